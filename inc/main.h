@@ -88,10 +88,12 @@ extern "C" {
  */
 //#define RGB_NOTIFICATIONS_CONNECTING_ONLY
 
-#define USART_RX_DATA_SIZE			256
+#define USART_RX_DATA_SIZE			256	// to the USB host, a power of 2
+#define USB_RX_DATA_SIZE			128	// from the USB host, at least 2 packets and at most 255
 
 /* Exported functions ------------------------------------------------------- */
 void Timing_Decrement(void);
+void LED_Animation_Tick(void);
 
 void USB_USART_Init(uint32_t baudRate);
 uint8_t USB_USART_Available_Data(void);
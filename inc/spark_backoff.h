@@ -0,0 +1,87 @@
+/**
+ ******************************************************************************
+ * @file    spark_backoff.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Exponential backoff with jitter for connection retries.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_BACKOFF_H
+#define __SPARK_BACKOFF_H
+
+#include <stdint.h>
+
+/**
+ * Spaces out retries after consecutive failures. The n-th retry waits
+ * between half and all of min(minimum * 2^(n-1), maximum) milliseconds,
+ * so that devices that lost the cloud at the same moment don't all come
+ * back at the same moment.
+ */
+class Backoff
+{
+	uint32_t minimum;
+	uint32_t maximum;
+	uint32_t retryAt;
+	uint32_t lastDelay;
+	uint8_t failures;
+
+public:
+	Backoff(uint32_t minimum, uint32_t maximum)
+		: minimum(minimum), maximum(maximum), retryAt(0), lastDelay(0), failures(0) {}
+
+	/**
+	 * Records a failed attempt and schedules the next one.
+	 * @param now       The current time in milliseconds.
+	 * @param random    Any random number, used for the jitter.
+	 */
+	void failed(uint32_t now, uint32_t random)
+	{
+		uint32_t delay = minimum;
+		for (uint8_t i = 0; i < failures && delay < maximum; i++)
+			delay <<= 1;
+		if (delay > maximum)
+			delay = maximum;
+
+		lastDelay = delay - (random % (delay / 2 + 1));
+		retryAt = now + lastDelay;
+		if (failures < 0xFF)
+			failures++;
+	}
+
+	/**
+	 * @return true when the next attempt may be made.
+	 */
+	bool ready(uint32_t now) const
+	{
+		return !failures || int32_t(now - retryAt) >= 0;
+	}
+
+	void reset()
+	{
+		failures = 0;
+		lastDelay = 0;
+	}
+
+	uint8_t failureCount() const { return failures; }
+
+	uint32_t delay() const { return lastDelay; }
+};
+
+#endif  /* __SPARK_BACKOFF_H */
@@ -0,0 +1,152 @@
+/**
+ ******************************************************************************
+ * @file    spark_connection_fsm.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   State machine of the Wi-Fi and cloud connection, driven by the
+ *          CC3000's asynchronous events and the steps of the main loop.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_CONNECTION_FSM_H
+#define __SPARK_CONNECTION_FSM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Number of events that can be posted between two calls to process(), a
+// power of 2
+#ifndef CONNECTION_QUEUE_DEPTH
+#define CONNECTION_QUEUE_DEPTH			8
+#endif
+
+// Ordered so that each state has all that the states before it have
+typedef enum
+{
+	CONNECTION_OFF = 0,				// the CC3000 is off
+	CONNECTION_WLAN_CONNECTING = 1,	// waiting to join an access point
+	CONNECTION_WLAN_ADDRESSING = 2,	// joined, waiting for DHCP
+	CONNECTION_WLAN_READY = 3,		// has an address, the cloud is not wanted
+	CONNECTION_CLOUD_WAITING = 4,	// waiting to try the cloud again
+	CONNECTION_CLOUD_CONNECTING = 5,	// resolving the server and opening the socket
+	CONNECTION_CLOUD_HANDSHAKE = 6,	// the socket is open
+	CONNECTION_CLOUD_CONNECTED = 7,
+	CONNECTION_STATE_COUNT = 8
+} Spark_Connection_State_TypeDef;
+
+typedef enum
+{
+	CONNECTION_EVENT_WLAN_STARTED = 0,		// the CC3000 was turned on
+	CONNECTION_EVENT_WLAN_STOPPED = 1,		// turned off, or reset
+	CONNECTION_EVENT_WLAN_CONNECTED = 2,	// HCI_EVNT_WLAN_UNSOL_CONNECT
+	CONNECTION_EVENT_WLAN_DISCONNECTED = 3,	// HCI_EVNT_WLAN_UNSOL_DISCONNECT
+	CONNECTION_EVENT_DHCP_OK = 4,			// HCI_EVNT_WLAN_UNSOL_DHCP with an address
+	CONNECTION_EVENT_DHCP_FAILED = 5,		// HCI_EVNT_WLAN_UNSOL_DHCP without one
+	CONNECTION_EVENT_CLOUD_WANTED = 6,		// SPARK_CLOUD_CONNECT was set
+	CONNECTION_EVENT_CLOUD_UNWANTED = 7,	// and cleared
+	CONNECTION_EVENT_CLOUD_RETRY = 8,		// the backoff has passed
+	CONNECTION_EVENT_SOCKET_OPENED = 9,
+	CONNECTION_EVENT_SOCKET_FAILED = 10,	// the server could not be reached
+	CONNECTION_EVENT_HANDSHAKE_OK = 11,
+	CONNECTION_EVENT_HANDSHAKE_FAILED = 12,
+	CONNECTION_EVENT_SOCKET_CLOSED = 13,	// by the server, or the protocol failed
+	CONNECTION_EVENT_COUNT = 14
+} Spark_Connection_Event_TypeDef;
+
+typedef struct
+{
+	uint32_t events;			// events handled
+	uint32_t transitions;		// events that matched a transition
+	uint32_t ignored;			// events with no transition from the state they arrived in
+	uint32_t dropped;			// events posted while the queue was full
+	uint32_t cloud_connects;	// times the cloud handshake completed
+	uint32_t last_cloud_millis;	// from the last start or loss of the cloud to the cloud
+	uint32_t max_cloud_millis;	// longest of those
+} Spark_Connection_State_Stats_TypeDef;
+
+/**
+ * The connection is in exactly one state, and only the events listed for
+ * that state in the transition table move it. Every other event is counted
+ * and ignored, so a late DHCP event can't put the cloud back up once the
+ * access point has gone.
+ *
+ * The CC3000's events are posted from its interrupt: post() only puts them in
+ * a ring that process() empties from the main loop. There is a single
+ * producer, WLAN_Async_Callback(), which the CC3000 driver does not reenter;
+ * events found by the main loop itself are dispatched directly.
+ */
+class ConnectionStateMachine
+{
+public:
+	/**
+	 * Called for each transition, including those back to the same state,
+	 * after the state has changed.
+	 */
+	typedef void (*Listener)(Spark_Connection_State_TypeDef from, Spark_Connection_Event_TypeDef event, Spark_Connection_State_TypeDef to);
+
+	/**
+	 * @return The current time in milliseconds.
+	 */
+	typedef uint32_t (*Clock)(void);
+
+	ConnectionStateMachine(Listener listener, Clock clock);
+
+	/**
+	 * Queues an event for process(). Safe from an interrupt.
+	 * @return false if the queue is full, the event is dropped.
+	 */
+	bool post(Spark_Connection_Event_TypeDef event);
+
+	/**
+	 * Handles the events posted since the last call, in order.
+	 * @return The number of events handled.
+	 */
+	int process();
+
+	/**
+	 * Handles an event now.
+	 * @return true if it moved the state machine.
+	 */
+	bool dispatch(Spark_Connection_Event_TypeDef event);
+
+	Spark_Connection_State_TypeDef state() const { return current; }
+
+	bool pending() const { return head != tail; }
+
+	void stats(Spark_Connection_State_Stats_TypeDef *stats) const;
+
+	static const char *name(Spark_Connection_State_TypeDef state);
+
+private:
+	Listener listener;
+	Clock clock;
+	Spark_Connection_State_TypeDef current;
+
+	volatile uint8_t queue[CONNECTION_QUEUE_DEPTH];
+	volatile uint8_t head;		// written by post() only
+	volatile uint8_t tail;		// written by process() only
+
+	uint32_t outage_start;		// when the cloud was last lost, or the CC3000 started
+	Spark_Connection_State_Stats_TypeDef counters;
+};
+
+// The Core's connection, fed by WLAN_Async_Callback() and SPARK_WLAN_Loop()
+extern ConnectionStateMachine Spark_Connection_State;
+
+#endif  /* __SPARK_CONNECTION_FSM_H */
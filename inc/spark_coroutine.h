@@ -0,0 +1,147 @@
+/**
+ ******************************************************************************
+ * @file    spark_coroutine.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Stackless coroutines in the protothread style, so a task can wait
+ *          for data, time or an event without blocking the main loop.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_COROUTINE_H
+#define __SPARK_COROUTINE_H
+
+#include <stdint.h>
+
+// The clock the timeouts are measured with, in milliseconds
+#ifndef CO_CLOCK
+#include "spark_wiring.h"
+#define CO_CLOCK()						millis()
+#endif
+
+#define CO_LINE_DONE					0xFFFF
+
+typedef enum
+{
+	CO_WAITING = 0,		// waiting for a condition or a delay
+	CO_YIELDED = 1,		// gave way to other work, and wants to run again
+	CO_DONE = 2			// reached CO_END or CO_EXIT
+} Spark_Coroutine_Status_TypeDef;
+
+/**
+ * The state a coroutine keeps between calls, 8 bytes: where it is waiting,
+ * and when the wait started.
+ *
+ * A coroutine is a function that takes its Coroutine and wraps its body in
+ * CO_BEGIN and CO_END. Each time it is called it carries on from where it
+ * last waited, and returns as soon as it has to wait again, so many of them
+ * can share the main loop:
+ *
+ *   Spark_Coroutine_Status_TypeDef readCommand(Coroutine &co)
+ *   {
+ *     CO_BEGIN(co);
+ *     while (1)
+ *     {
+ *       CO_AWAIT_TIMEOUT(co, Serial1.available() >= 4, 500);
+ *       if (!co.timedOut())
+ *         handle(Serial1);
+ *       CO_DELAY(co, 100);
+ *     }
+ *     CO_END(co);
+ *   }
+ *
+ *   Coroutine command;
+ *   void loop() { readCommand(command); }
+ *
+ * The waits are case labels of a switch, which gives two rules. Local
+ * variables are not kept across a wait, so keep state in statics or in a
+ * struct that extends Coroutine. A wait can't sit inside a switch statement
+ * of its own, or on the same line as another wait.
+ */
+struct Coroutine
+{
+	uint16_t line;			// the wait to resume at, 0 to start, CO_LINE_DONE when done
+	bool timed_out;
+	uint32_t started;		// CO_CLOCK() when the current wait started
+
+	Coroutine() : line(0), timed_out(false), started(0) {}
+
+	void reset() { line = 0; }
+
+	bool done() const { return line == CO_LINE_DONE; }
+
+	/**
+	 * @return true if the last CO_AWAIT_TIMEOUT ended by timing out.
+	 */
+	bool timedOut() const { return timed_out; }
+};
+
+// Each wait falls through into its own case label on the first pass. A
+// fallthrough comment is gone by the time the macro expands, so the
+// compilers that warn about it are told with the attribute
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define CO_FALLTHROUGH		__attribute__((fallthrough));
+#else
+#define CO_FALLTHROUGH
+#endif
+
+#define CO_LABEL(co) \
+	static_assert(__LINE__ < CO_LINE_DONE, "Coroutine waits must be on lines before 65535"); \
+	(co).line = __LINE__; CO_FALLTHROUGH case __LINE__:
+
+#define CO_BEGIN(co) \
+	switch ((co).line) { case CO_LINE_DONE: return CO_DONE; case 0:
+
+#define CO_END(co) \
+	} (co).line = CO_LINE_DONE; return CO_DONE
+
+// Returns, and carries on from here once condition is true
+#define CO_AWAIT(co, condition) \
+	do { CO_LABEL(co) if (!(condition)) return CO_WAITING; } while (0)
+
+// As CO_AWAIT, but gives up after ms milliseconds; check co.timedOut()
+#define CO_AWAIT_TIMEOUT(co, condition, ms) \
+	do { (co).started = CO_CLOCK(); (co).timed_out = false; CO_LABEL(co) \
+		if (!(condition)) { \
+			if ((uint32_t)(CO_CLOCK() - (co).started) < (uint32_t)(ms)) return CO_WAITING; \
+			(co).timed_out = true; \
+		} } while (0)
+
+// Returns, and carries on from here ms milliseconds later
+#define CO_DELAY(co, ms) \
+	do { (co).started = CO_CLOCK(); CO_LABEL(co) \
+		if ((uint32_t)(CO_CLOCK() - (co).started) < (uint32_t)(ms)) return CO_WAITING; } while (0)
+
+// Returns once, so other work can run, and carries on from here
+#define CO_YIELD(co) \
+	do { (co).line = __LINE__; return CO_YIELDED; case __LINE__:; } while (0)
+
+// Starts child over, and carries on from here once call, which runs it, is done
+#define CO_AWAIT_CHILD(co, child, call) \
+	do { (child).reset(); CO_LABEL(co) if (CO_DONE != (call)) return CO_WAITING; } while (0)
+
+// Ends the coroutine; later calls return CO_DONE until it is reset
+#define CO_EXIT(co) \
+	do { (co).line = CO_LINE_DONE; return CO_DONE; } while (0)
+
+// Starts the coroutine over on its next call
+#define CO_RESTART(co) \
+	do { (co).line = 0; return CO_YIELDED; } while (0)
+
+#endif  /* __SPARK_COROUTINE_H */
@@ -0,0 +1,97 @@
+/**
+ ******************************************************************************
+ * @file    spark_crc32.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Incremental CRC-32 with hardware, sliced table and nibble table
+ *          backends.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_CRC32_H
+#define __SPARK_CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * The CRC-32 of zip and ethernet (reflected polynomial 0xEDB88320, initial
+ * value and final xor 0xFFFFFFFF), the same value as Compute_CRC32() and the
+ * cloud. A CRC is built up as
+ *
+ *   uint32_t crc = crc32_init();
+ *   crc = crc32_update(crc, data, length);   // as often as needed
+ *   uint32_t value = crc32_final(crc);
+ */
+
+#define CRC32_BACKEND_HARDWARE			1	// the STM32 CRC peripheral, 4 bytes a cycle
+#define CRC32_BACKEND_SLICED			2	// CRC32_SLICES tables of 1 KB each
+#define CRC32_BACKEND_NIBBLE			3	// one 64 byte table, for small builds
+
+#ifndef CRC32_BACKEND
+#ifdef STM32F10X_MD
+#define CRC32_BACKEND					CRC32_BACKEND_HARDWARE
+#else
+#define CRC32_BACKEND					CRC32_BACKEND_SLICED
+#endif
+#endif
+
+// Bytes taken per step by the sliced backend, 4 or 8
+#ifndef CRC32_SLICES
+#define CRC32_SLICES					4
+#endif
+
+#define CRC32_INIT						0xFFFFFFFF
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline uint32_t crc32_init(void) { return CRC32_INIT; }
+
+/**
+ * Adds {@code length} bytes to a CRC, with the backend selected by
+ * CRC32_BACKEND.
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
+
+static inline uint32_t crc32_final(uint32_t crc) { return ~crc; }
+
+/**
+ * @return The CRC-32 of a whole buffer.
+ */
+uint32_t crc32_compute(const void *data, size_t length);
+
+/*
+ * Each backend, for cross checks and benchmarks. On the Core only the
+ * backend selected and the nibble backend are built, to keep the tables
+ * of the others out of flash. The hardware backend uses the CRC peripheral
+ * and must not be called from an interrupt; elsewhere it runs against a
+ * model of the peripheral, so the way it carries a CRC from one call to the
+ * next can be checked.
+ */
+uint32_t crc32_update_hardware(uint32_t crc, const void *data, size_t length);
+uint32_t crc32_update_sliced(uint32_t crc, const void *data, size_t length);
+uint32_t crc32_update_nibble(uint32_t crc, const void *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __SPARK_CRC32_H */
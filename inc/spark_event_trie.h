@@ -0,0 +1,228 @@
+/**
+ ******************************************************************************
+ * @file    spark_event_trie.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Prefix trie that dispatches inbound cloud events to the handlers
+ *          subscribed to a prefix of the event name.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_EVENT_TRIE_H
+#define __SPARK_EVENT_TRIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Same signature as the protocol's EventHandler.
+ */
+typedef void (*EventTrieHandler)(const char *event_name, const char *data);
+
+/**
+ * A character trie over subscription prefixes. Each node holds the handlers
+ * subscribed to the prefix that ends there, so dispatching an event walks
+ * the name once and calls every handler on the way - the cost grows with the
+ * length of the name, not the number of subscriptions.
+ *
+ * Nodes and handlers come from fixed pools sized by the template parameters.
+ * Children are kept in a sibling list sorted by character. Like the cloud
+ * tables, entries are never removed until the trie is cleared.
+ */
+template <int node_capacity, int handler_capacity>
+class EventTrie
+{
+    static_assert(node_capacity > 0 && node_capacity < 65535, "EventTrie node capacity must be 1..65534");
+    static_assert(handler_capacity > 0 && handler_capacity < 65535, "EventTrie handler capacity must be 1..65534");
+
+    // indices are stored + 1 so that 0 means none; node 0 is the root
+    struct Node
+    {
+        char c;
+        uint16_t child;
+        uint16_t sibling;
+        uint16_t handlers;
+    };
+
+    struct Entry
+    {
+        EventTrieHandler handler;
+        uint32_t hits;
+        uint16_t next;
+    };
+
+    Node nodes[node_capacity];
+    Entry entries[handler_capacity];
+    uint16_t node_count;
+    uint16_t entry_count;
+
+    /**
+     * Finds the child of {@code parent} for character {@code c}, creating it
+     * when {@code create} is set.
+     * @return The node index, or -1 if there is none or the pool is full.
+     */
+    int child(int parent, char c, bool create)
+    {
+        uint16_t* link = &nodes[parent].child;
+        while (*link && nodes[*link - 1].c < c)
+            link = &nodes[*link - 1].sibling;
+        if (*link && nodes[*link - 1].c == c)
+            return *link - 1;
+        if (!create || node_count >= node_capacity)
+            return -1;
+
+        Node& node = nodes[node_count];
+        node.c = c;
+        node.child = 0;
+        node.handlers = 0;
+        node.sibling = *link;
+        *link = ++node_count;
+        return node_count - 1;
+    }
+
+    int find_node(const char* prefix, size_t length) const
+    {
+        int node = 0;
+        for (size_t i = 0; i < length && node >= 0; i++)
+            node = const_cast<EventTrie*>(this)->child(node, prefix[i], false);
+        return node;
+    }
+
+    int find_handler(int node, EventTrieHandler handler) const
+    {
+        for (uint16_t id = nodes[node].handlers; id; id = entries[id - 1].next)
+        {
+            if (entries[id - 1].handler == handler)
+                return id - 1;
+        }
+        return -1;
+    }
+
+public:
+    EventTrie()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        memset(nodes, 0, sizeof(nodes));
+        memset(entries, 0, sizeof(entries));
+        node_count = 1;
+        entry_count = 0;
+    }
+
+    /**
+     * Subscribes {@code handler} to events whose name starts with the first
+     * {@code length} characters of {@code prefix}. Adding the same handler
+     * to the same prefix again returns the existing subscription.
+     * @return The subscription id, or -1 if the trie is full.
+     */
+    int add(const char* prefix, size_t length, EventTrieHandler handler)
+    {
+        // follow the nodes that are there already
+        int node = 0;
+        size_t matched = 0;
+        for (int next; matched < length && (next = child(node, prefix[matched], false)) >= 0; matched++)
+            node = next;
+
+        if (matched == length)
+        {
+            int id = find_handler(node, handler);
+            if (id >= 0)
+                return id;
+        }
+
+        // check there is room for all of it before any node is taken, so a
+        // failed add leaves no unreachable prefix behind
+        if (entry_count >= handler_capacity || length - matched > size_t(node_capacity - node_count))
+            return -1;
+        for (; matched < length; matched++)
+            node = child(node, prefix[matched], true);
+
+        // handlers at a node are called in the order they subscribed
+        uint16_t* link = &nodes[node].handlers;
+        while (*link)
+            link = &entries[*link - 1].next;
+
+        Entry& entry = entries[entry_count];
+        entry.handler = handler;
+        entry.hits = 0;
+        entry.next = 0;
+        *link = ++entry_count;
+        return entry_count - 1;
+    }
+
+    int add(const char* prefix, EventTrieHandler handler)
+    {
+        return add(prefix, strlen(prefix), handler);
+    }
+
+    /**
+     * @return The id of the subscription of {@code handler} to exactly
+     * {@code prefix}, or -1 if there is none.
+     */
+    int find(const char* prefix, EventTrieHandler handler) const
+    {
+        int node = find_node(prefix, strlen(prefix));
+        return node < 0 ? -1 : find_handler(node, handler);
+    }
+
+    /**
+     * Calls every handler subscribed to a prefix of {@code event_name},
+     * shortest prefix first, and counts a hit for each.
+     * @return The number of handlers called.
+     */
+    int dispatch(const char* event_name, const char* data)
+    {
+        int called = 0;
+        const char* next = event_name;
+        for (int node = 0; ; )
+        {
+            for (uint16_t id = nodes[node].handlers; id; id = entries[id - 1].next)
+            {
+                entries[id - 1].hits++;
+                entries[id - 1].handler(event_name, data);
+                called++;
+            }
+            char c = *next++;
+            if (!c || (node = child(node, c, false)) < 0)
+                break;
+        }
+        return called;
+    }
+
+    uint32_t hits(int id) const
+    {
+        return (id >= 0 && id < entry_count && id < handler_capacity) ? entries[id].hits : 0;
+    }
+
+    int handler_count() const
+    {
+        return entry_count;
+    }
+
+    int node_count_used() const
+    {
+        return node_count;
+    }
+};
+
+#endif  /* __SPARK_EVENT_TRIE_H */
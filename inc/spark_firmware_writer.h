@@ -0,0 +1,133 @@
+/**
+ ******************************************************************************
+ * @file    spark_firmware_writer.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Buffers OTA firmware chunks so that each is programmed while the
+ *          next one is on its way.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_FIRMWARE_WRITER_H
+#define __SPARK_FIRMWARE_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "spark_flash_region.h"
+
+// The largest chunk the cloud sends; larger chunks are programmed directly
+#ifndef FIRMWARE_CHUNK_BUFFER_SIZE
+#define FIRMWARE_CHUNK_BUFFER_SIZE		512
+#endif
+
+typedef struct
+{
+	uint32_t chunks;			// chunks saved
+	uint32_t bytes;				// bytes saved
+	uint32_t stalls;			// chunks that arrived before the previous one was programmed
+	uint32_t stall_micros;		// time chunks waited for the previous one to be programmed
+	uint32_t program_micros;	// time spent programming
+	uint32_t elapsed_micros;	// from begin() to the last chunk programmed
+	uint32_t bytes_per_second;	// bytes programmed over the elapsed time
+	uint32_t failed;			// chunks that did not read back as written
+	uint32_t crc;				// CRC-32 of the image saved so far
+} Spark_Firmware_Write_Stats_TypeDef;
+
+/**
+ * Sits between the protocol and the flash. The protocol acknowledges a
+ * chunk once save() returns, and waits for the next chunk before it reads
+ * more; save() only copies the chunk, and service() programs it while the
+ * next chunk travels. The protocol's receive buffer and this one make the
+ * two halves of a double buffer: a chunk that arrives while the previous one
+ * is still waiting is held until that one has been programmed.
+ *
+ * A CRC-32 of the image is updated as each chunk arrives.
+ */
+class FirmwareWriter
+{
+public:
+	/**
+	 * Programs and verifies a chunk at the next address.
+	 * @return The number of chunks programmed and verified since the update
+	 * began - it does not advance when the chunk did not verify.
+	 */
+	typedef uint16_t (*Programmer)(unsigned char *buf, uint32_t length);
+
+	/**
+	 * @return The current time in microseconds.
+	 */
+	typedef uint32_t (*Clock)(void);
+
+	FirmwareWriter(Programmer programmer, Clock clock);
+
+	/**
+	 * Starts a new image.
+	 */
+	void begin();
+
+	/**
+	 * Takes a chunk. It is copied, and programmed by the next call to
+	 * service(), save() or finish().
+	 */
+	void save(const uint8_t *buf, size_t length);
+
+	/**
+	 * Programs the chunk waiting, if there is one.
+	 * @return true if a chunk was programmed.
+	 */
+	bool service();
+
+	/**
+	 * Programs the chunk waiting.
+	 * @return false if any chunk of the image did not verify.
+	 */
+	bool finish();
+
+	/**
+	 * Reads the image back and compares its CRC with that of the chunks
+	 * saved.
+	 * @param image The region the image was programmed to.
+	 */
+	bool verify(const FlashRegion &image) const;
+
+	bool pending() const { return pendingLength != 0; }
+
+	uint16_t saved() const { return counters.chunks; }
+
+	uint32_t savedBytes() const { return counters.bytes; }
+
+	bool failed() const { return counters.failed != 0; }
+
+	void stats(Spark_Firmware_Write_Stats_TypeDef *stats) const;
+
+private:
+	Programmer programmer;
+	Clock clock;
+	uint8_t buffer[FIRMWARE_CHUNK_BUFFER_SIZE];
+	size_t pendingLength;
+	uint16_t programmed;
+	uint32_t started;
+	uint32_t crc;
+
+	Spark_Firmware_Write_Stats_TypeDef counters;
+
+	void program(uint8_t *buf, size_t length);
+};
+
+#endif  /* __SPARK_FIRMWARE_WRITER_H */
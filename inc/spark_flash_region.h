@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * @file    spark_flash_region.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Page-oriented access to a region of flash memory.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_FLASH_REGION_H
+#define __SPARK_FLASH_REGION_H
+
+#include <stdint.h>
+
+/**
+ * A region of NOR flash made of equally sized erase pages. Addresses are
+ * relative to the start of the region. The methods mirror those of
+ * Flashee::FlashDevice, so a Flashee device can stand in for the
+ * external flash in the host tests.
+ */
+class FlashRegion
+{
+public:
+	virtual ~FlashRegion() {}
+
+	virtual uint32_t pageSize() const = 0;
+	virtual uint32_t pageCount() const = 0;
+
+	uint32_t length() const { return pageSize() * pageCount(); }
+
+	/**
+	 * Sets all bytes of the page containing {@code address} to 0xFF.
+	 */
+	virtual bool erasePage(uint32_t address) = 0;
+
+	/**
+	 * Programs data without erasing first: bits can only be cleared.
+	 * The data must not span a page boundary.
+	 */
+	virtual bool writePage(const void *data, uint32_t address, uint32_t length) = 0;
+
+	virtual bool readPage(void *data, uint32_t address, uint32_t length) const = 0;
+};
+
+/**
+ * A region of the external serial flash.
+ */
+class ExternalFlashRegion : public FlashRegion
+{
+	uint32_t base;
+	uint32_t pages;
+
+public:
+	/**
+	 * @param address   The address of the first sector, sector aligned.
+	 * @param sectors   The number of sectors in the region.
+	 */
+	ExternalFlashRegion(uint32_t address, uint32_t sectors) : base(address), pages(sectors) {}
+
+	virtual uint32_t pageSize() const;
+	virtual uint32_t pageCount() const { return pages; }
+	virtual bool erasePage(uint32_t address);
+	virtual bool writePage(const void *data, uint32_t address, uint32_t length);
+	virtual bool readPage(void *data, uint32_t address, uint32_t length) const;
+};
+
+#endif  /* __SPARK_FLASH_REGION_H */
@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ * @file    spark_function_queue.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Queue of cloud function calls deferred to the main loop.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_FUNCTION_QUEUE_H
+#define __SPARK_FUNCTION_QUEUE_H
+
+#include <stdint.h>
+
+// Longest argument a function is called with, not counting the NUL
+#define USER_FUNC_ARG_LENGTH			64
+
+// Number of deferred function calls that can wait for the main loop
+#ifndef USER_FUNC_QUEUE_DEPTH
+#define USER_FUNC_QUEUE_DEPTH			4
+#endif
+
+typedef struct
+{
+	uint32_t queued;		// deferred calls accepted
+	uint32_t dropped;		// deferred calls refused because the queue was full
+	uint16_t pending;		// calls waiting to run
+	uint16_t high_water;	// most calls ever waiting at once
+} Spark_Function_Queue_Stats_TypeDef;
+
+/**
+ * A fixed-size FIFO of function calls received from the cloud, run one at a
+ * time from the main loop. Each call holds the function's index in the
+ * lookup table and a copy of its argument, truncated to
+ * USER_FUNC_ARG_LENGTH characters.
+ *
+ * A call is taken off the queue before it runs, so the function may call
+ * Spark.process() and queue further calls.
+ */
+class FunctionQueue
+{
+public:
+	/**
+	 * Runs a deferred call.
+	 * @param index The index the call was queued with.
+	 */
+	typedef void (*Runner)(int index, const char *arg);
+
+	FunctionQueue(Runner runner);
+
+	/**
+	 * Queues a call.
+	 * @return false if the queue is full, the call is dropped.
+	 */
+	bool add(int index, const char *arg);
+
+	/**
+	 * Runs the oldest call.
+	 * @return false if there was none.
+	 */
+	bool process();
+
+	void clear();
+
+	int pending() const { return count; }
+
+	void stats(Spark_Function_Queue_Stats_TypeDef *stats) const;
+
+private:
+	struct Call
+	{
+		int index;
+		char arg[USER_FUNC_ARG_LENGTH + 1];
+	};
+
+	Runner runner;
+	Call calls[USER_FUNC_QUEUE_DEPTH];
+	uint8_t head;
+	uint8_t count;
+
+	Spark_Function_Queue_Stats_TypeDef counters;
+};
+
+#endif  /* __SPARK_FUNCTION_QUEUE_H */
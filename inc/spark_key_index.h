@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * @file    spark_key_index.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Hashed index over the fixed-length keys of the cloud variable and
+ *          function lookup tables.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_KEY_INDEX_H
+#define __SPARK_KEY_INDEX_H
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Returns the smallest power of two that is at least twice {@code count},
+ * which keeps the load factor of the index at or below 50%.
+ */
+constexpr int key_index_buckets(int count, int buckets = 4)
+{
+    return buckets >= 2 * count ? buckets : key_index_buckets(count, buckets * 2);
+}
+
+/**
+ * An open-addressed hash index that maps keys to the slot they occupy in a
+ * lookup table. The keys are not copied - the table remains the owner, and
+ * the index only stores slot numbers. A key is hashed once when it is added,
+ * and a lookup costs one hash plus, in the usual case, a single key compare.
+ *
+ * Keys compare like {@code strncmp(a, b, key_length)}, so they may be NUL
+ * terminated or fill the whole key length.
+ *
+ * Entries are never removed; this matches the cloud tables, which only grow
+ * until the next reset.
+ */
+template <int capacity, int key_length>
+class KeyIndex
+{
+public:
+    typedef const char* (*KeyAccessor)(int slot);
+
+    static const int bucket_count = key_index_buckets(capacity);
+
+private:
+    static_assert(capacity > 0 && capacity < 255, "KeyIndex capacity must be 1..254");
+
+    // slot number + 1, or 0 when the bucket is empty
+    uint8_t buckets[bucket_count];
+    KeyAccessor key_at;
+
+public:
+    KeyIndex(KeyAccessor accessor) : key_at(accessor)
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        memset(buckets, 0, sizeof(buckets));
+    }
+
+    /**
+     * FNV-1a over the significant characters of the key.
+     */
+    static uint32_t hash(const char* key)
+    {
+        uint32_t h = 2166136261u;
+        for (int i = 0; i < key_length && key[i]; i++)
+        {
+            h ^= uint8_t(key[i]);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    /**
+     * Finds the slot for the given key.
+     * @return The slot number, or -1 if the key is not in the index.
+     */
+    int find(const char* key) const
+    {
+        for (int i = hash(key) & (bucket_count - 1), probes = 0; probes < bucket_count; probes++)
+        {
+            if (!buckets[i])
+                break;
+            int slot = buckets[i] - 1;
+            if (0 == strncmp(key_at(slot), key, key_length))
+                return slot;
+            i = (i + 1) & (bucket_count - 1);
+        }
+        return -1;
+    }
+
+    /**
+     * Adds a key that has been stored at {@code slot} in the table.
+     * The caller is expected to have checked the key is not already present.
+     * @return false if the index is full.
+     */
+    bool add(const char* key, int slot)
+    {
+        for (int i = hash(key) & (bucket_count - 1), probes = 0; probes < bucket_count; probes++)
+        {
+            if (!buckets[i])
+            {
+                buckets[i] = uint8_t(slot + 1);
+                return true;
+            }
+            i = (i + 1) & (bucket_count - 1);
+        }
+        return false;
+    }
+};
+
+template <int capacity, int key_length>
+const int KeyIndex<capacity, key_length>::bucket_count;
+
+#endif  /* __SPARK_KEY_INDEX_H */
@@ -0,0 +1,139 @@
+/**
+ ******************************************************************************
+ * @file    spark_led_animation.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Plays the RGB status animations from tables of keyframes.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_LED_ANIMATION_H
+#define __SPARK_LED_ANIMATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// How often the animation is advanced
+#ifndef LED_ANIMATION_TICK_MILLIS
+#define LED_ANIMATION_TICK_MILLIS		10
+#endif
+
+// A keyframe of this color shows the color the animation was played with
+#define LED_KEYFRAME_BASE_COLOR			0xFF000000
+
+// The keyframe's level fades to the next keyframe's over its duration
+#define LED_KEYFRAME_RAMP				0x01
+
+typedef struct
+{
+	uint32_t color;			// 0xRRGGBB, or LED_KEYFRAME_BASE_COLOR
+	uint16_t millis;		// how long the keyframe lasts
+	uint8_t level;			// brightness, 0 to 255 before gamma correction
+	uint8_t flags;
+} LedKeyframe;
+
+typedef struct
+{
+	const LedKeyframe *frames;
+	uint8_t count;
+} LedAnimation;
+
+// The system status animations
+extern const LedAnimation LED_ANIMATION_BREATHE;		// slow breathing, the cloud or listening
+extern const LedAnimation LED_ANIMATION_BLINK;			// 100 ms on and off, connecting to the network
+extern const LedAnimation LED_ANIMATION_BLINK_FAST;		// 50 ms on and off, connecting to the cloud
+extern const LedAnimation LED_ANIMATION_SIGNAL;			// the rainbow shown while the cloud signals the Core
+extern const LedAnimation LED_ANIMATION_ERROR;			// one 500 ms blink, repeated for the error code
+
+/**
+ * Steps through the keyframes of an animation as advance() is called, and
+ * hands each new color to the sink, corrected for gamma and scaled by the
+ * keyframe's level. Nothing is computed for the ticks within a keyframe that
+ * does not ramp, and the sink is only called when the color changes.
+ *
+ * play() may be called from the main loop while advance() runs in an
+ * interrupt: it only leaves a request, which advance() takes up.
+ */
+class LedAnimator
+{
+public:
+	/**
+	 * Shows a color, 0xRRGGBB.
+	 */
+	typedef void (*Sink)(uint32_t color);
+
+	// constexpr so that the status LED's animator is ready before the C++
+	// constructors run, SysTick starts in SparkCoreConfig()
+	constexpr LedAnimator(Sink sink)
+		: sink(sink), current{ NULL, 0, 0 }, next{ NULL, 0, 0 }, requested(false),
+		  frame(0), played(0), elapsed(0), shown(0), showing(false)
+	{
+	}
+
+	/**
+	 * Starts an animation from its first keyframe, unless it is already
+	 * playing with the same color.
+	 * @param repeats  The number of times to play it, 0 for ever.
+	 */
+	void play(const LedAnimation &animation, uint32_t color, uint8_t repeats = 0);
+
+	/**
+	 * Leaves the LED as it is, for code that drives it directly.
+	 */
+	void stop();
+
+	/**
+	 * @return true until an animation played a limited number of times has
+	 * ended, or it was stopped.
+	 */
+	bool playing() const;
+
+	void advance(uint32_t millis);
+
+	/**
+	 * @return {@code color} at {@code level}, gamma corrected.
+	 */
+	static uint32_t scale(uint32_t color, uint8_t level);
+
+private:
+	struct Request
+	{
+		const LedAnimation *animation;
+		uint32_t color;
+		uint8_t repeats;
+	};
+
+	Sink sink;
+	Request current;
+	Request next;
+	volatile bool requested;
+
+	uint8_t frame;
+	uint8_t played;
+	uint16_t elapsed;
+	uint32_t shown;
+	bool showing;
+
+	void show(const LedKeyframe &keyframe, uint8_t level);
+};
+
+// The RGB LED's status animation, advanced by PendSV_Handler()
+extern LedAnimator Led_Animator;
+
+#endif  /* __SPARK_LED_ANIMATION_H */
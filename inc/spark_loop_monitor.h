@@ -0,0 +1,166 @@
+/**
+ ******************************************************************************
+ * @file    spark_loop_monitor.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Histograms of main loop iteration times and of the period of the
+ *          application's loop(), with the worst period and what caused it.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_LOOP_MONITOR_H
+#define __SPARK_LOOP_MONITOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bucket n counts times from 2^n to 2^(n+1) microseconds, the last bucket
+// everything longer: 20 buckets reach 0.5 seconds
+#ifndef LOOP_MONITOR_BUCKETS
+#define LOOP_MONITOR_BUCKETS			20
+#endif
+
+#define LOOP_MONITOR_BLOB_VERSION		1
+
+// Bytes serialize() writes
+#define LOOP_MONITOR_BLOB_LENGTH		(2 + 4 * LOOP_MONITOR_BUCKETS + 12 + 13)
+
+typedef enum
+{
+	LOOP_SUBSYSTEM_NONE = 0,		// the main loop itself, or loop()
+	LOOP_SUBSYSTEM_WLAN = 1,		// SPARK_WLAN_Loop(), less the work below
+	LOOP_SUBSYSTEM_CONNECT = 2,		// resolving and opening the cloud socket
+	LOOP_SUBSYSTEM_HANDSHAKE = 3,
+	LOOP_SUBSYSTEM_CLOUD = 4,		// Spark_Communication_Loop()
+	LOOP_SUBSYSTEM_OTA = 5,			// saving and programming firmware chunks
+	LOOP_SUBSYSTEM_DELAY = 6,		// waiting in delay()
+	LOOP_SUBSYSTEM_COUNT = 7
+} Spark_Loop_Subsystem_TypeDef;
+
+typedef struct
+{
+	uint32_t period_micros;			// the longest time from one loop() to the next
+	uint32_t subsystem_micros;		// the time the subsystem below took of it
+	uint32_t at_millis;				// when it ended
+	uint8_t subsystem;				// the subsystem that took the most of it
+} Spark_Loop_Worst_TypeDef;
+
+/**
+ * iteration() is called at the top of each pass of the main loop, and
+ * userLoop() before each call of loop(). The time since the previous call
+ * of each goes into a histogram of log2 buckets of microseconds, which
+ * costs a count of leading zeros and no division.
+ *
+ * Subsystems mark their work with enter() and leave(), or with
+ * LoopMonitorScope. Time is charged to the innermost subsystem running, so
+ * the WLAN loop is not charged for the handshake it calls. The subsystem
+ * that took the most of the longest loop() period is kept with it.
+ *
+ * Counts saturate at 65535. serialize() writes everything as a little endian
+ * blob of LOOP_MONITOR_BLOB_LENGTH bytes for Serial, and report() as hex for
+ * a Spark.variable:
+ *
+ *   version, bucket count                            uint8 each
+ *   iteration histogram, period histogram            uint16 each bucket
+ *   iterations, loop() calls, longest iteration us   uint32
+ *   worst period us, its subsystem us, at ms         uint32
+ *   worst subsystem                                  uint8
+ */
+class LoopMonitor
+{
+public:
+	/**
+	 * @return The time, in microseconds or milliseconds as named.
+	 */
+	typedef uint32_t (*Clock)(void);
+
+	LoopMonitor(Clock micros, Clock millis);
+
+	void reset();
+
+	void iteration();
+
+	void userLoop();
+
+	/**
+	 * @return The subsystem that was running, to be passed to leave().
+	 */
+	Spark_Loop_Subsystem_TypeDef enter(Spark_Loop_Subsystem_TypeDef subsystem);
+
+	void leave(Spark_Loop_Subsystem_TypeDef previous);
+
+	uint16_t iterations(int bucket) const { return iterationHistogram[bucket]; }
+
+	uint16_t periods(int bucket) const { return periodHistogram[bucket]; }
+
+	const Spark_Loop_Worst_TypeDef &worst() const { return worstPeriod; }
+
+	/**
+	 * @return The bytes written, or 0 if {@code size} is less than
+	 * LOOP_MONITOR_BLOB_LENGTH.
+	 */
+	size_t serialize(uint8_t *buffer, size_t size) const;
+
+	/**
+	 * Writes the blob as hex, NUL terminated.
+	 * @return The length written, or 0 if {@code size} is too small.
+	 */
+	size_t report(char *buffer, size_t size) const;
+
+	static int bucket(uint32_t micros);
+
+private:
+	Clock micros;
+	Clock millis;
+
+	uint16_t iterationHistogram[LOOP_MONITOR_BUCKETS];
+	uint16_t periodHistogram[LOOP_MONITOR_BUCKETS];
+	uint32_t iterationCount;
+	uint32_t loopCount;
+	uint32_t longestIteration;
+	Spark_Loop_Worst_TypeDef worstPeriod;
+
+	uint32_t lastIteration;
+	uint32_t lastLoop;
+
+	Spark_Loop_Subsystem_TypeDef running;
+	uint32_t runningSince;
+	uint32_t charged[LOOP_SUBSYSTEM_COUNT];		// this period, by subsystem
+
+	void charge(uint32_t now);
+	static void add(uint16_t *histogram, uint32_t micros);
+};
+
+class LoopMonitorScope
+{
+	LoopMonitor &monitor;
+	Spark_Loop_Subsystem_TypeDef previous;
+
+public:
+	LoopMonitorScope(LoopMonitor &monitor, Spark_Loop_Subsystem_TypeDef subsystem)
+		: monitor(monitor), previous(monitor.enter(subsystem)) {}
+
+	~LoopMonitorScope() { monitor.leave(previous); }
+};
+
+extern LoopMonitor Loop_Monitor;
+
+#define LOOP_MONITOR_SCOPE(subsystem)	LoopMonitorScope loop_monitor_scope_(Loop_Monitor, subsystem)
+
+#endif  /* __SPARK_LOOP_MONITOR_H */
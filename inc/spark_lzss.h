@@ -0,0 +1,143 @@
+/**
+ ******************************************************************************
+ * @file    spark_lzss.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Streaming LZSS decoder for compressed firmware images.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_LZSS_H
+#define __SPARK_LZSS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The largest window the decoder supports: 2^LZSS_WINDOW_BITS bytes of RAM
+#ifndef LZSS_WINDOW_BITS
+#define LZSS_WINDOW_BITS				10
+#endif
+
+#define LZSS_WINDOW_SIZE				(1 << LZSS_WINDOW_BITS)
+
+// The largest image that may be inflated: the OTA region of the external
+// flash, EXTERNAL_FLASH_BLOCK_SIZE
+#ifndef LZSS_IMAGE_LENGTH_MAX
+#define LZSS_IMAGE_LENGTH_MAX			0x20000
+#endif
+
+// "SPZ1", the first bytes of a compressed image
+#define LZSS_MAGIC						0x315A5053
+
+#define LZSS_HEADER_LENGTH				16
+
+// A match encodes lengths from LZSS_MIN_MATCH
+#define LZSS_MIN_MATCH					3
+
+typedef enum
+{
+	LZSS_OK = 0,				// more data is expected
+	LZSS_DONE = 1,				// the image is complete and its CRC matches
+	LZSS_BAD_HEADER = 2,		// not a compressed image, or its window or image is too large
+	LZSS_BAD_DATA = 3,			// a match reaching before the start of the image or past its end
+	LZSS_WRITE_FAILED = 4,		// the writer refused the output
+	LZSS_BAD_TARGET = 5			// the image does not have the CRC expected
+} Spark_Lzss_Status_TypeDef;
+
+/**
+ * Inflates a compressed image that is fed to it in pieces of any size:
+ *
+ *   header   "SPZ1", image length, image CRC-32 (little endian uint32),
+ *            window bits, 3 reserved bytes
+ *   data     groups of a flag byte and up to 8 items, the least significant
+ *            flag first: 1 is a literal byte, 0 a 2 byte match of
+ *            window-bits distance - 1 and (16 - window-bits) length - 3,
+ *            big endian
+ *
+ * An image longer than LZSS_IMAGE_LENGTH_MAX is refused at the header. The
+ * stream ends when the image length has been produced, and the CRC is
+ * checked then. The window is also the output buffer: each half is handed
+ * to the writer as it fills, so RAM use is one window plus a few bytes of
+ * state.
+ */
+class LzssDecoder
+{
+public:
+	/**
+	 * Takes the next block of the image.
+	 * @return false if the block could not be written.
+	 */
+	typedef bool (*Writer)(const uint8_t *data, size_t length);
+
+	LzssDecoder(Writer writer);
+
+	void begin();
+
+	/**
+	 * Inflates the next piece of the compressed image.
+	 * @return LZSS_OK while more is expected, LZSS_DONE once the image is
+	 * complete and verified, or an error, after which further input is
+	 * ignored.
+	 */
+	Spark_Lzss_Status_TypeDef inflate(const uint8_t *data, size_t length);
+
+	Spark_Lzss_Status_TypeDef status() const { return result; }
+
+	uint32_t written() const { return total; }
+
+	/**
+	 * @return true if {@code data} starts with the compressed image magic.
+	 */
+	static bool isCompressed(const uint8_t *data, size_t length);
+
+private:
+	enum State
+	{
+		HEADER, FLAGS, ITEM, MATCH, FINISHED
+	};
+
+	Writer writer;
+	State state;
+	Spark_Lzss_Status_TypeDef result;
+
+	uint8_t header[LZSS_HEADER_LENGTH];
+	uint8_t header_length;
+	uint8_t window_bits;
+	uint32_t image_length;
+	uint32_t image_crc;
+
+	uint8_t flags;
+	uint8_t flag_count;
+	uint8_t match_high;
+
+	uint8_t window[LZSS_WINDOW_SIZE];
+	uint16_t position;		// next byte of the window to fill
+	uint16_t flushed;		// start of the bytes not yet written
+	uint32_t total;			// bytes produced, written or not
+	uint32_t crc;
+
+	bool put(uint8_t b);
+	bool nextItem();
+	bool flush();
+	Spark_Lzss_Status_TypeDef parseHeader();
+	Spark_Lzss_Status_TypeDef finish();
+	Spark_Lzss_Status_TypeDef fail(Spark_Lzss_Status_TypeDef error);
+};
+
+#endif  /* __SPARK_LZSS_H */
@@ -0,0 +1,163 @@
+/**
+ ******************************************************************************
+ * @file    spark_offline_log.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Append-only log in flash of the events published while offline.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_OFFLINE_LOG_H
+#define __SPARK_OFFLINE_LOG_H
+
+#include "spark_flash_region.h"
+#include "spark_publish_queue.h"
+
+// Where the log lives in the external flash: by default 32KB near the top
+// of the system area, ending a sector below the factory reset image.
+// The region from 0x80000 to the end of the flash belongs to the
+// application (Flashee uses all of it), so the log must stay out of it.
+#ifndef OFFLINE_LOG_ADDRESS
+#define OFFLINE_LOG_ADDRESS				0x17000
+#endif
+
+#ifndef OFFLINE_LOG_SECTORS
+#define OFFLINE_LOG_SECTORS				8
+#endif
+
+// Minimum time between replayed events, leaving cloud budget for live events
+#ifndef OFFLINE_REPLAY_INTERVAL_MILLIS
+#define OFFLINE_REPLAY_INTERVAL_MILLIS	2000
+#endif
+
+typedef struct
+{
+	uint32_t stored;		// events appended to the log
+	uint32_t replayed;		// events taken from the log to be published
+	uint32_t overwritten;	// events lost when the log wrapped before they were replayed
+	uint32_t corrupt;		// records skipped because they failed their CRC
+	uint32_t pending;		// events waiting to be replayed
+} Spark_Offline_Log_Stats_TypeDef;
+
+struct OfflineEvent
+{
+	char name[PUBLISH_NAME_LENGTH];
+	char data[PUBLISH_DATA_LENGTH];
+	uint32_t ttl;
+	bool hasData;
+	bool isPrivate;
+};
+
+/**
+ * Stores events in a circular sequence of flash pages. Each record carries
+ * a sequence number and a CRC, and records never span pages, so the read
+ * and write positions can be recovered after a reset by scanning the first
+ * record of each page. A record that was only partly written when power
+ * was lost fails its CRC, and the rest of that page is not used.
+ *
+ * Replayed records are marked by clearing a flag in their header, which
+ * needs no erase. When the log is full the oldest page is erased, losing
+ * the events in it that had not been replayed.
+ */
+class OfflineLog
+{
+public:
+	OfflineLog(FlashRegion &flash);
+
+	/**
+	 * Recovers the read and write positions from the flash contents.
+	 */
+	void begin();
+
+	/**
+	 * Appends an event. A NULL eventData stores an event without data.
+	 */
+	bool append(const char *eventName, const char *eventData, uint32_t ttl, bool isPrivate);
+
+	/**
+	 * Appends an event whose name and data need not be NUL terminated.
+	 */
+	bool append(const char *eventName, size_t nameLength, const char *eventData, size_t dataLength, uint32_t ttl, bool isPrivate);
+
+	/**
+	 * Reads the oldest event not yet replayed.
+	 * @return false when there are no events to replay.
+	 */
+	bool peek(OfflineEvent &event);
+
+	/**
+	 * Marks the event returned by peek() as replayed.
+	 */
+	void consume();
+
+	/**
+	 * Replays through the publish queue. Once the queue is empty, the event
+	 * queued by the last call is marked replayed if the queue sent it, and
+	 * the next one is queued. An event is only marked replayed once it has
+	 * been sent, so one the protocol refused or a reset cut off is
+	 * replayed again. Call before each drain() of the queue.
+	 * @return true if an event was queued.
+	 */
+	bool replay(PublishQueue &queue);
+
+	uint32_t pending() const { return counters.pending; }
+
+	void stats(Spark_Offline_Log_Stats_TypeDef *stats) const { *stats = counters; }
+
+private:
+	struct Header
+	{
+		uint16_t magic;
+		uint16_t replayed;	// 0xFFFF until the record is replayed
+		uint32_t sequence;
+		uint32_t ttl;
+		uint16_t length;	// of the payload: the name, a NUL, then the data
+		uint8_t flags;
+		uint8_t reserved;
+		uint32_t crc;		// of the header from sequence onwards and the payload
+	};
+
+	enum RecordState { RECORD_VALID, RECORD_ERASED, RECORD_INVALID };
+
+	FlashRegion &flash;
+	uint32_t pageSize;
+	uint32_t pageCount;
+
+	uint32_t writePage;
+	uint32_t writeOffset;
+	uint32_t nextSequence;
+
+	uint32_t readPage;
+	uint32_t readOffset;
+
+	// the event queued by replay() until the queue has sent it
+	bool replaying;
+	uint32_t replaySequence;
+	uint32_t replaySentBefore;	// the queue's sent count when it was queued
+
+	Spark_Offline_Log_Stats_TypeDef counters;
+
+	RecordState readRecord(uint32_t page, uint32_t offset, Header &header, uint8_t *payload);
+	static uint32_t recordSize(const Header &header);
+	static uint32_t recordCRC(const Header &header, const uint8_t *payload);
+	uint32_t countPending(uint32_t page, uint32_t &firstOffset, bool &corrupt);
+	void seekPending();
+};
+
+#endif  /* __SPARK_OFFLINE_LOG_H */
@@ -0,0 +1,160 @@
+/**
+ ******************************************************************************
+ * @file    spark_patch.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Rebuilds a firmware image from the running image and a binary
+ *          patch, as the patch streams in.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_PATCH_H
+#define __SPARK_PATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Output is handed on in blocks of this size, the size of an OTA chunk
+#ifndef PATCH_OUTPUT_BUFFER_SIZE
+#define PATCH_OUTPUT_BUFFER_SIZE		512
+#endif
+
+// The largest image a patch may rebuild: the OTA region of the external
+// flash, EXTERNAL_FLASH_BLOCK_SIZE
+#ifndef PATCH_TARGET_LENGTH_MAX
+#define PATCH_TARGET_LENGTH_MAX			0x20000
+#endif
+
+// "SPD1", the first bytes of a patch. An image starts with its stack
+// pointer, 0x2000xxxx, so the two can't be mistaken for each other.
+#define PATCH_MAGIC						0x31445053
+
+#define PATCH_HEADER_LENGTH				20
+
+typedef enum
+{
+	PATCH_OK = 0,				// more patch data is expected
+	PATCH_DONE = 1,				// the image is complete and its CRC matches
+	PATCH_BAD_HEADER = 2,		// not a patch, or its image is too large
+	PATCH_WRONG_SOURCE = 3,		// the patch is for another image than the one running
+	PATCH_BAD_DATA = 4,			// an unknown operation, or one reaching outside the images
+	PATCH_WRITE_FAILED = 5,		// the sink refused the output
+	PATCH_BAD_TARGET = 6		// the image rebuilt does not have the length or CRC expected
+} Spark_Patch_Status_TypeDef;
+
+/**
+ * Applies a patch that is fed to it in pieces of any size. The patch is
+ * a 20 byte header followed by operations:
+ *
+ *   header     "SPD1", source length, source CRC-32, target length,
+ *              target CRC-32 - all little endian uint32
+ *   COPY  0x01 length, offset   copy length bytes of the source
+ *   ADD   0x02 length, offset   then length bytes, each added to the
+ *                               next byte of the source
+ *   DATA  0x03 length           then length bytes of new data
+ *   END   0x00
+ *
+ * Lengths are unsigned LEB128 varints. Offsets are zigzag encoded signed
+ * varints, relative to where the previous COPY or ADD left off in the
+ * source, so code that only moved costs a few bytes. The target length is
+ * checked against PATCH_TARGET_LENGTH_MAX and the source against its CRC
+ * before the first operation, and the image produced against the target
+ * CRC and length at the end.
+ *
+ * RAM use is the output buffer: COPY reads the source straight into it,
+ * and ADD reads the source into it before the patch bytes are added.
+ */
+class PatchApplier
+{
+public:
+	/**
+	 * Reads the source image.
+	 * @return false if the range is outside the image.
+	 */
+	typedef bool (*Reader)(uint8_t *data, uint32_t offset, uint32_t length);
+
+	/**
+	 * Takes the next block of the image being rebuilt.
+	 * @return false if the block could not be written.
+	 */
+	typedef bool (*Writer)(const uint8_t *data, size_t length);
+
+	PatchApplier(Reader reader, Writer writer);
+
+	void begin();
+
+	/**
+	 * Applies the next piece of the patch.
+	 * @return PATCH_OK while more is expected, PATCH_DONE once the patch
+	 * has ended and the image is verified, or an error, after which
+	 * further input is ignored.
+	 */
+	Spark_Patch_Status_TypeDef apply(const uint8_t *data, size_t length);
+
+	Spark_Patch_Status_TypeDef status() const { return result; }
+
+	uint32_t targetLength() const { return target_length; }
+
+	uint32_t written() const { return output_total; }
+
+	/**
+	 * @return true if {@code data} starts with the patch magic.
+	 */
+	static bool isPatch(const uint8_t *data, size_t length);
+
+private:
+	enum State
+	{
+		HEADER, OPCODE, LENGTH, OFFSET, ADD_BYTES, DATA_BYTES, FINISHED
+	};
+
+	Reader reader;
+	Writer writer;
+	State state;
+	Spark_Patch_Status_TypeDef result;
+
+	uint8_t header[PATCH_HEADER_LENGTH];
+	uint8_t header_length;
+	uint32_t source_length;
+	uint32_t target_length;
+	uint32_t target_crc;
+
+	uint8_t opcode;
+	uint32_t varint;
+	uint8_t varint_shift;
+	uint32_t op_length;
+	uint32_t source_position;
+
+	uint8_t output[PATCH_OUTPUT_BUFFER_SIZE];
+	size_t output_fill;
+	size_t prefetched;		// source bytes read into the output ahead of ADD bytes
+	uint32_t output_total;
+	uint32_t output_crc;
+
+	bool varintByte(uint8_t b);
+	Spark_Patch_Status_TypeDef parseHeader();
+	Spark_Patch_Status_TypeDef startOperation();
+	Spark_Patch_Status_TypeDef copy();
+	Spark_Patch_Status_TypeDef prefetch();
+	Spark_Patch_Status_TypeDef flush();
+	Spark_Patch_Status_TypeDef finish();
+	Spark_Patch_Status_TypeDef fail(Spark_Patch_Status_TypeDef error);
+};
+
+#endif  /* __SPARK_PATCH_H */
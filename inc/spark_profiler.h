@@ -0,0 +1,111 @@
+/**
+ ******************************************************************************
+ * @file    spark_profiler.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Cycle counting probes around the main loop and the interrupt
+ *          handlers, compiled in with SPARK_PROFILER.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_PROFILER_H
+#define __SPARK_PROFILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+	PROBE_LOOP = 0,					// the application's loop()
+	PROBE_WLAN_LOOP = 1,			// SPARK_WLAN_Loop()
+	PROBE_COMMUNICATION_LOOP = 2,	// Spark_Communication_Loop()
+	PROBE_SYSTICK = 3,				// SysTick_Handler, Timing_Decrement() among it
+	PROBE_USART_ISR = 4,			// USART1 and USART2 interrupts
+	PROBE_EXTI_ISR = 5,				// the external interrupts of the pins and button
+	PROBE_COUNT = 6
+} Spark_Probe_TypeDef;
+
+typedef struct
+{
+	uint32_t count;				// times the probe ran
+	uint64_t total_cycles;
+	uint32_t min_cycles;		// 0 until the probe has run
+	uint32_t max_cycles;
+} Spark_Probe_Stats_TypeDef;
+
+/*
+ * A probe measures the time between the start and the end of the scope it
+ * is declared in, interrupts taken meanwhile included, and accumulates it
+ * in cycles of the DWT cycle counter, 72 a microsecond.
+ *
+ * Without SPARK_PROFILER (make PROFILER=y) PROFILE_SCOPE expands to nothing
+ * and the reports are empty. On the host the cycle counter is
+ * Profiler_Fake_Cycles, which the tests advance.
+ */
+#ifdef SPARK_PROFILER
+
+#ifndef PROFILER_CYCLES
+#ifdef STM32F10X_MD
+#include "stm32f10x.h"
+#define PROFILER_CYCLES()				(DWT->CYCCNT)
+#else
+extern volatile uint32_t Profiler_Fake_Cycles;
+#define PROFILER_CYCLES()				(Profiler_Fake_Cycles)
+#endif
+#endif
+
+void profilerRecord(Spark_Probe_TypeDef probe, uint32_t cycles);
+
+class ProfilerScope
+{
+	Spark_Probe_TypeDef probe;
+	uint32_t start;
+
+public:
+	ProfilerScope(Spark_Probe_TypeDef probe) : probe(probe), start(PROFILER_CYCLES()) {}
+
+	~ProfilerScope() { profilerRecord(probe, PROFILER_CYCLES() - start); }
+};
+
+#define PROFILE_SCOPE(probe)			ProfilerScope profiler_scope_(probe)
+
+void profilerStats(Spark_Probe_TypeDef probe, Spark_Probe_Stats_TypeDef *stats);
+
+void profilerReset(void);
+
+/**
+ * Writes each probe that has run as {@code name:count,avg,min,max} in cycles,
+ * separated by spaces - short enough for a Spark.variable STRING.
+ * @return The length written, without the terminating NUL.
+ */
+size_t profilerReport(char *buffer, size_t size);
+
+#else
+
+#define PROFILE_SCOPE(probe)
+
+static inline void profilerStats(Spark_Probe_TypeDef, Spark_Probe_Stats_TypeDef *stats) { *stats = Spark_Probe_Stats_TypeDef(); }
+
+static inline void profilerReset(void) {}
+
+static inline size_t profilerReport(char *buffer, size_t size) { if (size) *buffer = 0; return 0; }
+
+#endif /* SPARK_PROFILER */
+
+#endif  /* __SPARK_PROFILER_H */
@@ -0,0 +1,146 @@
+/**
+ ******************************************************************************
+ * @file    spark_publish_queue.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Queue of events waiting to be published, sent at a limited rate.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_PUBLISH_QUEUE_H
+#define __SPARK_PUBLISH_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Number of events that can wait to be sent
+#ifndef PUBLISH_QUEUE_DEPTH
+#define PUBLISH_QUEUE_DEPTH				4
+#endif
+
+// The cloud allows one event per second on average, in bursts of up to 4
+#ifndef PUBLISH_INTERVAL_MILLIS
+#define PUBLISH_INTERVAL_MILLIS			1000
+#endif
+
+#ifndef PUBLISH_BURST
+#define PUBLISH_BURST					4
+#endif
+
+// Including the terminating NUL
+#define PUBLISH_NAME_LENGTH				64
+#define PUBLISH_DATA_LENGTH				64
+
+typedef enum
+{
+	PUBLISH_QUEUED = 0,			// the event will be sent
+	PUBLISH_COALESCED = 1,		// the data replaced that of an event with the same name still waiting to be sent
+	PUBLISH_QUEUE_FULL = 2,		// the event was dropped, try again later
+	PUBLISH_NOT_CONNECTED = 3,	// the event was dropped, there is no cloud connection
+	PUBLISH_STORED = 4			// there is no cloud connection, the event was stored to be sent later
+} Spark_Publish_Status_TypeDef;
+
+typedef struct
+{
+	uint32_t queued;		// events accepted, including coalesced ones
+	uint32_t coalesced;		// events merged into one already queued
+	uint32_t dropped;		// events refused because the queue was full
+	uint32_t sent;			// events handed to the protocol
+	uint32_t send_failed;	// attempts the protocol refused, the event is retried
+	uint32_t bytes_sent;	// name and data bytes of the events sent
+	uint16_t pending;		// events waiting to be sent
+	uint16_t high_water;	// most events ever waiting at once
+} Spark_Publish_Stats_TypeDef;
+
+/**
+ * A fixed-size FIFO of events. Events are added by Spark.publish() and sent
+ * by drain(), which is called from the communication loop and is limited by
+ * a token bucket: PUBLISH_BURST events can be sent back to back, after which
+ * one more may be sent every PUBLISH_INTERVAL_MILLIS.
+ */
+class PublishQueue
+{
+public:
+	/**
+	 * Sends one event.
+	 * @return false if the event could not be sent, it then stays queued.
+	 */
+	typedef bool (*Sender)(const char *eventName, const char *eventData, int ttl, bool isPrivate);
+
+	PublishQueue(Sender sender);
+
+	/**
+	 * When enabled, an event that has the same name and scope as one still
+	 * in the queue replaces the data of the queued event rather than
+	 * taking a new entry. Off by default.
+	 */
+	void coalesce(bool enable) { coalescing = enable; }
+
+	/**
+	 * Queues an event. A NULL eventData is sent as an event without data.
+	 * Names and data longer than the queue can store are truncated.
+	 */
+	Spark_Publish_Status_TypeDef add(const char *eventName, const char *eventData, int ttl, bool isPrivate);
+
+	/**
+	 * Queues an event whose name and data need not be NUL terminated.
+	 */
+	Spark_Publish_Status_TypeDef add(const char *eventName, size_t nameLength, const char *eventData, size_t dataLength, int ttl, bool isPrivate);
+
+	/**
+	 * Sends as many queued events as the rate limit allows.
+	 * @param now   The current time in milliseconds.
+	 * @return The number of events sent.
+	 */
+	int drain(uint32_t now);
+
+	void clear();
+
+	int pending() const { return count; }
+
+	void stats(Spark_Publish_Stats_TypeDef *stats) const;
+
+private:
+	struct Entry
+	{
+		char name[PUBLISH_NAME_LENGTH];
+		char data[PUBLISH_DATA_LENGTH];
+		int ttl;
+		bool hasData;
+		bool isPrivate;
+	};
+
+	Sender sender;
+	Entry entries[PUBLISH_QUEUE_DEPTH];
+	uint8_t head;
+	uint8_t count;
+	bool coalescing;
+
+	// sending budget in milliseconds, each event costs PUBLISH_INTERVAL_MILLIS
+	uint32_t budget;
+	uint32_t lastDrain;
+	bool drained;
+
+	Spark_Publish_Stats_TypeDef counters;
+
+	Entry &at(int index) { return entries[(head + index) % PUBLISH_QUEUE_DEPTH]; }
+	static void copy(char *destination, size_t size, const char *source, size_t length);
+};
+
+#endif  /* __SPARK_PUBLISH_QUEUE_H */
@@ -0,0 +1,103 @@
+/**
+ ******************************************************************************
+ * @file    spark_receive_buffer.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Buffers data read from the cloud socket and limits how often an
+ *          idle socket is polled.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_RECEIVE_BUFFER_H
+#define __SPARK_RECEIVE_BUFFER_H
+
+#include <stdint.h>
+
+#ifndef SPARK_RECEIVE_BUFFER_SIZE
+#define SPARK_RECEIVE_BUFFER_SIZE		128
+#endif
+
+// How often a socket that had nothing to read is polled again
+#ifndef SPARK_RECEIVE_POLL_MILLIS
+#define SPARK_RECEIVE_POLL_MILLIS		20
+#endif
+
+typedef struct
+{
+	uint32_t polls;			// reads from the socket
+	uint32_t idle_polls;	// reads that found no data
+	uint32_t skipped;		// receives answered without polling an idle socket
+	uint32_t bytes;			// bytes read from the socket
+} Spark_Receive_Stats_TypeDef;
+
+/**
+ * Sits between the protocol and the socket. Each read from the socket
+ * costs a select() that waits at least 5ms when there is no data, so:
+ *  - a read fetches as much as fits in the buffer, and later receives are
+ *    served from memory. A receive for more than is buffered takes the rest
+ *    from the socket, so it only comes back short when the socket has no
+ *    more data;
+ *  - once a read has found the socket idle, the socket is not read again
+ *    for SPARK_RECEIVE_POLL_MILLIS, and receives return 0 straight away.
+ * While data keeps arriving the socket is read on every receive, so a
+ * message that arrives in pieces is not slowed down.
+ */
+class ReceiveBuffer
+{
+public:
+	/**
+	 * Reads from the socket.
+	 * @return the number of bytes read, 0 if there was no data or <0 on error.
+	 */
+	typedef int (*Reader)(uint8_t *buf, int length);
+
+	ReceiveBuffer(Reader reader);
+
+	/**
+	 * @param now   The current time in milliseconds.
+	 * @return the number of bytes copied to buf, 0 if there is no data
+	 *   or the error returned by the reader.
+	 */
+	int receive(uint8_t *buf, int length, uint32_t now);
+
+	/**
+	 * Discards buffered data, e.g. when the socket is closed.
+	 */
+	void clear();
+
+	int available() const { return int(tail - head); }
+
+	void stats(Spark_Receive_Stats_TypeDef *stats) const { *stats = counters; }
+
+private:
+	Reader reader;
+	// the buffer is only refilled once it is empty, so data never wraps
+	uint8_t buffer[SPARK_RECEIVE_BUFFER_SIZE];
+	uint16_t head;
+	uint16_t tail;
+
+	bool idle;
+	uint32_t idleSince;
+
+	Spark_Receive_Stats_TypeDef counters;
+
+	int read(uint8_t *buf, int length, uint32_t now);
+};
+
+#endif  /* __SPARK_RECEIVE_BUFFER_H */
@@ -0,0 +1,225 @@
+/**
+ ******************************************************************************
+ * @file    spark_ring_buffer.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Single-producer, single-consumer ring used by the serial ports,
+ *          USB CDC and socket buffers.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_RING_BUFFER_H
+#define __SPARK_RING_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Keeps the compiler from moving accesses to the data across the update of
+// an index. The Cortex-M3 doesn't reorder its own accesses to memory, so this
+// is all an interrupt on the same core needs to see them in order.
+#define RING_BUFFER_BARRIER()	__asm__ __volatile__ ("" ::: "memory")
+
+/**
+ * A ring of N elements, N a power of 2, with one producer and one consumer,
+ * typically an interrupt handler and the main loop. Neither takes a lock or
+ * turns interrupts off:
+ *  - head is only written by the producer and tail by the consumer;
+ *  - both count up freely and are masked to index the data, so all N
+ *    elements are used and head - tail is the number available;
+ *  - the producer writes the data before it moves head, and the consumer
+ *    reads it before it moves tail.
+ *
+ * The span methods give direct access to the contiguous part of the data
+ * up to the end of the ring, so a copy to or from a peripheral or socket
+ * needs no intermediate buffer.
+ */
+template <typename T, size_t N>
+class RingBuffer
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer size must be a power of 2");
+
+public:
+	constexpr RingBuffer() : data(), head(0), tail(0) {}
+
+	static constexpr size_t capacity() { return N; }
+
+	size_t available() const { return head - tail; }
+
+	size_t space() const { return N - available(); }
+
+	bool empty() const { return head == tail; }
+
+	bool full() const { return available() == N; }
+
+	// Producer ---------------------------------------------------------------
+
+	/**
+	 * @return false if the ring is full, the value is dropped.
+	 */
+	bool push(const T& value)
+	{
+		size_t h = head;
+		if (h - tail == N)
+			return false;
+		data[h & (N - 1)] = value;
+		RING_BUFFER_BARRIER();
+		head = h + 1;
+		return true;
+	}
+
+	/**
+	 * Appends as many of the {@code count} values as fit.
+	 * @return The number appended.
+	 */
+	size_t push(const T *values, size_t count)
+	{
+		size_t h = head;
+		size_t free = N - (h - tail);
+		if (count > free)
+			count = free;
+		size_t at = h & (N - 1);
+		size_t first = N - at;
+		if (first > count)
+			first = count;
+		memcpy(&data[at], values, first * sizeof(T));
+		memcpy(&data[0], values + first, (count - first) * sizeof(T));
+		RING_BUFFER_BARRIER();
+		head = h + count;
+		return count;
+	}
+
+	/**
+	 * The free space from head up to the end of the ring, to be filled
+	 * directly and then committed.
+	 * @return Its length, 0 if the ring is full.
+	 */
+	size_t writeSpan(T **span)
+	{
+		size_t h = head;
+		size_t free = N - (h - tail);
+		size_t at = h & (N - 1);
+		*span = &data[at];
+		return (N - at < free) ? N - at : free;
+	}
+
+	/**
+	 * Publishes {@code count} values written to the span.
+	 */
+	void commit(size_t count)
+	{
+		RING_BUFFER_BARRIER();
+		head = head + count;
+	}
+
+	// Consumer ---------------------------------------------------------------
+
+	/**
+	 * @return false if the ring is empty.
+	 */
+	bool pop(T& value)
+	{
+		size_t t = tail;
+		if (head == t)
+			return false;
+		RING_BUFFER_BARRIER();
+		value = data[t & (N - 1)];
+		RING_BUFFER_BARRIER();
+		tail = t + 1;
+		return true;
+	}
+
+	/**
+	 * Takes up to {@code count} values.
+	 * @return The number taken.
+	 */
+	size_t pop(T *values, size_t count)
+	{
+		size_t t = tail;
+		size_t ready = head - t;
+		if (count > ready)
+			count = ready;
+		RING_BUFFER_BARRIER();
+		size_t at = t & (N - 1);
+		size_t first = N - at;
+		if (first > count)
+			first = count;
+		memcpy(values, &data[at], first * sizeof(T));
+		memcpy(values + first, &data[0], (count - first) * sizeof(T));
+		RING_BUFFER_BARRIER();
+		tail = t + count;
+		return count;
+	}
+
+	/**
+	 * @return false if the ring is empty.
+	 */
+	bool peek(T& value) const
+	{
+		size_t t = tail;
+		if (head == t)
+			return false;
+		RING_BUFFER_BARRIER();
+		value = data[t & (N - 1)];
+		return true;
+	}
+
+	/**
+	 * The values from tail up to the end of the ring, to be read directly
+	 * and then skipped.
+	 * @return Its length, 0 if the ring is empty.
+	 */
+	size_t peekSpan(const T **span) const
+	{
+		size_t t = tail;
+		size_t ready = head - t;
+		size_t at = t & (N - 1);
+		RING_BUFFER_BARRIER();
+		*span = &data[at];
+		return (N - at < ready) ? N - at : ready;
+	}
+
+	/**
+	 * Drops {@code count} values, no more than are available.
+	 */
+	void skip(size_t count)
+	{
+		RING_BUFFER_BARRIER();
+		tail = tail + count;
+	}
+
+	/**
+	 * Drops everything available.
+	 */
+	void clear() { skip(available()); }
+
+	/**
+	 * Empties the ring and starts it again at the start of the data, so
+	 * the first write span is the whole ring. Only while neither side is
+	 * using it.
+	 */
+	void reset() { head = tail = 0; }
+
+private:
+	T data[N];
+	volatile size_t head;	// written by the producer only
+	volatile size_t tail;	// written by the consumer only
+};
+
+#endif  /* __SPARK_RING_BUFFER_H */
@@ -0,0 +1,149 @@
+/**
+ ******************************************************************************
+ * @file    spark_scheduler.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Cooperative scheduler of one-shot and periodic software timers and
+ *          posted tasks, run from the main loop.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_SCHEDULER_H
+#define __SPARK_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Number of timers, system and application, that can be pending at once
+#ifndef SCHEDULER_MAX_TIMERS
+#define SCHEDULER_MAX_TIMERS			16
+#endif
+
+// Number of tasks that can be posted between two runs
+#ifndef SCHEDULER_QUEUE_DEPTH
+#define SCHEDULER_QUEUE_DEPTH			8
+#endif
+
+typedef struct
+{
+	uint32_t runs;				// calls of run()
+	uint32_t fired;				// timer callbacks called
+	uint32_t posted;			// posted tasks called
+	uint32_t overruns;			// periods a periodic timer missed because it ran late
+	uint32_t max_late_millis;	// the longest a timer has waited past its due time
+	uint32_t refused;			// timers or tasks refused because the scheduler was full
+} Spark_Scheduler_Stats_TypeDef;
+
+/**
+ * Timers are kept in a binary min-heap ordered by due time, so run() only
+ * looks at the earliest and costs nothing while no timer is due. Times are
+ * compared as differences, so they keep their order across the wrap of the
+ * clock, as long as no timer is more than 2^31 ms away.
+ *
+ * A periodic timer is due again one period after it was due, not after it
+ * ran, so it keeps its phase. If it runs late by a whole period or more the
+ * periods missed are counted and dropped rather than run back to back.
+ *
+ * Nothing is called from an interrupt: callbacks run from run(), in the
+ * order they fell due, followed by the tasks posted since the last run.
+ */
+class Scheduler
+{
+public:
+	typedef void (*Task)(void);
+
+	/**
+	 * @return The current time in milliseconds.
+	 */
+	typedef uint32_t (*Clock)(void);
+
+	Scheduler(Clock clock);
+
+	/**
+	 * Calls {@code task} once, {@code delay} ms from now.
+	 * @return The timer id, or -1 if no timer is free.
+	 */
+	int after(uint32_t delay, Task task);
+
+	/**
+	 * Calls {@code task} every {@code period} ms, the first time one period
+	 * from now.
+	 * @return The timer id, or -1 if no timer is free or the period is 0.
+	 */
+	int every(uint32_t period, Task task);
+
+	/**
+	 * Stops a timer. An id is not reused for a while after its timer ends, so
+	 * cancelling a timer that has already fired does nothing.
+	 * @return true if the timer was pending.
+	 */
+	bool cancel(int id);
+
+	/**
+	 * Calls {@code task} on the next run().
+	 * @return false if the queue is full.
+	 */
+	bool post(Task task);
+
+	/**
+	 * Calls the timers that are due and the tasks posted.
+	 * @return The number of callbacks called.
+	 */
+	int run();
+
+	/**
+	 * @return The ms until the next timer is due, 0 if one is due or a task
+	 * is posted, or UINT32_MAX if nothing is scheduled.
+	 */
+	uint32_t idleMillis() const;
+
+	int pending() const { return heapCount; }
+
+	void stats(Spark_Scheduler_Stats_TypeDef *stats) const;
+
+private:
+	struct Timer
+	{
+		Task task;
+		uint32_t due;
+		uint32_t period;		// 0 for a one-shot timer
+		uint8_t generation;		// bumped each time the slot is reused
+		uint8_t heapIndex;
+	};
+
+	Clock clock;
+	Timer timers[SCHEDULER_MAX_TIMERS];
+	uint8_t heap[SCHEDULER_MAX_TIMERS];		// timer slots, earliest due first
+	uint8_t heapCount;
+
+	Task queue[SCHEDULER_QUEUE_DEPTH];
+	uint8_t queueHead;
+	uint8_t queueCount;
+
+	Spark_Scheduler_Stats_TypeDef counters;
+
+	int start(uint32_t delay, uint32_t period, Task task);
+	bool earlier(uint8_t a, uint8_t b) const;
+	void swap(uint8_t i, uint8_t j);
+	void siftUp(uint8_t i);
+	void siftDown(uint8_t i);
+	void remove(uint8_t i);
+};
+
+#endif  /* __SPARK_SCHEDULER_H */
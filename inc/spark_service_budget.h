@@ -0,0 +1,134 @@
+/**
+ ******************************************************************************
+ * @file    spark_service_budget.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Bounds the time the main loop and delay() give to the WLAN and
+ *          cloud, and adapts how often delay() gives it.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_SERVICE_BUDGET_H
+#define __SPARK_SERVICE_BUDGET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The longest the WLAN and cloud are serviced for at a time, unless the
+// application sets its own budget
+#ifndef SERVICE_BUDGET_MILLIS
+#define SERVICE_BUDGET_MILLIS			20
+#endif
+
+// How often delay() services them while there is work pending...
+#ifndef SERVICE_BUSY_INTERVAL_MILLIS
+#define SERVICE_BUSY_INTERVAL_MILLIS	1
+#endif
+
+// ...and, the interval doubling each time there was none, when idle
+#ifndef SERVICE_IDLE_INTERVAL_MILLIS
+#define SERVICE_IDLE_INTERVAL_MILLIS	1000
+#endif
+
+typedef struct
+{
+	uint32_t slices;			// times the WLAN and cloud were serviced
+	uint32_t passes;			// passes of the service in them
+	uint32_t busy;				// slices that ended with work still pending
+	uint32_t overruns;			// slices that ended past the budget, a single pass took longer
+	uint32_t max_slice_millis;	// longest slice
+	uint32_t interval_millis;	// current interval between slices in delay()
+	uint32_t budget_millis;		// current budget
+} Spark_Service_Stats_TypeDef;
+
+/**
+ * Each slice runs one pass of the service, then more while there is work
+ * pending and the budget lasts. The first pass always runs, so even a budget
+ * of 0 can't starve the cloud; the budget bounds what the cloud adds to the
+ * latency of loop() by everything after it.
+ *
+ * The main loop takes a slice every pass. delay() takes one when the
+ * interval since the last has passed: SERVICE_BUSY_INTERVAL_MILLIS while work
+ * is pending, an OTA update say, backing off to SERVICE_IDLE_INTERVAL_MILLIS
+ * as slices find nothing to do.
+ */
+class ServiceBudget
+{
+public:
+	/**
+	 * One pass of the WLAN and cloud loop.
+	 */
+	typedef void (*Service)(void);
+
+	/**
+	 * @return true while messages are pending, the cloud is connecting or
+	 * an OTA update is in progress.
+	 */
+	typedef bool (*Busy)(void);
+
+	/**
+	 * @return The current time in milliseconds.
+	 */
+	typedef uint32_t (*Clock)(void);
+
+	ServiceBudget(Service service, Busy busy, Clock clock);
+
+	/**
+	 * Caps the time of a slice. 0 is a single pass.
+	 */
+	void setBudget(uint32_t millis) { budget = millis; }
+
+	uint32_t getBudget() const { return budget; }
+
+	/**
+	 * Takes a slice now.
+	 * @return The number of passes.
+	 */
+	int run();
+
+	/**
+	 * Takes a slice if the interval has passed, ending it by {@code deadline}
+	 * as well as the budget.
+	 * @return The number of passes, 0 if it was not time.
+	 */
+	int poll(uint32_t deadline);
+
+	bool due() const { return int32_t(clock() - last) >= int32_t(interval); }
+
+	uint32_t getInterval() const { return interval; }
+
+	void stats(Spark_Service_Stats_TypeDef *stats) const;
+
+private:
+	Service service;
+	Busy busy;
+	Clock clock;
+	uint32_t budget;
+	uint32_t interval;
+	uint32_t last;			// when the last slice ended
+
+	Spark_Service_Stats_TypeDef counters;
+
+	int slice(uint32_t end);
+};
+
+// The Core's WLAN and cloud, serviced by the main loop and delay()
+extern ServiceBudget Spark_Service_Budget;
+
+#endif  /* __SPARK_SERVICE_BUDGET_H */
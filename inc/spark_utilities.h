@@ -32,6 +32,19 @@
 #include "spark_wiring_time.h"
 #include "spark_wiring_interrupts.h"
 #include "spark_protocol.h"
+#include "spark_publish_queue.h"
+#include "spark_offline_log.h"
+#include "spark_receive_buffer.h"
+#include "spark_variable_tracker.h"
+#include "spark_function_queue.h"
+#include "spark_firmware_writer.h"
+#include "spark_patch.h"
+#include "spark_lzss.h"
+#include "spark_crc32.h"
+#include "spark_scheduler.h"
+#include "spark_loop_monitor.h"
+#include "spark_connection_fsm.h"
+#include "spark_service_budget.h"
 
 #define BYTE_N(x,n)						(((x) >> n*8) & 0x000000FF)
 
@@ -42,18 +55,61 @@
 
 #define TIMING_FLASH_UPDATE_TIMEOUT		30000	//30sec
 
-#define SPARK_LOOP_DELAY_MILLIS			1000	//1sec
+// How long the server address from DNS is reused before it is looked up again
+#ifndef SPARK_DNS_CACHE_MILLIS
+#define SPARK_DNS_CACHE_MILLIS			3600000	//1hour
+#endif
+
+#define SPARK_DNS_ATTEMPTS				10
+
+// Spacing of cloud connection attempts after a failure
+#ifndef SPARK_CONNECT_BACKOFF_MIN_MILLIS
+#define SPARK_CONNECT_BACKOFF_MIN_MILLIS	1000	//1sec
+#endif
+
+#ifndef SPARK_CONNECT_BACKOFF_MAX_MILLIS
+#define SPARK_CONNECT_BACKOFF_MAX_MILLIS	60000	//1min
+#endif
 
+#define SPARK_CONNECT_IN_PROGRESS		1
+
+// The running image, the source of a firmware patch: the application's
+// flash origin in linker_stm32f10x_md_dfu.ld, up to the end of the flash
+#ifndef PATCH_SOURCE_ADDRESS
+#define PATCH_SOURCE_ADDRESS			0x08005000
+#endif
+#define PATCH_SOURCE_LENGTH_MAX			0x1B000
+
+// Room for the messages sent together after the handshake
+#define SPARK_SEND_CORK_LENGTH			128
+
+// The table sizes can be overridden at compile time, e.g. -DUSER_VAR_MAX_COUNT=32
+#ifndef USER_VAR_MAX_COUNT
 #define USER_VAR_MAX_COUNT				10
+#endif
 #define USER_VAR_KEY_LENGTH				12
 
+// How often the variables registered with a deadband are compared
+#ifndef USER_VAR_PUSH_MILLIS
+#define USER_VAR_PUSH_MILLIS			100
+#endif
+
+#ifndef USER_FUNC_MAX_COUNT
 #define USER_FUNC_MAX_COUNT				4
+#endif
 #define USER_FUNC_KEY_LENGTH			12
-#define USER_FUNC_ARG_LENGTH			64
 
 #define USER_EVENT_NAME_LENGTH			64
 #define USER_EVENT_DATA_LENGTH			64
 
+// Size of the subscription trie: characters of distinct prefixes, and handlers
+#ifndef USER_EVENT_TRIE_NODES
+#define USER_EVENT_TRIE_NODES			128
+#endif
+#ifndef USER_EVENT_HANDLER_MAX_COUNT
+#define USER_EVENT_HANDLER_MAX_COUNT	16
+#endif
+
 typedef enum
 {
   AUTOMATIC = 0, SEMI_AUTOMATIC = 1, MANUAL = 2
@@ -66,19 +122,37 @@ typedef enum
 
 typedef enum
 {
-	BOOLEAN = 1, INT = 2, STRING = 4, DOUBLE = 9
-} Spark_Data_TypeDef;
+	PUBLIC = 0, PRIVATE = 1
+} Spark_Event_TypeDef;
 
 typedef enum
 {
-	PUBLIC = 0, PRIVATE = 1
-} Spark_Event_TypeDef;
+	CALL_IMMEDIATE = 0, CALL_DEFERRED = 1
+} Spark_Function_Call_TypeDef;
 
 typedef enum
 {
   MY_DEVICES
 } Spark_Subscription_Scope_TypeDef;
 
+typedef struct
+{
+	uint32_t count;			// handshakes attempted since reset
+	uint32_t failed;		// handshakes that returned an error
+	uint32_t last_millis;	// duration of the last handshake
+	uint32_t max_millis;	// longest handshake
+	uint32_t total_millis;	// time spent in all handshakes
+} Spark_Handshake_Stats_TypeDef;
+
+typedef struct
+{
+	uint32_t socket_opens;		// sockets opened by the cloud connection
+	uint32_t socket_closes;		// and closed
+	uint32_t sends;				// send and sendto calls
+	uint32_t connect_start;		// millis() when the last connection attempt started
+	uint32_t ready_millis;		// from the start of the last connection to the end of its handshake
+} Spark_Connection_Stats_TypeDef;
+
 class SystemClass {
 private:
   static System_Mode_TypeDef _mode;
@@ -106,21 +180,31 @@ public:
 class SparkClass {
 public:
 	static void variable(const char *varKey, void *userVar, Spark_Data_TypeDef userVarType);
+	static void variable(const char *varKey, void *userVar, Spark_Data_TypeDef userVarType, double deadband);
 	static void function(const char *funcKey, int (*pFunc)(String paramString));
-	static void publish(const char *eventName);
-	static void publish(const char *eventName, const char *eventData);
-	static void publish(const char *eventName, const char *eventData, int ttl);
-	static void publish(const char *eventName, const char *eventData, int ttl, Spark_Event_TypeDef eventType);
-	static void publish(String eventName);
-	static void publish(String eventName, String eventData);
-	static void publish(String eventName, String eventData, int ttl);
-	static void publish(String eventName, String eventData, int ttl, Spark_Event_TypeDef eventType);
+	static void function(const char *funcKey, int (*pFunc)(String paramString), Spark_Function_Call_TypeDef callType);
+	static Spark_Publish_Status_TypeDef publish(const char *eventName);
+	static Spark_Publish_Status_TypeDef publish(const char *eventName, const char *eventData);
+	static Spark_Publish_Status_TypeDef publish(const char *eventName, const char *eventData, int ttl);
+	static Spark_Publish_Status_TypeDef publish(const char *eventName, const char *eventData, int ttl, Spark_Event_TypeDef eventType);
+	static Spark_Publish_Status_TypeDef publish(const char *eventName, size_t nameLength, const char *eventData, size_t dataLength, int ttl, Spark_Event_TypeDef eventType);
+	static Spark_Publish_Status_TypeDef publish(const String &eventName);
+	static Spark_Publish_Status_TypeDef publish(const String &eventName, const String &eventData);
+	static Spark_Publish_Status_TypeDef publish(const String &eventName, const String &eventData, int ttl);
+	static Spark_Publish_Status_TypeDef publish(const String &eventName, const String &eventData, int ttl, Spark_Event_TypeDef eventType);
+	static void coalescePublish(bool enable);
+	static void storeOffline(bool enable);
+	static int every(unsigned long period, void (*task)(void));
+	static int after(unsigned long delay, void (*task)(void));
+	static bool cancel(int timer);
 	static bool subscribe(const char *eventName, EventHandler handler);
 	static bool subscribe(const char *eventName, EventHandler handler, Spark_Subscription_Scope_TypeDef scope);
 	static bool subscribe(const char *eventName, EventHandler handler, const char *deviceID);
-	static bool subscribe(String eventName, EventHandler handler);
-	static bool subscribe(String eventName, EventHandler handler, Spark_Subscription_Scope_TypeDef scope);
-	static bool subscribe(String eventName, EventHandler handler, String deviceID);
+	static bool subscribe(const char *eventName, size_t nameLength, EventHandler handler);
+	static bool subscribe(const char *eventName, size_t nameLength, EventHandler handler, Spark_Subscription_Scope_TypeDef scope);
+	static bool subscribe(const String &eventName, EventHandler handler);
+	static bool subscribe(const String &eventName, EventHandler handler, Spark_Subscription_Scope_TypeDef scope);
+	static bool subscribe(const String &eventName, EventHandler handler, const String &deviceID);
 	static void sleep(Spark_Sleep_TypeDef sleepMode, long seconds);
 	static void sleep(long seconds);
 	static void sleep(uint16_t wakeUpPin, uint16_t edgeTriggerMode);
@@ -129,6 +213,7 @@ public:
 	static void connect(void);
 	static void disconnect(void);
         static void process(void);
+	static void serviceBudget(unsigned long millis);
 	static String deviceID(void);
 	static void syncTime(void);
 };
@@ -150,6 +235,7 @@ int Internet_Test(void);
 void Enter_STOP_Mode(void);
 
 int Spark_Connect(void);
+int Spark_Connect_Step(void);
 int Spark_Disconnect(void);
 void Spark_ConnectAbort_WLANReset(void);
 
@@ -157,12 +243,30 @@ void Spark_Protocol_Init(void);
 int Spark_Handshake(void);
 bool Spark_Communication_Loop(void);
 void Multicast_Presence_Announcement(void);
+void Multicast_Presence_Release(bool close);
 void Spark_Signal(bool on);
 void Spark_SetTime(unsigned long dateTime);
 
 int userVarType(const char *varKey);
 void *getUserVar(const char *varKey);
 int userFuncSchedule(const char *funcKey, const char *paramString);
+void userFuncProcess(void);
+void userFuncQueueStats(Spark_Function_Queue_Stats_TypeDef *stats);
+void userVarProcess(void);
+void variablePushStats(Spark_Variable_Push_Stats_TypeDef *stats);
+void userTimerProcess(void);
+void schedulerStats(Spark_Scheduler_Stats_TypeDef *stats);
+size_t loopMonitorSerialize(uint8_t *buffer, size_t size);
+size_t loopMonitorReport(char *buffer, size_t size);
+void handshakeStats(Spark_Handshake_Stats_TypeDef *stats);
+void connectionStats(Spark_Connection_Stats_TypeDef *stats);
+void connectionStateStats(Spark_Connection_State_Stats_TypeDef *stats);
+void serviceStats(Spark_Service_Stats_TypeDef *stats);
+void publishQueueStats(Spark_Publish_Stats_TypeDef *stats);
+void offlineLogStats(Spark_Offline_Log_Stats_TypeDef *stats);
+void receiveBufferStats(Spark_Receive_Stats_TypeDef *stats);
+void firmwareWriteStats(Spark_Firmware_Write_Stats_TypeDef *stats);
+uint32_t subscriptionHits(const char *eventName, EventHandler handler);
 
 long socket_connect(long sd, const sockaddr *addr, long addrlen);
 
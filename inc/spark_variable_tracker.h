@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * @file    spark_variable_tracker.h
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Change tracking for cloud variables, pushing the values that moved
+ *          beyond a deadband as batched events.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_VARIABLE_TRACKER_H
+#define __SPARK_VARIABLE_TRACKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Number of variables whose changes can be pushed
+#ifndef VARIABLE_TRACKER_MAX_COUNT
+#define VARIABLE_TRACKER_MAX_COUNT		10
+#endif
+
+// The same as the cloud variable keys
+#define VARIABLE_TRACKER_KEY_LENGTH		12
+
+// Including the terminating NUL, the same as the data of an event
+#define VARIABLE_TRACKER_DATA_LENGTH	64
+
+typedef enum
+{
+	BOOLEAN = 1, INT = 2, STRING = 4, DOUBLE = 9
+} Spark_Data_TypeDef;
+
+typedef struct
+{
+	uint32_t samples;		// variable values compared against the last value sent
+	uint32_t changes;		// changed values sent
+	uint32_t suppressed;	// changed values within their deadband, not sent
+	uint32_t batches;		// events sent
+	uint32_t refused;		// events the sender could not take, the changes are retried
+} Spark_Variable_Push_Stats_TypeDef;
+
+/**
+ * Remembers the last value sent for each tracked variable. process() compares
+ * every variable against it, and sends those that changed by more than their
+ * deadband as one event of {@code key=value} pairs joined by {@code &}.
+ * Changes that don't fit in one event are sent by the following calls.
+ *
+ * A value only becomes the new reference once the sender has taken it, so
+ * changes are not lost while the event can't be sent. Strings are compared
+ * by a hash of their contents; booleans and strings have no deadband.
+ */
+class VariableTracker
+{
+public:
+	/**
+	 * Sends one event of changes.
+	 * @return false if the event could not be sent, the changes are then
+	 * compared again on the next call.
+	 */
+	typedef bool (*Sender)(const char *data, size_t length);
+
+	VariableTracker(Sender sender);
+
+	/**
+	 * Tracks a variable. The key need not be NUL terminated when it fills
+	 * VARIABLE_TRACKER_KEY_LENGTH characters.
+	 * @param deadband  How far an INT or DOUBLE may move from the value last
+	 *                  sent before it is sent again. 0 sends every change.
+	 * @return false if no more variables can be tracked.
+	 */
+	bool track(const char *key, const void *variable, Spark_Data_TypeDef type, double deadband);
+
+	/**
+	 * Compares the tracked variables with the values last sent and sends
+	 * the changes.
+	 * @return The number of changed values sent.
+	 */
+	int process();
+
+	int count() const { return entryCount; }
+
+	void stats(Spark_Variable_Push_Stats_TypeDef *stats) const;
+
+private:
+	union Value
+	{
+		int32_t i;
+		double d;
+		bool b;
+		uint32_t hash;
+	};
+
+	struct Entry
+	{
+		const char *key;
+		const void *variable;
+		double deadband;
+		Spark_Data_TypeDef type;
+		Value sent;			// the value last sent
+		Value current;		// the value in the event being built
+		bool hasSent;
+		bool inBatch;
+	};
+
+	Sender sender;
+	Entry entries[VARIABLE_TRACKER_MAX_COUNT];
+	uint8_t entryCount;
+	// where the next comparison starts, so a variable that changes all the
+	// time can't keep the others out of a full event
+	uint8_t next;
+
+	Spark_Variable_Push_Stats_TypeDef counters;
+
+	Value read(const Entry &entry) const;
+	bool changed(const Entry &entry, const Value &value);
+	int format(char *buffer, size_t size, const Entry &entry, const Value &value) const;
+};
+
+#endif  /* __SPARK_VARIABLE_TRACKER_H */
@@ -28,8 +28,9 @@
 
 #include "spark_wiring_client.h"
 #include "spark_wiring.h"
+#include "spark_ring_buffer.h"
 
-#define TCPCLIENT_BUF_MAX_SIZE	128
+#define TCPCLIENT_BUF_MAX_SIZE	128	// a power of 2
 
 class TCPClient : public Client {
 
@@ -59,9 +60,7 @@ public:
 private:
 	static uint16_t _srcport;
 	long _sock;
-	uint8_t _buffer[TCPCLIENT_BUF_MAX_SIZE];
-	uint16_t _offset;
-	uint16_t _total;
+	RingBuffer<uint8_t, TCPCLIENT_BUF_MAX_SIZE> _buffer;
 	inline int bufferCount();
 };
 
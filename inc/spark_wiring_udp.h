@@ -28,8 +28,9 @@
 #define __SPARK_WIRING_UDP_H
 
 #include "spark_wiring.h"
+#include "spark_ring_buffer.h"
 
-#define RX_BUF_MAX_SIZE	512
+#define RX_BUF_MAX_SIZE	512	// a power of 2
 
 class UDP : public Stream {
 private:
@@ -39,9 +40,7 @@ private:
 	uint16_t _remotePort;
 	sockaddr _remoteSockAddr;
 	socklen_t _remoteSockAddrLen;
-	uint8_t _buffer[RX_BUF_MAX_SIZE];
-	uint16_t _offset;
-        uint16_t _total;
+	RingBuffer<uint8_t, RX_BUF_MAX_SIZE> _buffer;
 public:
 	UDP();
 
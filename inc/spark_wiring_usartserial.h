@@ -28,15 +28,25 @@
 #define __SPARK_WIRING_USARTSERIAL_H
 
 #include "spark_wiring_stream.h"
+#include "spark_ring_buffer.h"
 
+// Size of each port's receive and transmit rings, a power of 2
+#ifndef SERIAL_BUFFER_SIZE
 #define SERIAL_BUFFER_SIZE 64
+#endif
+
+typedef RingBuffer<unsigned char, SERIAL_BUFFER_SIZE> Ring_Buffer;
 
-typedef struct Ring_Buffer
+typedef struct
 {
-  unsigned char buffer[SERIAL_BUFFER_SIZE];
-  volatile unsigned int head;
-  volatile unsigned int tail;
-} Ring_Buffer;
+  uint32_t overruns;        // bytes the USART lost, the last not read before the next (ORE)
+  uint32_t framing_errors;  // bytes without a stop bit, a wrong baud rate or a break (FE)
+  uint32_t noise_errors;    // bytes sampled with noise (NE)
+  uint32_t parity_errors;   // (PE)
+  uint32_t dropped;         // bytes received while the receive ring was full
+  uint32_t rx_interrupts;   // a byte each, or in DMA mode an idle line or half a ring
+  uint32_t tx_interrupts;   // a byte each, or in DMA mode a burst
+} Spark_Serial_Stats_TypeDef;
 
 typedef enum USART_Num_Def {
   USART_TX_RX =0,
@@ -58,9 +68,24 @@ typedef struct STM32_USART_Info {
 
   uint32_t usart_pin_remap;
 
+  // DMA channels, NULL if the port has none free
+  DMA_Channel_TypeDef* usart_tx_dma;
+  DMA_Channel_TypeDef* usart_rx_dma;
+  IRQn usart_tx_dma_int_n;
+  IRQn usart_rx_dma_int_n;
+  uint32_t usart_tx_dma_flag_tc;
+  uint32_t usart_tx_dma_flag_gl;
+  uint32_t usart_rx_dma_flag_gl;
+
   // Buffer pointers. These need to be global for IRQ handler access
   Ring_Buffer* usart_tx_buffer;
   Ring_Buffer* usart_rx_buffer;
+  Spark_Serial_Stats_TypeDef* usart_stats;
+
+  // DMA state, also for the IRQ handlers
+  bool usart_dma_enabled;
+  uint16_t usart_rx_dma_position;	// where the DMA had written to when last published
+  volatile uint16_t usart_tx_dma_length;	// of the burst in flight, 0 if none
 
 } STM32_USART_Info;
 extern STM32_USART_Info USART_MAP[TOTAL_USARTS];
@@ -73,8 +98,10 @@ class USARTSerial : public Stream
     static USART_InitTypeDef USART_InitStructure;
     static bool USARTSerial_Enabled;
     bool transmitting;
+    bool enableDMA;
     Ring_Buffer _rx_buffer;
     Ring_Buffer _tx_buffer;
+    Spark_Serial_Stats_TypeDef _stats;
     STM32_USART_Info *usartMap; // pointer to USART_MAP[] containing USART peripheral register locations (etc)
 
   public:
@@ -83,6 +110,7 @@ class USARTSerial : public Stream
     void begin(unsigned long);
     void begin(unsigned long, uint8_t);
     void end();
+    void enableDMAMode(bool);
 
     virtual int available(void);
     virtual int peek(void);
@@ -99,8 +127,13 @@ class USARTSerial : public Stream
 
     operator bool();
 
+    void stats(Spark_Serial_Stats_TypeDef *stats) const;
+
 	static bool isEnabled(void);
 
+  private:
+    void discardOverwritten(void);
+
 };
 
 extern USARTSerial Serial1; // USART2 on PA2/3 (Spark TX, RX)
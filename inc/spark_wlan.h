@@ -65,6 +65,9 @@ void SPARK_WLAN_Setup(void (*presence_announcement_callback)(void));
 void SPARK_WLAN_Loop(void);
 void SPARK_WLAN_SmartConfigProcess();
 
+/* Shows a status color, and the status animations play in it */
+void LED_SetStatusColor(uint32_t color);
+
 /* Spark Cloud APIs */
 extern int Spark_Connect(void);
 extern int Spark_Disconnect(void);
@@ -97,8 +100,6 @@ extern volatile uint8_t WLAN_SERIAL_CONFIG_DONE;
 extern volatile uint8_t Spark_Error_Count;
 extern volatile uint8_t Cloud_Handshake_Error_Count;
 
-extern volatile system_tick_t spark_loop_total_millis;
-
 extern long sparkSocket;
 
 extern unsigned char wlan_profile_index;
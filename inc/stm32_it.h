@@ -70,6 +70,8 @@ void TIM4_IRQHandler(void);
 void RTC_IRQHandler(void);
 void RTCAlarm_IRQHandler(void);
 void DMA1_Channel5_IRQHandler(void);
+void DMA1_Channel6_IRQHandler(void);
+void DMA1_Channel7_IRQHandler(void);
 void USB_LP_CAN1_RX0_IRQHandler(void);
 
 extern void (*Wiring_TIM2_Interrupt_Handler)(void);
@@ -30,6 +30,9 @@
 #include "main.h"
 #include "debug.h"
 #include "spark_utilities.h"
+#include "spark_profiler.h"
+#include "spark_led_animation.h"
+#include "spark_ring_buffer.h"
 extern "C" {
 #include "usb_conf.h"
 #include "usb_lib.h"
@@ -48,17 +51,19 @@ extern "C" {
 /* Private variables ---------------------------------------------------------*/
 volatile uint32_t TimingFlashUpdateTimeout;
 
-uint8_t  USART_Rx_Buffer[USART_RX_DATA_SIZE];
-uint32_t USART_Rx_ptr_in = 0;
-uint32_t USART_Rx_ptr_out = 0;
-uint32_t USART_Rx_length  = 0;
+static volatile uint32_t LED_Status_Color;
 
-uint8_t USB_Rx_Buffer[VIRTUAL_COM_PORT_DATA_SIZE];
-uint16_t USB_Rx_length = 0;
-uint16_t USB_Rx_ptr = 0;
+static void LED_Show_Status(uint32_t color);
+LedAnimator Led_Animator(LED_Show_Status);
 
-uint8_t  USB_Tx_State = 0;
-uint8_t  USB_Rx_State = 0;
+/* Data for the host, from USB_USART_Send_Data() to the IN endpoint */
+RingBuffer<uint8_t, USART_RX_DATA_SIZE> USART_Rx_Buffer;
+
+/* Data from the host, from the OUT endpoint to USB_USART_Receive_Data() */
+RingBuffer<uint8_t, USB_RX_DATA_SIZE> USB_Rx_Buffer;
+
+uint8_t  USB_Tx_State = 0;			/* 1 while an IN packet is being sent */
+volatile uint8_t USB_Rx_State = 0;	/* 1 while the OUT endpoint NAKs, the buffer being too full for a packet */
 
 uint32_t USB_USART_BaudRate = 9600;
 
@@ -97,6 +102,9 @@ extern "C" void SparkCoreConfig(void)
 
 	SysTick_Configuration();
 
+	/* The LED animation runs in PendSV, below every other interrupt */
+	NVIC_SetPriority(PendSV_IRQn, 0x0F);
+
 	/* Enable CRC clock */
 	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_CRC, ENABLE);
 #if !defined (RGB_NOTIFICATIONS_ON)	&& defined (RGB_NOTIFICATIONS_OFF)
@@ -110,8 +118,7 @@ extern "C" void SparkCoreConfig(void)
         /* Execute Stop mode if STOP mode flag is set via Spark.sleep(pin, mode) */
         Enter_STOP_Mode();
 
-        LED_SetRGBColor(RGB_COLOR_WHITE);
-        LED_On(LED_RGB);
+        LED_SetStatusColor(RGB_COLOR_WHITE);
         SPARK_LED_FADE = 1;
 
 #ifdef IWDG_RESET_ENABLE
@@ -171,11 +178,13 @@ int main(void)
   /* Main loop */
   while (1)
   {
+    Loop_Monitor.iteration();
+
 #ifdef SPARK_WLAN_ENABLE
     if(SPARK_WLAN_SETUP)
     {
       DECLARE_SYS_HEALTH(ENTERED_WLAN_Loop);
-      SPARK_WLAN_Loop();
+      Spark_Service_Budget.run();
     }
 #endif
 
@@ -199,9 +208,19 @@ int main(void)
 				{
 					//Execute user application loop
 			                DECLARE_SYS_HEALTH(ENTERED_Loop);
-					loop();
+					Loop_Monitor.userLoop();
+					{
+						PROFILE_SCOPE(PROBE_LOOP);
+						loop();
+					}
                                         DECLARE_SYS_HEALTH(RAN_Loop);
 				}
+
+				//Execute any cloud function calls deferred to the main loop
+				userFuncProcess();
+
+				//Run the timers that are due, the variable push among them
+				userTimerProcess();
 #ifdef SPARK_WLAN_ENABLE
 			}
 		}
@@ -224,52 +243,16 @@ void Timing_Decrement(void)
 		TimingDelay--;
 	}
 
-#if !defined (RGB_NOTIFICATIONS_ON)	&& defined (RGB_NOTIFICATIONS_OFF)
-	//Just needed in case LED_RGB_OVERRIDE is set to 0 by accident
-	if (LED_RGB_OVERRIDE == 0)
-	{
-		LED_RGB_OVERRIDE = 1;
-		LED_Off(LED_RGB);
-	}
-#endif
-
-	if (LED_RGB_OVERRIDE != 0)
-	{
-		if ((LED_Spark_Signal != 0) && (NULL != LED_Signaling_Override))
-		{
-			LED_Signaling_Override();
-		}
-	}
-	else if (TimingLED != 0x00)
+	// The LED animation is advanced in PendSV, which runs once SysTick and
+	// any other interrupt have returned
+	if (TimingLED != 0x00)
 	{
 		TimingLED--;
 	}
-	else if(WLAN_SMART_CONFIG_START || SPARK_FLASH_UPDATE || Spark_Error_Count)
-	{
-		//Do nothing
-	}
-	else if(SPARK_LED_FADE)
-	{
-		LED_Fade(LED_RGB);
-		TimingLED = 20;//Breathing frequency kept constant
-	}
-	else if(SPARK_WLAN_SETUP && SPARK_CLOUD_CONNECTED)
-	{
-#if defined (RGB_NOTIFICATIONS_CONNECTING_ONLY)
-		LED_Off(LED_RGB);
-#else
-		LED_SetRGBColor(RGB_COLOR_CYAN);
-		LED_On(LED_RGB);
-		SPARK_LED_FADE = 1;
-#endif
-	}
 	else
 	{
-		LED_Toggle(LED_RGB);
-		if(SPARK_CLOUD_SOCKETED)
-			TimingLED = 50;		//50ms
-		else
-			TimingLED = 100;	//100ms
+		TimingLED = LED_ANIMATION_TICK_MILLIS - 1;
+		SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
 	}
 
 #ifdef SPARK_WLAN_ENABLE
@@ -322,6 +305,94 @@ void Timing_Decrement(void)
 #endif
 }
 
+/*******************************************************************************
+ * Function Name  : LED_SetStatusColor
+ * Description    : Shows a status color, and plays the status animations in it.
+ * Input          : color - 0xRRGGBB
+ * Output         : None
+ * Return         : None
+ *******************************************************************************/
+void LED_SetStatusColor(uint32_t color)
+{
+	LED_Status_Color = color;
+	LED_SetRGBColor(color);
+	LED_On(LED_RGB);
+}
+
+static void LED_Show_Status(uint32_t color)
+{
+	if (LED_RGB_OVERRIDE != 0)
+	{
+		LED_SetSignalingColor(color);
+	}
+	else
+	{
+		LED_SetRGBColor(color);
+	}
+	LED_On(LED_RGB);
+}
+
+/*******************************************************************************
+ * Function Name  : LED_Animation_Tick
+ * Description    : Picks the animation for the system status and advances it,
+ *                  every LED_ANIMATION_TICK_MILLIS from PendSV_Handler.
+ * Input          : None
+ * Output         : None
+ * Return         : None
+ *******************************************************************************/
+void LED_Animation_Tick(void)
+{
+#if !defined (RGB_NOTIFICATIONS_ON)	&& defined (RGB_NOTIFICATIONS_OFF)
+	//Just needed in case LED_RGB_OVERRIDE is set to 0 by accident
+	if (LED_RGB_OVERRIDE == 0)
+	{
+		LED_RGB_OVERRIDE = 1;
+		LED_Off(LED_RGB);
+	}
+#endif
+
+	if (LED_RGB_OVERRIDE != 0)
+	{
+		if (LED_Spark_Signal != 0)
+			Led_Animator.play(LED_ANIMATION_SIGNAL, 0);
+		else
+			Led_Animator.stop();
+	}
+	else if(WLAN_SMART_CONFIG_START || SPARK_FLASH_UPDATE)
+	{
+		//The LED is driven directly
+		Led_Animator.stop();
+	}
+	else if(Spark_Error_Count)
+	{
+		//Spark_Error_Blink() plays the error code
+	}
+	else if(SPARK_LED_FADE)
+	{
+		Led_Animator.play(LED_ANIMATION_BREATHE, LED_Status_Color);
+	}
+	else if(SPARK_WLAN_SETUP && SPARK_CLOUD_CONNECTED)
+	{
+#if defined (RGB_NOTIFICATIONS_CONNECTING_ONLY)
+		if (Led_Animator.playing())
+		{
+			Led_Animator.stop();
+			LED_Off(LED_RGB);
+		}
+#else
+		LED_Status_Color = RGB_COLOR_CYAN;
+		SPARK_LED_FADE = 1;
+		Led_Animator.play(LED_ANIMATION_BREATHE, LED_Status_Color);
+#endif
+	}
+	else
+	{
+		Led_Animator.play(SPARK_CLOUD_SOCKETED ? LED_ANIMATION_BLINK_FAST : LED_ANIMATION_BLINK, LED_Status_Color);
+	}
+
+	Led_Animator.advance(LED_ANIMATION_TICK_MILLIS);
+}
+
 /*******************************************************************************
  * Function Name  : USB_USART_Init
  * Description    : Start USB-USART protocol.
@@ -349,10 +420,7 @@ uint8_t USB_USART_Available_Data(void)
 {
 	if(bDeviceState == CONFIGURED)
 	{
-		if(USB_Rx_State == 1)
-		{
-			return (USB_Rx_length - USB_Rx_ptr);
-		}
+		return USB_Rx_Buffer.available();
 	}
 
 	return 0;
@@ -366,20 +434,19 @@ uint8_t USB_USART_Available_Data(void)
  *******************************************************************************/
 int32_t USB_USART_Receive_Data(void)
 {
-	if(bDeviceState == CONFIGURED)
+	uint8_t Data;
+
+	if(bDeviceState == CONFIGURED && USB_Rx_Buffer.pop(Data))
 	{
-		if(USB_Rx_State == 1)
+		if(USB_Rx_State == 1 && USB_Rx_Buffer.space() >= VIRTUAL_COM_PORT_DATA_SIZE)
 		{
-			if((USB_Rx_length - USB_Rx_ptr) == 1)
-			{
-				USB_Rx_State = 0;
-
-				/* Enable the receive of data on EP3 */
-				SetEPRxValid(ENDP3);
-			}
+			USB_Rx_State = 0;
 
-			return USB_Rx_Buffer[USB_Rx_ptr++];
+			/* Enable the receive of data on EP3 */
+			SetEPRxValid(ENDP3);
 		}
+
+		return Data;
 	}
 
 	return -1;
@@ -395,15 +462,8 @@ void USB_USART_Send_Data(uint8_t Data)
 {
 	if(bDeviceState == CONFIGURED)
 	{
-		USART_Rx_Buffer[USART_Rx_ptr_in] = Data;
-
-		USART_Rx_ptr_in++;
-
-		/* To avoid buffer overflow */
-		if(USART_Rx_ptr_in == USART_RX_DATA_SIZE)
-		{
-			USART_Rx_ptr_in = 0;
-		}
+		/* Dropped if the host is not reading, rather than overwriting */
+		USART_Rx_Buffer.push(Data);
 
 		if(CC3000_Read_Interrupt_Pin())
 		{
@@ -421,50 +481,28 @@ void USB_USART_Send_Data(uint8_t Data)
  *******************************************************************************/
 void Handle_USBAsynchXfer (void)
 {
-
-	uint16_t USB_Tx_ptr;
+	const uint8_t *USB_Tx_ptr;
 	uint16_t USB_Tx_length;
 
 	if(USB_Tx_State != 1)
 	{
-		if (USART_Rx_ptr_out == USART_RX_DATA_SIZE)
-		{
-			USART_Rx_ptr_out = 0;
-		}
+		/* Up to a packet of the data that is contiguous in the buffer */
+		USB_Tx_length = USART_Rx_Buffer.peekSpan(&USB_Tx_ptr);
 
-		if(USART_Rx_ptr_out == USART_Rx_ptr_in)
+		if(USB_Tx_length == 0)
 		{
 			USB_Tx_State = 0;
 			return;
 		}
 
-		if(USART_Rx_ptr_out > USART_Rx_ptr_in) /* rollback */
-		{
-			USART_Rx_length = USART_RX_DATA_SIZE - USART_Rx_ptr_out;
-		}
-		else
-		{
-			USART_Rx_length = USART_Rx_ptr_in - USART_Rx_ptr_out;
-		}
-
-		if (USART_Rx_length > VIRTUAL_COM_PORT_DATA_SIZE)
+		if (USB_Tx_length > VIRTUAL_COM_PORT_DATA_SIZE)
 		{
-			USB_Tx_ptr = USART_Rx_ptr_out;
 			USB_Tx_length = VIRTUAL_COM_PORT_DATA_SIZE;
-
-			USART_Rx_ptr_out += VIRTUAL_COM_PORT_DATA_SIZE;
-			USART_Rx_length -= VIRTUAL_COM_PORT_DATA_SIZE;
 		}
-		else
-		{
-			USB_Tx_ptr = USART_Rx_ptr_out;
-			USB_Tx_length = USART_Rx_length;
 
-			USART_Rx_ptr_out += USART_Rx_length;
-			USART_Rx_length = 0;
-		}
 		USB_Tx_State = 1;
-		UserToPMABufferCopy(&USART_Rx_Buffer[USB_Tx_ptr], ENDP1_TXADDR, USB_Tx_length);
+		UserToPMABufferCopy((uint8_t *)USB_Tx_ptr, ENDP1_TXADDR, USB_Tx_length);
+		USART_Rx_Buffer.skip(USB_Tx_length);
 		SetEPTxCount(ENDP1, USB_Tx_length);
 		SetEPTxValid(ENDP1);
 	}
@@ -0,0 +1,155 @@
+/**
+ ******************************************************************************
+ * @file    spark_connection_fsm.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   State machine of the Wi-Fi and cloud connection, driven by the
+ *          CC3000's asynchronous events and the steps of the main loop.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_connection_fsm.h"
+#include <string.h>
+
+static_assert(CONNECTION_QUEUE_DEPTH >= 2 && CONNECTION_QUEUE_DEPTH <= 128
+		&& (CONNECTION_QUEUE_DEPTH & (CONNECTION_QUEUE_DEPTH - 1)) == 0,
+		"CONNECTION_QUEUE_DEPTH must be a power of 2, 2..128");
+
+typedef struct
+{
+	uint8_t first;		// the event moves the states first to last
+	uint8_t last;
+	uint8_t event;
+	uint8_t next;		// to this one
+} Connection_Transition_TypeDef;
+
+static const Connection_Transition_TypeDef Connection_Transitions[] = {
+	{ CONNECTION_OFF, CONNECTION_OFF, CONNECTION_EVENT_WLAN_STARTED, CONNECTION_WLAN_CONNECTING },
+	{ CONNECTION_WLAN_CONNECTING, CONNECTION_CLOUD_CONNECTED, CONNECTION_EVENT_WLAN_STOPPED, CONNECTION_OFF },
+
+	// a failed join, a wrong password among them, comes back to connecting
+	{ CONNECTION_WLAN_CONNECTING, CONNECTION_CLOUD_CONNECTED, CONNECTION_EVENT_WLAN_DISCONNECTED, CONNECTION_WLAN_CONNECTING },
+	{ CONNECTION_WLAN_CONNECTING, CONNECTION_WLAN_CONNECTING, CONNECTION_EVENT_WLAN_CONNECTED, CONNECTION_WLAN_ADDRESSING },
+	{ CONNECTION_WLAN_CONNECTING, CONNECTION_WLAN_ADDRESSING, CONNECTION_EVENT_DHCP_OK, CONNECTION_WLAN_READY },
+	{ CONNECTION_WLAN_ADDRESSING, CONNECTION_CLOUD_CONNECTED, CONNECTION_EVENT_DHCP_FAILED, CONNECTION_WLAN_ADDRESSING },
+
+	{ CONNECTION_WLAN_READY, CONNECTION_WLAN_READY, CONNECTION_EVENT_CLOUD_WANTED, CONNECTION_CLOUD_WAITING },
+	{ CONNECTION_CLOUD_WAITING, CONNECTION_CLOUD_CONNECTED, CONNECTION_EVENT_CLOUD_UNWANTED, CONNECTION_WLAN_READY },
+	{ CONNECTION_CLOUD_WAITING, CONNECTION_CLOUD_WAITING, CONNECTION_EVENT_CLOUD_RETRY, CONNECTION_CLOUD_CONNECTING },
+	{ CONNECTION_CLOUD_CONNECTING, CONNECTION_CLOUD_CONNECTING, CONNECTION_EVENT_SOCKET_OPENED, CONNECTION_CLOUD_HANDSHAKE },
+	{ CONNECTION_CLOUD_CONNECTING, CONNECTION_CLOUD_CONNECTING, CONNECTION_EVENT_SOCKET_FAILED, CONNECTION_CLOUD_WAITING },
+	{ CONNECTION_CLOUD_HANDSHAKE, CONNECTION_CLOUD_HANDSHAKE, CONNECTION_EVENT_HANDSHAKE_OK, CONNECTION_CLOUD_CONNECTED },
+	{ CONNECTION_CLOUD_HANDSHAKE, CONNECTION_CLOUD_HANDSHAKE, CONNECTION_EVENT_HANDSHAKE_FAILED, CONNECTION_CLOUD_WAITING },
+	{ CONNECTION_CLOUD_HANDSHAKE, CONNECTION_CLOUD_CONNECTED, CONNECTION_EVENT_SOCKET_CLOSED, CONNECTION_CLOUD_WAITING }
+};
+
+#define CONNECTION_TRANSITION_COUNT		(sizeof(Connection_Transitions) / sizeof(Connection_Transitions[0]))
+
+static const char *const Connection_State_Names[CONNECTION_STATE_COUNT] = {
+	"off", "wlan connecting", "wlan addressing", "wlan ready",
+	"cloud waiting", "cloud connecting", "cloud handshake", "cloud connected"
+};
+
+ConnectionStateMachine::ConnectionStateMachine(Listener listener, Clock clock)
+	: listener(listener), clock(clock)
+{
+	current = CONNECTION_OFF;
+	memset((void *)queue, 0, sizeof(queue));
+	head = tail = 0;
+	outage_start = 0;
+	memset(&counters, 0, sizeof(counters));
+}
+
+bool ConnectionStateMachine::post(Spark_Connection_Event_TypeDef event)
+{
+	uint8_t next = (head + 1) & (CONNECTION_QUEUE_DEPTH - 1);
+	if (next == tail)
+	{
+		counters.dropped++;
+		return false;
+	}
+	queue[head] = event;
+	head = next;
+	return true;
+}
+
+int ConnectionStateMachine::process()
+{
+	int handled = 0;
+	while (tail != head)
+	{
+		Spark_Connection_Event_TypeDef event = Spark_Connection_Event_TypeDef(queue[tail]);
+		tail = (tail + 1) & (CONNECTION_QUEUE_DEPTH - 1);
+		dispatch(event);
+		handled++;
+	}
+	return handled;
+}
+
+bool ConnectionStateMachine::dispatch(Spark_Connection_Event_TypeDef event)
+{
+	counters.events++;
+
+	const Connection_Transition_TypeDef *transition = NULL;
+	for (size_t i = 0; i < CONNECTION_TRANSITION_COUNT && !transition; i++)
+	{
+		const Connection_Transition_TypeDef &t = Connection_Transitions[i];
+		if (t.event == event && current >= t.first && current <= t.last)
+			transition = &t;
+	}
+	if (!transition)
+	{
+		counters.ignored++;
+		return false;
+	}
+
+	Spark_Connection_State_TypeDef from = current;
+	Spark_Connection_State_TypeDef to = Spark_Connection_State_TypeDef(transition->next);
+	counters.transitions++;
+
+	if (to != from)
+	{
+		if (from == CONNECTION_OFF || from == CONNECTION_CLOUD_CONNECTED)
+			outage_start = clock();
+
+		if (to == CONNECTION_CLOUD_CONNECTED)
+		{
+			uint32_t elapsed = clock() - outage_start;
+			counters.cloud_connects++;
+			counters.last_cloud_millis = elapsed;
+			if (elapsed > counters.max_cloud_millis)
+				counters.max_cloud_millis = elapsed;
+		}
+	}
+
+	current = to;
+	if (listener)
+		listener(from, event, to);
+	return true;
+}
+
+void ConnectionStateMachine::stats(Spark_Connection_State_Stats_TypeDef *stats) const
+{
+	*stats = counters;
+}
+
+const char *ConnectionStateMachine::name(Spark_Connection_State_TypeDef state)
+{
+	return unsigned(state) < CONNECTION_STATE_COUNT ? Connection_State_Names[state] : "?";
+}
@@ -0,0 +1,129 @@
+/**
+ ******************************************************************************
+ * @file    spark_firmware_writer.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Buffers OTA firmware chunks so that each is programmed while the
+ *          next one is on its way.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_firmware_writer.h"
+#include "spark_crc32.h"
+#include <string.h>
+
+FirmwareWriter::FirmwareWriter(Programmer programmer, Clock clock) : programmer(programmer), clock(clock)
+{
+	begin();
+}
+
+void FirmwareWriter::begin()
+{
+	memset(&counters, 0, sizeof(counters));
+	pendingLength = 0;
+	programmed = 0;
+	crc = crc32_init();
+	started = clock();
+}
+
+void FirmwareWriter::program(uint8_t *buf, size_t length)
+{
+	uint32_t start = clock();
+	uint16_t index = programmer(buf, length);
+	uint32_t end = clock();
+
+	if (index == uint16_t(programmed + 1))
+		programmed = index;
+	else
+		counters.failed++;
+
+	counters.program_micros += end - start;
+	counters.elapsed_micros = end - started;
+}
+
+void FirmwareWriter::save(const uint8_t *buf, size_t length)
+{
+	crc = crc32_update(crc, buf, length);
+	counters.crc = crc32_final(crc);
+	counters.chunks++;
+	counters.bytes += length;
+
+	if (pendingLength)
+	{
+		uint32_t start = clock();
+		service();
+		counters.stalls++;
+		counters.stall_micros += clock() - start;
+	}
+
+	if (length > sizeof(buffer))
+	{
+		// too big to hold, the protocol waits for this one
+		program(const_cast<uint8_t *>(buf), length);
+		return;
+	}
+
+	memcpy(buffer, buf, length);
+	pendingLength = length;
+}
+
+bool FirmwareWriter::service()
+{
+	if (!pendingLength)
+		return false;
+
+	program(buffer, pendingLength);
+	pendingLength = 0;
+	return true;
+}
+
+bool FirmwareWriter::finish()
+{
+	service();
+	return !failed();
+}
+
+bool FirmwareWriter::verify(const FlashRegion &image) const
+{
+	if (counters.bytes > image.length())
+		return false;
+
+	uint8_t buf[64];
+	uint32_t readCRC = crc32_init();
+	for (uint32_t address = 0; address < counters.bytes; )
+	{
+		uint32_t length = counters.bytes - address;
+		if (length > sizeof(buf))
+			length = sizeof(buf);
+		if (length > image.pageSize() - address % image.pageSize())
+			length = image.pageSize() - address % image.pageSize();
+		if (!image.readPage(buf, address, length))
+			return false;
+		readCRC = crc32_update(readCRC, buf, length);
+		address += length;
+	}
+	return crc32_final(readCRC) == counters.crc;
+}
+
+void FirmwareWriter::stats(Spark_Firmware_Write_Stats_TypeDef *stats) const
+{
+	*stats = counters;
+	stats->bytes_per_second = counters.elapsed_micros ?
+			uint32_t(uint64_t(counters.bytes) * 1000000 / counters.elapsed_micros) : 0;
+}
@@ -0,0 +1,56 @@
+/**
+ ******************************************************************************
+ * @file    spark_flash_region.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Page-oriented access to a region of the external serial flash.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_flash_region.h"
+#include "sst25vf_spi.h"
+
+uint32_t ExternalFlashRegion::pageSize() const
+{
+	return sFLASH_PAGESIZE;
+}
+
+bool ExternalFlashRegion::erasePage(uint32_t address)
+{
+	if (address >= length())
+		return false;
+	sFLASH_EraseSector(base + address - (address % sFLASH_PAGESIZE));
+	return true;
+}
+
+bool ExternalFlashRegion::writePage(const void *data, uint32_t address, uint32_t length)
+{
+	if (address + length > this->length())
+		return false;
+	sFLASH_WriteBuffer((uint8_t *)data, base + address, length);
+	return true;
+}
+
+bool ExternalFlashRegion::readPage(void *data, uint32_t address, uint32_t length) const
+{
+	if (address + length > this->length())
+		return false;
+	sFLASH_ReadBuffer((uint8_t *)data, base + address, length);
+	return true;
+}
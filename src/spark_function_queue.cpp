@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * @file    spark_function_queue.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Queue of cloud function calls deferred to the main loop.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_function_queue.h"
+#include <string.h>
+
+FunctionQueue::FunctionQueue(Runner runner) : runner(runner)
+{
+	clear();
+	memset(&counters, 0, sizeof(counters));
+}
+
+void FunctionQueue::clear()
+{
+	head = 0;
+	count = 0;
+}
+
+bool FunctionQueue::add(int index, const char *arg)
+{
+	if (count == USER_FUNC_QUEUE_DEPTH)
+	{
+		counters.dropped++;
+		return false;
+	}
+
+	Call &call = calls[(head + count) % USER_FUNC_QUEUE_DEPTH];
+	call.index = index;
+	strncpy(call.arg, arg, USER_FUNC_ARG_LENGTH);
+	call.arg[USER_FUNC_ARG_LENGTH] = '\0';
+
+	count++;
+	counters.queued++;
+	if (count > counters.high_water)
+		counters.high_water = count;
+	return true;
+}
+
+bool FunctionQueue::process()
+{
+	if (!count)
+		return false;
+
+	// the slot is free for new calls once the call is taken off the queue
+	char arg[USER_FUNC_ARG_LENGTH + 1];
+	int index = calls[head].index;
+	memcpy(arg, calls[head].arg, sizeof(arg));
+	head = (head + 1) % USER_FUNC_QUEUE_DEPTH;
+	count--;
+
+	runner(index, arg);
+	return true;
+}
+
+void FunctionQueue::stats(Spark_Function_Queue_Stats_TypeDef *stats) const
+{
+	*stats = counters;
+	stats->pending = count;
+}
@@ -0,0 +1,187 @@
+/**
+ ******************************************************************************
+ * @file    spark_led_animation.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Plays the RGB status animations from tables of keyframes.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_led_animation.h"
+
+#define LED_FRAME_COUNT(frames)		uint8_t(sizeof(frames) / sizeof(frames[0]))
+
+// The level to show for each level asked for, 255 * (level / 255)^2.2, so
+// that equal steps of level look like equal steps of brightness
+static const uint8_t LED_Gamma[256] = {
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+	  1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+	  3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+	  6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+	 12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+	 20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+	 30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+	 42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+	 56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+	 73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+	 91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+	113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+	137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+	163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+	192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+	223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+};
+
+static const LedKeyframe Breathe_Frames[] = {
+	{ LED_KEYFRAME_BASE_COLOR, 2000, 255, LED_KEYFRAME_RAMP },
+	{ LED_KEYFRAME_BASE_COLOR, 2000, 40, LED_KEYFRAME_RAMP }
+};
+
+static const LedKeyframe Blink_Frames[] = {
+	{ LED_KEYFRAME_BASE_COLOR, 100, 255, 0 },
+	{ LED_KEYFRAME_BASE_COLOR, 100, 0, 0 }
+};
+
+static const LedKeyframe Blink_Fast_Frames[] = {
+	{ LED_KEYFRAME_BASE_COLOR, 50, 255, 0 },
+	{ LED_KEYFRAME_BASE_COLOR, 50, 0, 0 }
+};
+
+// violet, indigo, blue, green, yellow, orange, red
+static const LedKeyframe Signal_Frames[] = {
+	{ 0xEE82EE, 100, 255, 0 },
+	{ 0x4B0082, 100, 255, 0 },
+	{ 0x0000FF, 100, 255, 0 },
+	{ 0x00FF00, 100, 255, 0 },
+	{ 0xFFFF00, 100, 255, 0 },
+	{ 0xFFA500, 100, 255, 0 },
+	{ 0xFF0000, 100, 255, 0 }
+};
+
+static const LedKeyframe Error_Frames[] = {
+	{ LED_KEYFRAME_BASE_COLOR, 500, 255, 0 },
+	{ LED_KEYFRAME_BASE_COLOR, 500, 0, 0 }
+};
+
+const LedAnimation LED_ANIMATION_BREATHE = { Breathe_Frames, LED_FRAME_COUNT(Breathe_Frames) };
+const LedAnimation LED_ANIMATION_BLINK = { Blink_Frames, LED_FRAME_COUNT(Blink_Frames) };
+const LedAnimation LED_ANIMATION_BLINK_FAST = { Blink_Fast_Frames, LED_FRAME_COUNT(Blink_Fast_Frames) };
+const LedAnimation LED_ANIMATION_SIGNAL = { Signal_Frames, LED_FRAME_COUNT(Signal_Frames) };
+const LedAnimation LED_ANIMATION_ERROR = { Error_Frames, LED_FRAME_COUNT(Error_Frames) };
+
+void LedAnimator::play(const LedAnimation &animation, uint32_t color, uint8_t repeats)
+{
+	const Request &latest = requested ? next : current;
+	if (latest.animation == &animation && latest.color == color && latest.repeats == repeats)
+		return;
+
+	requested = false;
+	next.animation = &animation;
+	next.color = color;
+	next.repeats = repeats;
+	requested = true;
+}
+
+void LedAnimator::stop()
+{
+	if (!playing())
+		return;
+
+	requested = false;
+	next.animation = NULL;
+	requested = true;
+}
+
+bool LedAnimator::playing() const
+{
+	return requested ? next.animation != NULL : current.animation != NULL;
+}
+
+uint32_t LedAnimator::scale(uint32_t color, uint8_t level)
+{
+	uint32_t g = LED_Gamma[level] + 1;
+	uint32_t r = (((color >> 16) & 0xFF) * g) >> 8;
+	uint32_t gr = (((color >> 8) & 0xFF) * g) >> 8;
+	uint32_t b = ((color & 0xFF) * g) >> 8;
+	return (r << 16) | (gr << 8) | b;
+}
+
+void LedAnimator::show(const LedKeyframe &keyframe, uint8_t level)
+{
+	uint32_t color = keyframe.color == LED_KEYFRAME_BASE_COLOR ? current.color : keyframe.color;
+	color = level ? scale(color, level) : 0;
+	if (!showing || color != shown)
+	{
+		shown = color;
+		showing = true;
+		sink(color);
+	}
+}
+
+void LedAnimator::advance(uint32_t millis)
+{
+	bool restarted = false;
+	if (requested)
+	{
+		current = next;
+		requested = false;
+		frame = played = 0;
+		elapsed = 0;
+		// the LED may have been driven directly while nothing played
+		showing = false;
+		restarted = true;
+	}
+
+	if (!current.animation)
+		return;
+
+	const LedKeyframe *frames = current.animation->frames;
+	uint8_t count = current.animation->count;
+	bool changed = restarted;
+
+	// a keyframe of 0 ms is held until another animation is played
+	uint32_t time = elapsed + millis;
+	while (frames[frame].millis && time >= frames[frame].millis)
+	{
+		time -= frames[frame].millis;
+		changed = true;
+		if (++frame == count)
+		{
+			frame = 0;
+			if (current.repeats && ++played >= current.repeats)
+			{
+				current.animation = NULL;
+				return;
+			}
+		}
+	}
+	elapsed = time;
+
+	const LedKeyframe &keyframe = frames[frame];
+	if ((keyframe.flags & LED_KEYFRAME_RAMP) && keyframe.millis)
+	{
+		int from = keyframe.level;
+		int to = frames[(frame + 1) % count].level;
+		show(keyframe, from + (to - from) * int(elapsed) / keyframe.millis);
+	}
+	else if (changed)
+	{
+		show(keyframe, keyframe.level);
+	}
+}
@@ -0,0 +1,173 @@
+/**
+ ******************************************************************************
+ * @file    spark_loop_monitor.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Histograms of main loop iteration times and of the period of the
+ *          application's loop(), with the worst period and what caused it.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_loop_monitor.h"
+#include <string.h>
+
+static_assert(LOOP_MONITOR_BUCKETS > 1 && LOOP_MONITOR_BUCKETS <= 32, "LOOP_MONITOR_BUCKETS must be 2..32");
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+	*p++ = v;
+	*p++ = v >> 8;
+	return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+	return put16(put16(p, v), v >> 16);
+}
+
+LoopMonitor::LoopMonitor(Clock micros, Clock millis) : micros(micros), millis(millis)
+{
+	reset();
+}
+
+void LoopMonitor::reset()
+{
+	memset(iterationHistogram, 0, sizeof(iterationHistogram));
+	memset(periodHistogram, 0, sizeof(periodHistogram));
+	memset(&worstPeriod, 0, sizeof(worstPeriod));
+	memset(charged, 0, sizeof(charged));
+	iterationCount = loopCount = longestIteration = 0;
+	lastIteration = lastLoop = runningSince = 0;
+	running = LOOP_SUBSYSTEM_NONE;
+}
+
+int LoopMonitor::bucket(uint32_t micros)
+{
+	if (micros < 2)
+		return 0;
+	int log2 = 31 - __builtin_clz(micros);
+	return log2 < LOOP_MONITOR_BUCKETS ? log2 : LOOP_MONITOR_BUCKETS - 1;
+}
+
+void LoopMonitor::add(uint16_t *histogram, uint32_t micros)
+{
+	uint16_t &count = histogram[bucket(micros)];
+	if (count != UINT16_MAX)
+		count++;
+}
+
+void LoopMonitor::iteration()
+{
+	uint32_t now = micros();
+	if (iterationCount)
+	{
+		uint32_t elapsed = now - lastIteration;
+		add(iterationHistogram, elapsed);
+		if (elapsed > longestIteration)
+			longestIteration = elapsed;
+	}
+	lastIteration = now;
+	iterationCount++;
+}
+
+void LoopMonitor::userLoop()
+{
+	uint32_t now = micros();
+	charge(now);
+	if (loopCount)
+	{
+		uint32_t period = now - lastLoop;
+		add(periodHistogram, period);
+		if (period > worstPeriod.period_micros)
+		{
+			int most = 0;
+			for (int subsystem = 1; subsystem < LOOP_SUBSYSTEM_COUNT; subsystem++)
+			{
+				if (charged[subsystem] > charged[most])
+					most = subsystem;
+			}
+			worstPeriod.period_micros = period;
+			worstPeriod.subsystem = most;
+			worstPeriod.subsystem_micros = charged[most];
+			worstPeriod.at_millis = millis();
+		}
+	}
+	memset(charged, 0, sizeof(charged));
+	lastLoop = now;
+	loopCount++;
+}
+
+void LoopMonitor::charge(uint32_t now)
+{
+	charged[running] += now - runningSince;
+	runningSince = now;
+}
+
+Spark_Loop_Subsystem_TypeDef LoopMonitor::enter(Spark_Loop_Subsystem_TypeDef subsystem)
+{
+	charge(micros());
+	Spark_Loop_Subsystem_TypeDef previous = running;
+	running = subsystem;
+	return previous;
+}
+
+void LoopMonitor::leave(Spark_Loop_Subsystem_TypeDef previous)
+{
+	charge(micros());
+	running = previous;
+}
+
+size_t LoopMonitor::serialize(uint8_t *buffer, size_t size) const
+{
+	if (size < LOOP_MONITOR_BLOB_LENGTH)
+		return 0;
+
+	uint8_t *p = buffer;
+	*p++ = LOOP_MONITOR_BLOB_VERSION;
+	*p++ = LOOP_MONITOR_BUCKETS;
+	for (int i = 0; i < LOOP_MONITOR_BUCKETS; i++)
+		p = put16(p, iterationHistogram[i]);
+	for (int i = 0; i < LOOP_MONITOR_BUCKETS; i++)
+		p = put16(p, periodHistogram[i]);
+	p = put32(p, iterationCount);
+	p = put32(p, loopCount);
+	p = put32(p, longestIteration);
+	p = put32(p, worstPeriod.period_micros);
+	p = put32(p, worstPeriod.subsystem_micros);
+	p = put32(p, worstPeriod.at_millis);
+	*p++ = worstPeriod.subsystem;
+	return p - buffer;
+}
+
+size_t LoopMonitor::report(char *buffer, size_t size) const
+{
+	static const char hex[] = "0123456789abcdef";
+	uint8_t blob[LOOP_MONITOR_BLOB_LENGTH];
+	if (size < 2 * sizeof(blob) + 1)
+		return 0;
+
+	size_t length = serialize(blob, sizeof(blob));
+	for (size_t i = 0; i < length; i++)
+	{
+		buffer[2 * i] = hex[blob[i] >> 4];
+		buffer[2 * i + 1] = hex[blob[i] & 0x0F];
+	}
+	buffer[2 * length] = 0;
+	return 2 * length;
+}
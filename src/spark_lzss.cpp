@@ -0,0 +1,183 @@
+/**
+ ******************************************************************************
+ * @file    spark_lzss.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Streaming LZSS decoder for compressed firmware images.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_lzss.h"
+#include "spark_crc32.h"
+#include <string.h>
+
+static const uint16_t LZSS_WINDOW_MASK = LZSS_WINDOW_SIZE - 1;
+static const uint16_t LZSS_FLUSH_SIZE = LZSS_WINDOW_SIZE / 2;
+
+static uint32_t read32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+bool LzssDecoder::isCompressed(const uint8_t *data, size_t length)
+{
+	return length >= 4 && LZSS_MAGIC == read32(data);
+}
+
+LzssDecoder::LzssDecoder(Writer writer) : writer(writer)
+{
+	begin();
+}
+
+void LzssDecoder::begin()
+{
+	state = HEADER;
+	result = LZSS_OK;
+	header_length = 0;
+	image_length = 0;
+	position = flushed = 0;
+	total = 0;
+	crc = crc32_init();
+}
+
+Spark_Lzss_Status_TypeDef LzssDecoder::fail(Spark_Lzss_Status_TypeDef error)
+{
+	state = FINISHED;
+	return result = error;
+}
+
+Spark_Lzss_Status_TypeDef LzssDecoder::parseHeader()
+{
+	if (LZSS_MAGIC != read32(header))
+		return LZSS_BAD_HEADER;
+	image_length = read32(header + 4);
+	if (image_length > LZSS_IMAGE_LENGTH_MAX)
+		return LZSS_BAD_HEADER;
+	image_crc = read32(header + 8);
+	window_bits = header[12];
+	if (window_bits < 4 || window_bits > LZSS_WINDOW_BITS || window_bits > 12)
+		return LZSS_BAD_HEADER;
+	return LZSS_OK;
+}
+
+bool LzssDecoder::flush()
+{
+	uint16_t length = (position - flushed) & LZSS_WINDOW_MASK;
+	if (!length)
+		return true;
+	if (!writer(window + flushed, length))
+		return false;
+	crc = crc32_update(crc, window + flushed, length);
+	flushed = position;
+	return true;
+}
+
+// the window is flushed a half at a time, so what is written is never wrapped
+bool LzssDecoder::put(uint8_t b)
+{
+	window[position] = b;
+	position = (position + 1) & LZSS_WINDOW_MASK;
+	total++;
+	return (position & (LZSS_FLUSH_SIZE - 1)) || flush();
+}
+
+Spark_Lzss_Status_TypeDef LzssDecoder::finish()
+{
+	if (!flush())
+		return fail(LZSS_WRITE_FAILED);
+	if (crc32_final(crc) != image_crc)
+		return fail(LZSS_BAD_TARGET);
+	state = FINISHED;
+	return result = LZSS_DONE;
+}
+
+// Moves to the next flag, and says whether the image is complete
+bool LzssDecoder::nextItem()
+{
+	if (total >= image_length)
+		return true;
+	flags >>= 1;
+	if (!--flag_count)
+		state = FLAGS;
+	return false;
+}
+
+Spark_Lzss_Status_TypeDef LzssDecoder::inflate(const uint8_t *data, size_t length)
+{
+	while (length-- && FINISHED != state)
+	{
+		uint8_t b = *data++;
+		switch (state)
+		{
+			case HEADER:
+				header[header_length++] = b;
+				if (LZSS_HEADER_LENGTH == header_length)
+				{
+					Spark_Lzss_Status_TypeDef error = parseHeader();
+					if (error)
+						return fail(error);
+					if (!image_length)
+						return finish();
+					state = FLAGS;
+				}
+				break;
+
+			case FLAGS:
+				flags = b;
+				flag_count = 8;
+				state = ITEM;
+				break;
+
+			case ITEM:
+				if (!(flags & 1))
+				{
+					match_high = b;
+					state = MATCH;
+					break;
+				}
+				if (!put(b))
+					return fail(LZSS_WRITE_FAILED);
+				if (nextItem())
+					return finish();
+				break;
+
+			case MATCH:
+			{
+				uint16_t match = (match_high << 8) | b;
+				uint16_t distance = (match >> (16 - window_bits)) + 1;
+				uint16_t count = (match & ((1 << (16 - window_bits)) - 1)) + LZSS_MIN_MATCH;
+				if (distance > total || total + count > image_length)
+					return fail(LZSS_BAD_DATA);
+				while (count--)
+				{
+					if (!put(window[(position - distance) & LZSS_WINDOW_MASK]))
+						return fail(LZSS_WRITE_FAILED);
+				}
+				state = ITEM;
+				if (nextItem())
+					return finish();
+				break;
+			}
+
+			case FINISHED:
+				break;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,352 @@
+/**
+ ******************************************************************************
+ * @file    spark_offline_log.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Append-only log in flash of the events published while offline.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_offline_log.h"
+#include "spark_crc32.h"
+#include <string.h>
+#include <stddef.h>
+
+#define OFFLINE_LOG_MAGIC		0x4C45	// "EL"
+#define OFFLINE_LOG_PRIVATE		0x01
+#define OFFLINE_LOG_HAS_DATA	0x02
+
+static const uint32_t MAX_PAYLOAD = PUBLISH_NAME_LENGTH + PUBLISH_DATA_LENGTH;
+
+OfflineLog::OfflineLog(FlashRegion &flash) : flash(flash)
+{
+	memset(&counters, 0, sizeof(counters));
+	writePage = writeOffset = readPage = readOffset = 0;
+	nextSequence = 1;
+	pageSize = pageCount = 0;
+	replaying = false;
+	replaySequence = replaySentBefore = 0;
+}
+
+uint32_t OfflineLog::recordSize(const Header &header)
+{
+	return (sizeof(Header) + header.length + 3) & ~3;
+}
+
+uint32_t OfflineLog::recordCRC(const Header &header, const uint8_t *payload)
+{
+	const uint8_t *fields = (const uint8_t *)&header + offsetof(Header, sequence);
+	uint32_t crc = crc32_update(crc32_init(), fields, offsetof(Header, crc) - offsetof(Header, sequence));
+	return crc32_final(crc32_update(crc, payload, header.length));
+}
+
+OfflineLog::RecordState OfflineLog::readRecord(uint32_t page, uint32_t offset, Header &header, uint8_t *payload)
+{
+	if (offset + sizeof(Header) > pageSize)
+		return RECORD_ERASED;
+
+	if (!flash.readPage(&header, page * pageSize + offset, sizeof(Header)))
+		return RECORD_INVALID;
+
+	const uint8_t *bytes = (const uint8_t *)&header;
+	uint32_t i = 0;
+	while (i < sizeof(Header) && bytes[i] == 0xFF)
+		i++;
+	if (i == sizeof(Header))
+		return RECORD_ERASED;
+
+	if (header.magic != OFFLINE_LOG_MAGIC || header.length > MAX_PAYLOAD || offset + recordSize(header) > pageSize)
+		return RECORD_INVALID;
+
+	if (!flash.readPage(payload, page * pageSize + offset + sizeof(Header), header.length))
+		return RECORD_INVALID;
+
+	return recordCRC(header, payload) == header.crc ? RECORD_VALID : RECORD_INVALID;
+}
+
+uint32_t OfflineLog::countPending(uint32_t page, uint32_t &firstOffset, bool &corrupt)
+{
+	Header header;
+	uint8_t payload[MAX_PAYLOAD];
+	uint32_t count = 0;
+	uint32_t offset = 0;
+	RecordState state;
+
+	while (RECORD_VALID == (state = readRecord(page, offset, header, payload)))
+	{
+		if (header.replayed == 0xFFFF && !count++)
+			firstOffset = offset;
+		offset += recordSize(header);
+	}
+	corrupt = (RECORD_INVALID == state);
+	return count;
+}
+
+void OfflineLog::begin()
+{
+	Header header;
+	uint8_t payload[MAX_PAYLOAD];
+
+	pageSize = flash.pageSize();
+	pageCount = flash.pageCount();
+	memset(&counters, 0, sizeof(counters));
+	writePage = writeOffset = readPage = readOffset = 0;
+	nextSequence = 1;
+	replaying = false;
+
+	// the page whose first record is the most recent is the one being written
+	bool found = false;
+	uint32_t newest = 0;
+	uint32_t newestSequence = 0;
+	for (uint32_t page = 0; page < pageCount; page++)
+	{
+		if (RECORD_VALID == readRecord(page, 0, header, payload) &&
+			(!found || int32_t(header.sequence - newestSequence) > 0))
+		{
+			found = true;
+			newest = page;
+			newestSequence = header.sequence;
+		}
+	}
+	if (!found)
+		return;
+
+	writePage = newest;
+	RecordState state;
+	while (RECORD_VALID == (state = readRecord(writePage, writeOffset, header, payload)))
+	{
+		nextSequence = header.sequence + 1;
+		writeOffset += recordSize(header);
+	}
+	// don't append after a partly written record
+	if (RECORD_INVALID == state)
+		writeOffset = pageSize;
+
+	// pages after the newest hold the oldest records
+	readPage = writePage;
+	readOffset = writeOffset;
+	for (uint32_t i = 1; i <= pageCount; i++)
+	{
+		uint32_t page = (newest + i) % pageCount;
+		uint32_t first;
+		bool corrupt;
+		uint32_t count = countPending(page, first, corrupt);
+		if (count && !counters.pending)
+		{
+			readPage = page;
+			readOffset = first;
+		}
+		counters.pending += count;
+		counters.corrupt += corrupt;
+	}
+}
+
+void OfflineLog::seekPending()
+{
+	Header header;
+	uint8_t payload[MAX_PAYLOAD];
+
+	for (uint32_t pages = 0; counters.pending && pages <= pageCount; )
+	{
+		if (RECORD_VALID == readRecord(readPage, readOffset, header, payload))
+		{
+			if (header.replayed == 0xFFFF)
+				return;
+			readOffset += recordSize(header);
+			continue;
+		}
+		readPage = (readPage + 1) % pageCount;
+		readOffset = 0;
+		pages++;
+	}
+	// the records counted as pending have gone
+	counters.pending = 0;
+}
+
+bool OfflineLog::append(const char *eventName, const char *eventData, uint32_t ttl, bool isPrivate)
+{
+	return append(eventName, strnlen(eventName, PUBLISH_NAME_LENGTH),
+			eventData, eventData ? strnlen(eventData, PUBLISH_DATA_LENGTH) : 0, ttl, isPrivate);
+}
+
+bool OfflineLog::append(const char *eventName, size_t nameLength, const char *eventData, size_t dataLength, uint32_t ttl, bool isPrivate)
+{
+	if (!pageCount)
+		return false;
+
+	uint8_t record[sizeof(Header) + MAX_PAYLOAD + 3];
+	uint8_t *payload = record + sizeof(Header);
+	memset(record, 0xFF, sizeof(record));
+
+	if (nameLength > PUBLISH_NAME_LENGTH - 1)
+		nameLength = PUBLISH_NAME_LENGTH - 1;
+	if (!eventData)
+		dataLength = 0;
+	else if (dataLength > PUBLISH_DATA_LENGTH - 1)
+		dataLength = PUBLISH_DATA_LENGTH - 1;
+	memcpy(payload, eventName, nameLength);
+	payload[nameLength] = '\0';
+	if (dataLength)
+		memcpy(payload + nameLength + 1, eventData, dataLength);
+
+	Header header;
+	header.magic = OFFLINE_LOG_MAGIC;
+	header.replayed = 0xFFFF;
+	header.sequence = nextSequence;
+	header.ttl = ttl;
+	header.length = nameLength + 1 + dataLength;
+	header.flags = (isPrivate ? OFFLINE_LOG_PRIVATE : 0) | (eventData ? OFFLINE_LOG_HAS_DATA : 0);
+	header.reserved = 0xFF;
+	header.crc = recordCRC(header, payload);
+	memcpy(record, &header, sizeof(Header));
+
+	uint32_t size = recordSize(header);
+	if (writeOffset + size > pageSize)
+	{
+		writePage = (writePage + 1) % pageCount;
+		writeOffset = 0;
+	}
+
+	if (0 == writeOffset)
+	{
+		// the page is reused, events in it that were not replayed are lost
+		uint32_t first;
+		bool corrupt;
+		uint32_t lost = countPending(writePage, first, corrupt);
+		counters.overwritten += lost;
+		counters.pending -= lost;
+
+		if (!flash.erasePage(writePage * pageSize))
+			return false;
+
+		if (readPage == writePage)
+		{
+			readPage = (writePage + 1) % pageCount;
+			readOffset = 0;
+			seekPending();
+		}
+	}
+
+	if (!flash.writePage(record, writePage * pageSize + writeOffset, size))
+	{
+		// the page may hold a partial record now
+		writeOffset = pageSize;
+		return false;
+	}
+
+	if (!counters.pending)
+	{
+		readPage = writePage;
+		readOffset = writeOffset;
+	}
+	writeOffset += size;
+	nextSequence++;
+	counters.stored++;
+	counters.pending++;
+	return true;
+}
+
+bool OfflineLog::peek(OfflineEvent &event)
+{
+	Header header;
+	uint8_t payload[MAX_PAYLOAD];
+
+	while (counters.pending)
+	{
+		uint32_t nameLength = 0, dataLength = 0;
+		if (RECORD_VALID == readRecord(readPage, readOffset, header, payload) && header.replayed == 0xFFFF)
+		{
+			nameLength = strnlen((const char *)payload, header.length);
+			dataLength = header.length - nameLength - 1;
+		}
+		if (nameLength && nameLength < PUBLISH_NAME_LENGTH && dataLength < PUBLISH_DATA_LENGTH)
+		{
+			memcpy(event.name, payload, nameLength);
+			event.name[nameLength] = '\0';
+			memcpy(event.data, payload + nameLength + 1, dataLength);
+			event.data[dataLength] = '\0';
+			event.ttl = header.ttl;
+			event.hasData = header.flags & OFFLINE_LOG_HAS_DATA;
+			event.isPrivate = header.flags & OFFLINE_LOG_PRIVATE;
+			return true;
+		}
+
+		// the record changed since it was counted
+		counters.corrupt++;
+		counters.pending--;
+		readPage = (readPage + 1) % pageCount;
+		readOffset = 0;
+		seekPending();
+	}
+	return false;
+}
+
+void OfflineLog::consume()
+{
+	Header header;
+	if (!counters.pending || !flash.readPage(&header, readPage * pageSize + readOffset, sizeof(Header)))
+		return;
+
+	uint16_t replayed = 0;
+	flash.writePage(&replayed, readPage * pageSize + readOffset + offsetof(Header, replayed), sizeof(replayed));
+
+	counters.replayed++;
+	counters.pending--;
+	readOffset += recordSize(header);
+	seekPending();
+}
+
+bool OfflineLog::replay(PublishQueue &queue)
+{
+	if (queue.pending())
+		return false;
+
+	Spark_Publish_Stats_TypeDef stats;
+	queue.stats(&stats);
+	if (replaying)
+	{
+		// the queue is FIFO and was empty when the event was added, so the
+		// first event it sent since was this one
+		Header header;
+		replaying = false;
+		if (stats.sent != replaySentBefore && counters.pending &&
+			flash.readPage(&header, readPage * pageSize + readOffset, sizeof(Header)) &&
+			header.sequence == replaySequence)
+		{
+			consume();
+		}
+	}
+
+	OfflineEvent event;
+	if (!peek(event))
+		return false;
+
+	Spark_Publish_Status_TypeDef status = queue.add(event.name, event.hasData ? event.data : NULL, event.ttl, event.isPrivate);
+	if (PUBLISH_QUEUED != status && PUBLISH_COALESCED != status)
+		return false;
+
+	Header header;
+	if (flash.readPage(&header, readPage * pageSize + readOffset, sizeof(Header)))
+	{
+		replaying = true;
+		replaySequence = header.sequence;
+		replaySentBefore = stats.sent;
+	}
+	return true;
+}
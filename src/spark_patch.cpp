@@ -0,0 +1,273 @@
+/**
+ ******************************************************************************
+ * @file    spark_patch.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Rebuilds a firmware image from the running image and a binary
+ *          patch, as the patch streams in.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_patch.h"
+#include "spark_crc32.h"
+#include <string.h>
+
+enum PatchOperation
+{
+	PATCH_END = 0, PATCH_COPY = 1, PATCH_ADD = 2, PATCH_DATA = 3
+};
+
+static uint32_t read32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+bool PatchApplier::isPatch(const uint8_t *data, size_t length)
+{
+	return length >= 4 && PATCH_MAGIC == read32(data);
+}
+
+PatchApplier::PatchApplier(Reader reader, Writer writer) : reader(reader), writer(writer)
+{
+	begin();
+}
+
+void PatchApplier::begin()
+{
+	state = HEADER;
+	result = PATCH_OK;
+	header_length = 0;
+	source_length = target_length = target_crc = 0;
+	source_position = 0;
+	output_fill = 0;
+	prefetched = 0;
+	output_total = 0;
+	output_crc = crc32_init();
+}
+
+Spark_Patch_Status_TypeDef PatchApplier::fail(Spark_Patch_Status_TypeDef error)
+{
+	state = FINISHED;
+	return result = error;
+}
+
+bool PatchApplier::varintByte(uint8_t b)
+{
+	varint |= uint32_t(b & 0x7F) << varint_shift;
+	varint_shift += 7;
+	return !(b & 0x80);
+}
+
+Spark_Patch_Status_TypeDef PatchApplier::parseHeader()
+{
+	if (PATCH_MAGIC != read32(header))
+		return PATCH_BAD_HEADER;
+
+	source_length = read32(header + 4);
+	uint32_t source_crc = read32(header + 8);
+	target_length = read32(header + 12);
+	target_crc = read32(header + 16);
+	if (target_length > PATCH_TARGET_LENGTH_MAX)
+		return PATCH_BAD_HEADER;
+
+	// the output buffer is free until the first operation
+	uint32_t crc = crc32_init();
+	for (uint32_t offset = 0; offset < source_length; )
+	{
+		uint32_t length = source_length - offset;
+		if (length > sizeof(output))
+			length = sizeof(output);
+		if (!reader(output, offset, length))
+			return PATCH_WRONG_SOURCE;
+		crc = crc32_update(crc, output, length);
+		offset += length;
+	}
+	return crc32_final(crc) == source_crc ? PATCH_OK : PATCH_WRONG_SOURCE;
+}
+
+Spark_Patch_Status_TypeDef PatchApplier::flush()
+{
+	if (!output_fill)
+		return PATCH_OK;
+	if (!writer(output, output_fill))
+		return PATCH_WRITE_FAILED;
+	output_crc = crc32_update(output_crc, output, output_fill);
+	output_total += output_fill;
+	output_fill = 0;
+	return PATCH_OK;
+}
+
+Spark_Patch_Status_TypeDef PatchApplier::copy()
+{
+	while (op_length)
+	{
+		if (output_fill == sizeof(output))
+		{
+			Spark_Patch_Status_TypeDef error = flush();
+			if (error)
+				return error;
+		}
+		uint32_t length = sizeof(output) - output_fill;
+		if (length > op_length)
+			length = op_length;
+		if (!reader(output + output_fill, source_position, length))
+			return PATCH_BAD_DATA;
+		output_fill += length;
+		source_position += length;
+		op_length -= length;
+	}
+	return PATCH_OK;
+}
+
+Spark_Patch_Status_TypeDef PatchApplier::prefetch()
+{
+	if (output_fill == sizeof(output))
+	{
+		Spark_Patch_Status_TypeDef error = flush();
+		if (error)
+			return error;
+	}
+	uint32_t length = sizeof(output) - output_fill;
+	if (length > op_length)
+		length = op_length;
+	if (!reader(output + output_fill, source_position, length))
+		return PATCH_BAD_DATA;
+	output_fill += length;
+	source_position += length;
+	prefetched = length;
+	return PATCH_OK;
+}
+
+Spark_Patch_Status_TypeDef PatchApplier::startOperation()
+{
+	// the operation must stay within both images, in 64 bits so that a
+	// length near 2^32 can't wrap past the check
+	if (uint64_t(output_total) + output_fill + op_length > target_length)
+		return PATCH_BAD_DATA;
+	if (PATCH_DATA != opcode && source_position + uint64_t(op_length) > source_length)
+		return PATCH_BAD_DATA;
+
+	switch (opcode)
+	{
+		case PATCH_COPY:
+			state = OPCODE;
+			return copy();
+
+		case PATCH_ADD:
+			state = op_length ? ADD_BYTES : OPCODE;
+			return PATCH_OK;
+
+		case PATCH_DATA:
+		default:
+			state = op_length ? DATA_BYTES : OPCODE;
+			return PATCH_OK;
+	}
+}
+
+Spark_Patch_Status_TypeDef PatchApplier::finish()
+{
+	Spark_Patch_Status_TypeDef error = flush();
+	if (error)
+		return fail(error);
+	if (output_total != target_length || crc32_final(output_crc) != target_crc)
+		return fail(PATCH_BAD_TARGET);
+	state = FINISHED;
+	return result = PATCH_DONE;
+}
+
+Spark_Patch_Status_TypeDef PatchApplier::apply(const uint8_t *data, size_t length)
+{
+	Spark_Patch_Status_TypeDef error;
+	while (length-- && FINISHED != state)
+	{
+		uint8_t b = *data++;
+		switch (state)
+		{
+			case HEADER:
+				header[header_length++] = b;
+				if (PATCH_HEADER_LENGTH == header_length)
+				{
+					if ((error = parseHeader()))
+						return fail(error);
+					state = OPCODE;
+				}
+				break;
+
+			case OPCODE:
+				opcode = b;
+				if (PATCH_END == opcode)
+					return finish();
+				if (opcode > PATCH_DATA)
+					return fail(PATCH_BAD_DATA);
+				varint = 0;
+				varint_shift = 0;
+				state = LENGTH;
+				break;
+
+			case LENGTH:
+				if (varint_shift > 28)
+					return fail(PATCH_BAD_DATA);
+				if (varintByte(b))
+				{
+					op_length = varint;
+					varint = 0;
+					varint_shift = 0;
+					if (PATCH_DATA == opcode && (error = startOperation()))
+						return fail(error);
+					if (PATCH_DATA != opcode)
+						state = OFFSET;
+				}
+				break;
+
+			case OFFSET:
+				if (varint_shift > 28)
+					return fail(PATCH_BAD_DATA);
+				if (varintByte(b))
+				{
+					int64_t position = int64_t(source_position) + int32_t((varint >> 1) ^ -(varint & 1));
+					if (position < 0 || position > source_length)
+						return fail(PATCH_BAD_DATA);
+					source_position = uint32_t(position);
+					if ((error = startOperation()))
+						return fail(error);
+				}
+				break;
+
+			case ADD_BYTES:
+				if (!prefetched && (error = prefetch()))
+					return fail(error);
+				output[output_fill - prefetched--] += b;
+				if (!--op_length)
+					state = OPCODE;
+				break;
+
+			case DATA_BYTES:
+				if (output_fill == sizeof(output) && (error = flush()))
+					return fail(error);
+				output[output_fill++] = b;
+				if (!--op_length)
+					state = OPCODE;
+				break;
+
+			case FINISHED:
+				break;
+		}
+	}
+	return result;
+}
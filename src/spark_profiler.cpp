@@ -0,0 +1,101 @@
+/**
+ ******************************************************************************
+ * @file    spark_profiler.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Cycle counting probes around the main loop and the interrupt
+ *          handlers, compiled in with SPARK_PROFILER.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_profiler.h"
+
+#ifdef SPARK_PROFILER
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef STM32F10X_MD
+volatile uint32_t Profiler_Fake_Cycles;
+#endif
+
+static const char *const Probe_Names[PROBE_COUNT] = {
+	"loop", "wlan", "cloud", "systick", "usart", "exti"
+};
+
+// Each probe is updated from one context only - the main loop, or one
+// interrupt priority - so the updates need no locking
+static volatile Spark_Probe_Stats_TypeDef Probes[PROBE_COUNT];
+
+void profilerRecord(Spark_Probe_TypeDef probe, uint32_t cycles)
+{
+	volatile Spark_Probe_Stats_TypeDef &stats = Probes[probe];
+	if (!stats.count || cycles < stats.min_cycles)
+		stats.min_cycles = cycles;
+	if (cycles > stats.max_cycles)
+		stats.max_cycles = cycles;
+	stats.total_cycles += cycles;
+	stats.count++;
+}
+
+void profilerStats(Spark_Probe_TypeDef probe, Spark_Probe_Stats_TypeDef *stats)
+{
+	// read twice and compare, in case the probe's interrupt ran meanwhile
+	do
+	{
+		memcpy(stats, (const void *)&Probes[probe], sizeof(*stats));
+	}
+	while (stats->count != Probes[probe].count);
+}
+
+void profilerReset(void)
+{
+	memset((void *)Probes, 0, sizeof(Probes));
+}
+
+size_t profilerReport(char *buffer, size_t size)
+{
+	size_t length = 0;
+	if (!size)
+		return 0;
+	buffer[0] = 0;
+
+	for (int probe = 0; probe < PROBE_COUNT; probe++)
+	{
+		Spark_Probe_Stats_TypeDef stats;
+		profilerStats(Spark_Probe_TypeDef(probe), &stats);
+		if (!stats.count)
+			continue;
+
+		int written = snprintf(buffer + length, size - length, "%s%s:%lu,%lu,%lu,%lu",
+				length ? " " : "", Probe_Names[probe], (unsigned long)stats.count,
+				(unsigned long)(stats.total_cycles / stats.count),
+				(unsigned long)stats.min_cycles, (unsigned long)stats.max_cycles);
+		if (written < 0 || size_t(written) >= size - length)
+		{
+			// drop the probe that did not fit whole
+			buffer[length] = 0;
+			break;
+		}
+		length += written;
+	}
+	return length;
+}
+
+#endif /* SPARK_PROFILER */
@@ -0,0 +1,136 @@
+/**
+ ******************************************************************************
+ * @file    spark_publish_queue.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Queue of events waiting to be published, sent at a limited rate.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_publish_queue.h"
+#include <string.h>
+
+static const uint32_t PUBLISH_BUDGET_MAX = uint32_t(PUBLISH_BURST) * PUBLISH_INTERVAL_MILLIS;
+
+PublishQueue::PublishQueue(Sender sender) : sender(sender), coalescing(false)
+{
+	clear();
+	memset(&counters, 0, sizeof(counters));
+}
+
+void PublishQueue::clear()
+{
+	head = 0;
+	count = 0;
+	budget = PUBLISH_BUDGET_MAX;
+	drained = false;
+}
+
+void PublishQueue::copy(char *destination, size_t size, const char *source, size_t length)
+{
+	if (length > size - 1)
+		length = size - 1;
+	if (length)
+		memcpy(destination, source, length);
+	destination[length] = '\0';
+}
+
+Spark_Publish_Status_TypeDef PublishQueue::add(const char *eventName, const char *eventData, int ttl, bool isPrivate)
+{
+	return add(eventName, strnlen(eventName, PUBLISH_NAME_LENGTH),
+			eventData, eventData ? strnlen(eventData, PUBLISH_DATA_LENGTH) : 0, ttl, isPrivate);
+}
+
+Spark_Publish_Status_TypeDef PublishQueue::add(const char *eventName, size_t nameLength, const char *eventData, size_t dataLength, int ttl, bool isPrivate)
+{
+	if (nameLength > PUBLISH_NAME_LENGTH - 1)
+		nameLength = PUBLISH_NAME_LENGTH - 1;
+
+	if (coalescing)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			Entry &entry = at(i);
+			if (entry.isPrivate == isPrivate && !entry.name[nameLength] && 0 == strncmp(entry.name, eventName, nameLength))
+			{
+				entry.hasData = (NULL != eventData);
+				copy(entry.data, PUBLISH_DATA_LENGTH, eventData, entry.hasData ? dataLength : 0);
+				entry.ttl = ttl;
+				counters.queued++;
+				counters.coalesced++;
+				return PUBLISH_COALESCED;
+			}
+		}
+	}
+
+	if (count == PUBLISH_QUEUE_DEPTH)
+	{
+		counters.dropped++;
+		return PUBLISH_QUEUE_FULL;
+	}
+
+	Entry &entry = at(count);
+	copy(entry.name, PUBLISH_NAME_LENGTH, eventName, nameLength);
+	entry.hasData = (NULL != eventData);
+	copy(entry.data, PUBLISH_DATA_LENGTH, eventData, entry.hasData ? dataLength : 0);
+	entry.ttl = ttl;
+	entry.isPrivate = isPrivate;
+
+	count++;
+	counters.queued++;
+	if (count > counters.high_water)
+		counters.high_water = count;
+	return PUBLISH_QUEUED;
+}
+
+int PublishQueue::drain(uint32_t now)
+{
+	if (drained)
+	{
+		uint32_t elapsed = now - lastDrain;
+		budget = (elapsed >= PUBLISH_BUDGET_MAX - budget) ? PUBLISH_BUDGET_MAX : budget + elapsed;
+	}
+	lastDrain = now;
+	drained = true;
+
+	int sent = 0;
+	while (count && budget >= PUBLISH_INTERVAL_MILLIS)
+	{
+		Entry &entry = at(0);
+		if (!sender(entry.name, entry.hasData ? entry.data : NULL, entry.ttl, entry.isPrivate))
+		{
+			counters.send_failed++;
+			break;
+		}
+
+		counters.sent++;
+		counters.bytes_sent += strlen(entry.name) + strlen(entry.data);
+		budget -= PUBLISH_INTERVAL_MILLIS;
+		head = (head + 1) % PUBLISH_QUEUE_DEPTH;
+		count--;
+		sent++;
+	}
+	return sent;
+}
+
+void PublishQueue::stats(Spark_Publish_Stats_TypeDef *stats) const
+{
+	*stats = counters;
+	stats->pending = count;
+}
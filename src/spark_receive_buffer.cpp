@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ * @file    spark_receive_buffer.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Buffers data read from the cloud socket and limits how often an
+ *          idle socket is polled.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_receive_buffer.h"
+#include <string.h>
+
+ReceiveBuffer::ReceiveBuffer(Reader reader) : reader(reader)
+{
+	memset(&counters, 0, sizeof(counters));
+	clear();
+}
+
+void ReceiveBuffer::clear()
+{
+	head = tail = 0;
+	idle = false;
+}
+
+int ReceiveBuffer::read(uint8_t *buf, int length, uint32_t now)
+{
+	counters.polls++;
+	int count = reader(buf, length);
+	if (count > 0)
+	{
+		counters.bytes += count;
+		idle = false;
+	}
+	else if (count == 0)
+	{
+		counters.idle_polls++;
+		idle = true;
+		idleSince = now;
+	}
+	return count;
+}
+
+int ReceiveBuffer::receive(uint8_t *buf, int length, uint32_t now)
+{
+	// serve what is buffered first
+	int count = tail - head;
+	if (count > length)
+		count = length;
+	memcpy(buf, buffer + head, count);
+	head += count;
+	if (count == length)
+		return count;
+
+	// the buffer is now empty: the rest of the request comes from the socket,
+	// so a message header is never cut short at the end of a refill
+	if (idle && (now - idleSince) < SPARK_RECEIVE_POLL_MILLIS)
+	{
+		if (count == 0)
+			counters.skipped++;
+		return count;
+	}
+
+	int wanted = length - count;
+	int got;
+	if (wanted >= SPARK_RECEIVE_BUFFER_SIZE)
+	{
+		// a large request can be read in place
+		got = read(buf + count, wanted, now);
+	}
+	else
+	{
+		head = tail = 0;
+		got = read(buffer, SPARK_RECEIVE_BUFFER_SIZE, now);
+		if (got > 0)
+		{
+			tail = got;
+			if (got > wanted)
+				got = wanted;
+			memcpy(buf + count, buffer, got);
+			head = got;
+		}
+	}
+
+	// an error is reported on the next receive, once the data read is used
+	if (got < 0)
+		return count ? count : got;
+	return count + got;
+}
@@ -0,0 +1,221 @@
+/**
+ ******************************************************************************
+ * @file    spark_scheduler.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Cooperative scheduler of one-shot and periodic software timers and
+ *          posted tasks, run from the main loop.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_scheduler.h"
+#include <string.h>
+
+static_assert(SCHEDULER_MAX_TIMERS > 0 && SCHEDULER_MAX_TIMERS < 256, "SCHEDULER_MAX_TIMERS must be 1..255");
+static_assert(SCHEDULER_QUEUE_DEPTH > 0 && SCHEDULER_QUEUE_DEPTH < 256, "SCHEDULER_QUEUE_DEPTH must be 1..255");
+
+Scheduler::Scheduler(Clock clock) : clock(clock)
+{
+	memset(timers, 0, sizeof(timers));
+	memset(heap, 0, sizeof(heap));
+	memset(queue, 0, sizeof(queue));
+	memset(&counters, 0, sizeof(counters));
+	heapCount = queueHead = queueCount = 0;
+}
+
+int Scheduler::after(uint32_t delay, Task task)
+{
+	return start(delay, 0, task);
+}
+
+int Scheduler::every(uint32_t period, Task task)
+{
+	if (!period)
+		return -1;
+	return start(period, period, task);
+}
+
+int Scheduler::start(uint32_t delay, uint32_t period, Task task)
+{
+	if (!task)
+		return -1;
+
+	uint8_t slot = 0;
+	while (slot < SCHEDULER_MAX_TIMERS && timers[slot].task)
+		slot++;
+	if (slot == SCHEDULER_MAX_TIMERS)
+	{
+		counters.refused++;
+		return -1;
+	}
+
+	Timer &timer = timers[slot];
+	timer.task = task;
+	timer.due = clock() + delay;
+	timer.period = period;
+	timer.heapIndex = heapCount;
+	heap[heapCount++] = slot;
+	siftUp(timer.heapIndex);
+	return slot | (timer.generation << 8);
+}
+
+bool Scheduler::cancel(int id)
+{
+	uint8_t slot = id & 0xFF;
+	if (id < 0 || slot >= SCHEDULER_MAX_TIMERS)
+		return false;
+
+	Timer &timer = timers[slot];
+	if (!timer.task || timer.generation != uint8_t(id >> 8))
+		return false;
+
+	remove(timer.heapIndex);
+	return true;
+}
+
+bool Scheduler::post(Task task)
+{
+	if (!task || queueCount == SCHEDULER_QUEUE_DEPTH)
+	{
+		counters.refused++;
+		return false;
+	}
+	queue[(queueHead + queueCount++) % SCHEDULER_QUEUE_DEPTH] = task;
+	return true;
+}
+
+int Scheduler::run()
+{
+	uint32_t now = clock();
+	int called = 0;
+	counters.runs++;
+
+	// no more calls than there were timers pending, so a callback that
+	// starts a timer already due can't keep run() from returning
+	for (uint8_t limit = heapCount; heapCount && limit; limit--)
+	{
+		Timer &timer = timers[heap[0]];
+		int32_t late = int32_t(now - timer.due);
+		if (late < 0)
+			break;
+
+		if (uint32_t(late) > counters.max_late_millis)
+			counters.max_late_millis = late;
+
+		// rescheduled or freed before the call, so the task may cancel or
+		// start timers, this one included
+		Task task = timer.task;
+		if (timer.period)
+		{
+			uint32_t missed = uint32_t(late) / timer.period;
+			counters.overruns += missed;
+			timer.due += (missed + 1) * timer.period;
+			siftDown(0);
+		}
+		else
+		{
+			remove(0);
+		}
+
+		counters.fired++;
+		called++;
+		task();
+	}
+
+	// only the tasks posted before this run, for the same reason
+	for (uint8_t count = queueCount; count && queueCount; count--)
+	{
+		Task task = queue[queueHead];
+		queueHead = (queueHead + 1) % SCHEDULER_QUEUE_DEPTH;
+		queueCount--;
+		counters.posted++;
+		called++;
+		task();
+	}
+
+	return called;
+}
+
+uint32_t Scheduler::idleMillis() const
+{
+	if (queueCount)
+		return 0;
+	if (!heapCount)
+		return UINT32_MAX;
+	int32_t remaining = int32_t(timers[heap[0]].due - clock());
+	return remaining > 0 ? remaining : 0;
+}
+
+void Scheduler::stats(Spark_Scheduler_Stats_TypeDef *stats) const
+{
+	*stats = counters;
+}
+
+bool Scheduler::earlier(uint8_t a, uint8_t b) const
+{
+	return int32_t(timers[heap[a]].due - timers[heap[b]].due) < 0;
+}
+
+void Scheduler::swap(uint8_t i, uint8_t j)
+{
+	uint8_t slot = heap[i];
+	heap[i] = heap[j];
+	heap[j] = slot;
+	timers[heap[i]].heapIndex = i;
+	timers[heap[j]].heapIndex = j;
+}
+
+void Scheduler::siftUp(uint8_t i)
+{
+	while (i && earlier(i, (i - 1) / 2))
+	{
+		swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+void Scheduler::siftDown(uint8_t i)
+{
+	for (;;)
+	{
+		int child = 2 * i + 1;
+		if (child >= heapCount)
+			break;
+		if (child + 1 < heapCount && earlier(child + 1, child))
+			child++;
+		if (!earlier(child, i))
+			break;
+		swap(i, child);
+		i = child;
+	}
+}
+
+void Scheduler::remove(uint8_t i)
+{
+	Timer &timer = timers[heap[i]];
+	timer.task = NULL;
+	timer.generation++;
+
+	if (i != --heapCount)
+	{
+		swap(i, heapCount);
+		siftDown(i);
+		siftUp(i);
+	}
+}
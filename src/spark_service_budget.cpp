@@ -0,0 +1,103 @@
+/**
+ ******************************************************************************
+ * @file    spark_service_budget.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Bounds the time the main loop and delay() give to the WLAN and
+ *          cloud, and adapts how often delay() gives it.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_service_budget.h"
+#include <string.h>
+
+static_assert(SERVICE_BUSY_INTERVAL_MILLIS > 0 && SERVICE_BUSY_INTERVAL_MILLIS <= SERVICE_IDLE_INTERVAL_MILLIS,
+		"SERVICE_BUSY_INTERVAL_MILLIS must be 1..SERVICE_IDLE_INTERVAL_MILLIS");
+
+ServiceBudget::ServiceBudget(Service service, Busy busy, Clock clock)
+	: service(service), busy(busy), clock(clock)
+{
+	budget = SERVICE_BUDGET_MILLIS;
+	interval = SERVICE_BUSY_INTERVAL_MILLIS;
+	last = 0;
+	memset(&counters, 0, sizeof(counters));
+}
+
+int ServiceBudget::run()
+{
+	return slice(clock() + budget);
+}
+
+int ServiceBudget::poll(uint32_t deadline)
+{
+	if (!due())
+		return 0;
+
+	uint32_t end = clock() + budget;
+	if (int32_t(deadline - end) < 0)
+		end = deadline;
+	return slice(end);
+}
+
+int ServiceBudget::slice(uint32_t end)
+{
+	uint32_t start = clock();
+	uint32_t now;
+	bool pending;
+	int passes = 0;
+
+	// the first pass whatever the budget, then more while there is work
+	do
+	{
+		service();
+		passes++;
+		pending = busy();
+		now = clock();
+	}
+	while (pending && int32_t(end - now) > 0);
+
+	uint32_t elapsed = now - start;
+	counters.slices++;
+	counters.passes += passes;
+	if (elapsed > counters.max_slice_millis)
+		counters.max_slice_millis = elapsed;
+	if (elapsed > budget)
+		counters.overruns++;
+
+	if (pending)
+	{
+		counters.busy++;
+		interval = SERVICE_BUSY_INTERVAL_MILLIS;
+	}
+	else if (interval < SERVICE_IDLE_INTERVAL_MILLIS)
+	{
+		interval *= 2;
+		if (interval > SERVICE_IDLE_INTERVAL_MILLIS)
+			interval = SERVICE_IDLE_INTERVAL_MILLIS;
+	}
+	last = now;
+	return passes;
+}
+
+void ServiceBudget::stats(Spark_Service_Stats_TypeDef *stats) const
+{
+	*stats = counters;
+	stats->interval_millis = interval;
+	stats->budget_millis = budget;
+}
@@ -25,6 +25,10 @@
   ******************************************************************************
  */
 #include "spark_utilities.h"
+#include "spark_key_index.h"
+#include "spark_event_trie.h"
+#include "spark_profiler.h"
+#include "spark_loop_monitor.h"
 #include "spark_wiring.h"
 #include "socket.h"
 #include "netapp.h"
@@ -33,6 +37,20 @@
 
 SparkProtocol spark_protocol;
 
+static bool Spark_Send_Event(const char *eventName, const char *eventData, int ttl, bool isPrivate)
+{
+  return spark_protocol.send_event(eventName, eventData, ttl, isPrivate ? EventType::PRIVATE : EventType::PUBLIC);
+}
+
+PublishQueue Publish_Queue(Spark_Send_Event);
+
+#ifdef SPARK_SFLASH_ENABLE
+ExternalFlashRegion Offline_Log_Flash(OFFLINE_LOG_ADDRESS, OFFLINE_LOG_SECTORS);
+OfflineLog Offline_Log(Offline_Log_Flash);
+bool Offline_Log_Enabled;
+uint32_t Offline_Replay_Time;
+#endif
+
 #define INVALID_SOCKET (-1)
 
 long sparkSocket = INVALID_SOCKET;
@@ -42,13 +60,8 @@ sockaddr tSocketAddr;
 
 extern uint8_t LED_RGB_BRIGHTNESS;
 
-// LED_Signaling_Override
+// LED_ANIMATION_SIGNAL plays while set
 __IO uint8_t LED_Spark_Signal;
-__IO uint32_t LED_Signaling_Timing;
-const uint32_t VIBGYOR_Colors[] = {
-  0xEE82EE, 0x4B0082, 0x0000FF, 0x00FF00, 0xFFFF00, 0xFFA500, 0xFF0000};
-int VIBGYOR_Size = sizeof(VIBGYOR_Colors) / sizeof(uint32_t);
-int VIBGYOR_Index;
 
 int User_Var_Count;
 int User_Func_Count;
@@ -64,11 +77,66 @@ struct User_Func_Lookup_Table_t
 {
 	int (*pUserFunc)(String userArg);
 	char userFuncKey[USER_FUNC_KEY_LENGTH];
-	char userFuncArg[USER_FUNC_ARG_LENGTH];
-	int userFuncRet;
-	bool userFuncSchedule;
+	Spark_Function_Call_TypeDef userFuncCallType;
 } User_Func_Lookup_Table[USER_FUNC_MAX_COUNT];
 
+// Deferred function calls, run from the main loop in the order received
+static void userFuncRun(int i, const char *arg);
+FunctionQueue User_Func_Queue(userFuncRun);
+
+static const char *userVarKeyAt(int index)
+{
+	return User_Var_Lookup_Table[index].userVarKey;
+}
+
+static const char *userFuncKeyAt(int index)
+{
+	return User_Func_Lookup_Table[index].userFuncKey;
+}
+
+static bool Spark_Send_Variables(const char *data, size_t length)
+{
+  return PUBLISH_QUEUED == Publish_Queue.add("spark/variables", 15, data, length, 60, true);
+}
+
+// Variables registered with a deadband, their changes are pushed as events
+VariableTracker User_Var_Tracker(Spark_Send_Variables);
+
+static uint32_t Scheduler_Clock(void)
+{
+  return millis();
+}
+
+// Timers and tasks of the application and the system, run from the main
+// loop after loop()
+Scheduler Spark_Scheduler(Scheduler_Clock);
+
+// micros() divides the cycle counter, so it wraps after 59.6 seconds rather
+// than at 2^32; this one carries the remainder so that it wraps at 2^32
+static uint32_t Loop_Monitor_Micros(void)
+{
+  static uint32_t last_cycles, cycles_left, elapsed_micros;
+  uint32_t cycles = DWT->CYCCNT;
+  cycles_left += cycles - last_cycles;
+  last_cycles = cycles;
+  elapsed_micros += cycles_left / SYSTEM_US_TICKS;
+  cycles_left %= SYSTEM_US_TICKS;
+  return elapsed_micros;
+}
+
+static uint32_t Loop_Monitor_Millis(void)
+{
+  return millis();
+}
+
+// Main loop timing, charged to the subsystems that ran
+LoopMonitor Loop_Monitor(Loop_Monitor_Micros, Loop_Monitor_Millis);
+static bool User_Var_Push_Started;
+
+// Hashed indexes over the lookup tables, so cloud requests don't scan the tables
+KeyIndex<USER_VAR_MAX_COUNT, USER_VAR_KEY_LENGTH> User_Var_Index(userVarKeyAt);
+KeyIndex<USER_FUNC_MAX_COUNT, USER_FUNC_KEY_LENGTH> User_Func_Index(userFuncKeyAt);
+
 /*
 static unsigned char uitoa(unsigned int cNum, char *cString);
 static unsigned int atoui(char *cString);
@@ -203,91 +271,185 @@ void SparkClass::variable(const char *varKey, void *userVar, Spark_Data_TypeDef
     if (User_Var_Count == USER_VAR_MAX_COUNT)
       return;
 
-    for (int i = 0; i < User_Var_Count; i++)
-    {
-      if (User_Var_Lookup_Table[i].userVar == userVar &&
-          (0 == strncmp(User_Var_Lookup_Table[i].userVarKey, varKey, USER_VAR_KEY_LENGTH)))
-      {
-        return;
-      }
-    }
+    // a key can only be registered once, the first registration wins
+    if (User_Var_Index.find(varKey) >= 0)
+      return;
 
     User_Var_Lookup_Table[User_Var_Count].userVar = userVar;
     User_Var_Lookup_Table[User_Var_Count].userVarType = userVarType;
     memset(User_Var_Lookup_Table[User_Var_Count].userVarKey, 0, USER_VAR_KEY_LENGTH);
-    memcpy(User_Var_Lookup_Table[User_Var_Count].userVarKey, varKey, USER_VAR_KEY_LENGTH);
+    strncpy(User_Var_Lookup_Table[User_Var_Count].userVarKey, varKey, USER_VAR_KEY_LENGTH);
+    User_Var_Index.add(User_Var_Lookup_Table[User_Var_Count].userVarKey, User_Var_Count);
     User_Var_Count++;
   }
 }
 
+void SparkClass::variable(const char *varKey, void *userVar, Spark_Data_TypeDef userVarType, double deadband)
+{
+  int count = User_Var_Count;
+  variable(varKey, userVar, userVarType);
+  if (count != User_Var_Count)
+    User_Var_Tracker.track(User_Var_Lookup_Table[count].userVarKey, userVar, userVarType, deadband);
+
+  // the variables are only compared when a push is due
+  if (!User_Var_Push_Started && User_Var_Tracker.count())
+    User_Var_Push_Started = 0 <= Spark_Scheduler.every(USER_VAR_PUSH_MILLIS, userVarProcess);
+}
+
+/*
+ * Calls task every period ms, from the main loop after loop(), until the
+ * timer is cancelled. Unlike polling millis() in loop(), a periodic timer
+ * keeps its phase when loop() runs late.
+ * Returns the timer id, or -1 if SCHEDULER_MAX_TIMERS are already running.
+ */
+int SparkClass::every(unsigned long period, void (*task)(void))
+{
+  return Spark_Scheduler.every(period, task);
+}
+
+/*
+ * Calls task once, delay ms from now.
+ */
+int SparkClass::after(unsigned long delay, void (*task)(void))
+{
+  return Spark_Scheduler.after(delay, task);
+}
+
+bool SparkClass::cancel(int timer)
+{
+  return Spark_Scheduler.cancel(timer);
+}
+
 void SparkClass::function(const char *funcKey, int (*pFunc)(String paramString))
 {
-	int i = 0;
+	function(funcKey, pFunc, CALL_IMMEDIATE);
+}
+
+/*
+ * A CALL_DEFERRED function is not run while the cloud request is being handled.
+ * The call is queued and the cloud is answered straight away with 0 (or -1 if
+ * the queue is full). The function runs from the main loop after loop(), and
+ * its return value is published as the private event "spark/function/<key>".
+ */
+void SparkClass::function(const char *funcKey, int (*pFunc)(String paramString), Spark_Function_Call_TypeDef callType)
+{
 	if(NULL != pFunc && NULL != funcKey)
 	{
 		if(User_Func_Count == USER_FUNC_MAX_COUNT)
 			return;
 
-		for(i = 0; i < User_Func_Count; i++)
-		{
-			if(User_Func_Lookup_Table[i].pUserFunc == pFunc && (0 == strncmp(User_Func_Lookup_Table[i].userFuncKey, funcKey, USER_FUNC_KEY_LENGTH)))
-			{
-				return;
-			}
-		}
+		// a key can only be registered once, the first registration wins
+		if(User_Func_Index.find(funcKey) >= 0)
+			return;
 
 		User_Func_Lookup_Table[User_Func_Count].pUserFunc = pFunc;
-		memset(User_Func_Lookup_Table[User_Func_Count].userFuncArg, 0, USER_FUNC_ARG_LENGTH);
 		memset(User_Func_Lookup_Table[User_Func_Count].userFuncKey, 0, USER_FUNC_KEY_LENGTH);
-		memcpy(User_Func_Lookup_Table[User_Func_Count].userFuncKey, funcKey, USER_FUNC_KEY_LENGTH);
-		User_Func_Lookup_Table[User_Func_Count].userFuncSchedule = false;
+		strncpy(User_Func_Lookup_Table[User_Func_Count].userFuncKey, funcKey, USER_FUNC_KEY_LENGTH);
+		User_Func_Lookup_Table[User_Func_Count].userFuncCallType = callType;
+		User_Func_Index.add(User_Func_Lookup_Table[User_Func_Count].userFuncKey, User_Func_Count);
 		User_Func_Count++;
 	}
 }
 
-void SparkClass::publish(const char *eventName)
+Spark_Publish_Status_TypeDef SparkClass::publish(const char *eventName)
+{
+  return publish(eventName, NULL, 60, PUBLIC);
+}
+
+Spark_Publish_Status_TypeDef SparkClass::publish(const char *eventName, const char *eventData)
+{
+  return publish(eventName, eventData, 60, PUBLIC);
+}
+
+Spark_Publish_Status_TypeDef SparkClass::publish(const char *eventName, const char *eventData, int ttl)
+{
+  return publish(eventName, eventData, ttl, PUBLIC);
+}
+
+Spark_Publish_Status_TypeDef SparkClass::publish(const char *eventName, const char *eventData, int ttl, Spark_Event_TypeDef eventType)
+{
+  return publish(eventName, strlen(eventName), eventData, eventData ? strlen(eventData) : 0, ttl, eventType);
+}
+
+// Events are queued and sent from the communication loop at the rate the
+// cloud accepts. The status tells the application when to back off.
+// The name and data are copied straight into the queue, so they need not
+// be NUL terminated and no heap is used.
+Spark_Publish_Status_TypeDef SparkClass::publish(const char *eventName, size_t nameLength, const char *eventData, size_t dataLength, int ttl, Spark_Event_TypeDef eventType)
+{
+  if (!SPARK_CLOUD_SOCKETED)
+  {
+#ifdef SPARK_SFLASH_ENABLE
+    if (Offline_Log_Enabled && Offline_Log.append(eventName, nameLength, eventData, dataLength, ttl, PRIVATE == eventType))
+      return PUBLISH_STORED;
+#endif
+    return PUBLISH_NOT_CONNECTED;
+  }
+  return Publish_Queue.add(eventName, nameLength, eventData, dataLength, ttl, PRIVATE == eventType);
+}
+
+Spark_Publish_Status_TypeDef SparkClass::publish(const String &eventName)
+{
+  return publish(eventName.c_str(), eventName.length(), NULL, 0, 60, PUBLIC);
+}
+
+Spark_Publish_Status_TypeDef SparkClass::publish(const String &eventName, const String &eventData)
 {
-  spark_protocol.send_event(eventName, NULL, 60, EventType::PUBLIC);
+  return publish(eventName.c_str(), eventName.length(), eventData.c_str(), eventData.length(), 60, PUBLIC);
 }
 
-void SparkClass::publish(const char *eventName, const char *eventData)
+Spark_Publish_Status_TypeDef SparkClass::publish(const String &eventName, const String &eventData, int ttl)
 {
-  spark_protocol.send_event(eventName, eventData, 60, EventType::PUBLIC);
+  return publish(eventName.c_str(), eventName.length(), eventData.c_str(), eventData.length(), ttl, PUBLIC);
 }
 
-void SparkClass::publish(const char *eventName, const char *eventData, int ttl)
+Spark_Publish_Status_TypeDef SparkClass::publish(const String &eventName, const String &eventData, int ttl, Spark_Event_TypeDef eventType)
 {
-  spark_protocol.send_event(eventName, eventData, ttl, EventType::PUBLIC);
+  return publish(eventName.c_str(), eventName.length(), eventData.c_str(), eventData.length(), ttl, eventType);
 }
 
-void SparkClass::publish(const char *eventName, const char *eventData, int ttl, Spark_Event_TypeDef eventType)
+void SparkClass::coalescePublish(bool enable)
 {
-  spark_protocol.send_event(eventName, eventData, ttl, (eventType ? EventType::PRIVATE : EventType::PUBLIC));
+  Publish_Queue.coalesce(enable);
 }
 
-void SparkClass::publish(String eventName)
+// When enabled, events published without a cloud connection are kept in the
+// external flash and sent once the core is connected again.
+void SparkClass::storeOffline(bool enable)
 {
-  publish(eventName.c_str());
+#ifdef SPARK_SFLASH_ENABLE
+  if (enable && !Offline_Log_Enabled)
+    Offline_Log.begin();
+  Offline_Log_Enabled = enable;
+#endif
 }
 
-void SparkClass::publish(String eventName, String eventData)
+// Subscriptions are matched here rather than by the protocol, which compares
+// the event name against every handler. The protocol only knows the
+// dispatcher, registered once with an empty filter that matches every event.
+EventTrie<USER_EVENT_TRIE_NODES, USER_EVENT_HANDLER_MAX_COUNT> Event_Trie;
+static bool Event_Dispatcher_Added;
+
+static void Spark_Event_Dispatch(const char *eventName, const char *data)
 {
-  publish(eventName.c_str(), eventData.c_str());
+  Event_Trie.dispatch(eventName, data);
 }
 
-void SparkClass::publish(String eventName, String eventData, int ttl)
+static bool Spark_Event_Subscribe(const char *eventName, EventHandler handler)
 {
-  publish(eventName.c_str(), eventData.c_str(), ttl);
+  if (!Event_Dispatcher_Added)
+    Event_Dispatcher_Added = spark_protocol.add_event_handler("", Spark_Event_Dispatch);
+  return Event_Dispatcher_Added && 0 <= Event_Trie.add(eventName, strnlen(eventName, USER_EVENT_NAME_LENGTH), handler);
 }
 
-void SparkClass::publish(String eventName, String eventData, int ttl, Spark_Event_TypeDef eventType)
+uint32_t subscriptionHits(const char *eventName, EventHandler handler)
 {
-  publish(eventName.c_str(), eventData.c_str(), ttl, eventType);
+  return Event_Trie.hits(Event_Trie.find(eventName, handler));
 }
 
 bool SparkClass::subscribe(const char *eventName, EventHandler handler)
 {
-  bool success = spark_protocol.add_event_handler(eventName, handler);
+  bool success = Spark_Event_Subscribe(eventName, handler);
   if (success)
   {
     success = spark_protocol.send_subscription(eventName, SubscriptionScope::FIREHOSE);
@@ -297,7 +459,7 @@ bool SparkClass::subscribe(const char *eventName, EventHandler handler)
 
 bool SparkClass::subscribe(const char *eventName, EventHandler handler, Spark_Subscription_Scope_TypeDef scope)
 {
-  bool success = spark_protocol.add_event_handler(eventName, handler);
+  bool success = Spark_Event_Subscribe(eventName, handler);
   if (success)
   {
     success = spark_protocol.send_subscription(eventName, SubscriptionScope::MY_DEVICES);
@@ -307,7 +469,7 @@ bool SparkClass::subscribe(const char *eventName, EventHandler handler, Spark_Su
 
 bool SparkClass::subscribe(const char *eventName, EventHandler handler, const char *deviceID)
 {
-  bool success = spark_protocol.add_event_handler(eventName, handler);
+  bool success = Spark_Event_Subscribe(eventName, handler);
   if (success)
   {
     success = spark_protocol.send_subscription(eventName, deviceID);
@@ -315,17 +477,39 @@ bool SparkClass::subscribe(const char *eventName, EventHandler handler, const ch
   return success;
 }
 
-bool SparkClass::subscribe(String eventName, EventHandler handler)
+// The filter is sent to the cloud NUL terminated, so a name given with a
+// length only needs a terminated copy on the stack.
+bool SparkClass::subscribe(const char *eventName, size_t nameLength, EventHandler handler)
+{
+  char name[USER_EVENT_NAME_LENGTH];
+  if (nameLength >= sizeof(name))
+    nameLength = sizeof(name) - 1;
+  memcpy(name, eventName, nameLength);
+  name[nameLength] = '\0';
+  return subscribe(name, handler);
+}
+
+bool SparkClass::subscribe(const char *eventName, size_t nameLength, EventHandler handler, Spark_Subscription_Scope_TypeDef scope)
+{
+  char name[USER_EVENT_NAME_LENGTH];
+  if (nameLength >= sizeof(name))
+    nameLength = sizeof(name) - 1;
+  memcpy(name, eventName, nameLength);
+  name[nameLength] = '\0';
+  return subscribe(name, handler, scope);
+}
+
+bool SparkClass::subscribe(const String &eventName, EventHandler handler)
 {
   return subscribe(eventName.c_str(), handler);
 }
 
-bool SparkClass::subscribe(String eventName, EventHandler handler, Spark_Subscription_Scope_TypeDef scope)
+bool SparkClass::subscribe(const String &eventName, EventHandler handler, Spark_Subscription_Scope_TypeDef scope)
 {
   return subscribe(eventName.c_str(), handler, scope);
 }
 
-bool SparkClass::subscribe(String eventName, EventHandler handler, String deviceID)
+bool SparkClass::subscribe(const String &eventName, EventHandler handler, const String &deviceID)
 {
   return subscribe(eventName.c_str(), handler, deviceID.c_str());
 }
@@ -510,13 +694,18 @@ void SparkClass::process(void)
 #ifdef SPARK_WLAN_ENABLE
   if (SPARK_CLOUD_SOCKETED && !Spark_Communication_Loop())
   {
-    SPARK_FLASH_UPDATE = 0;
-    SPARK_CLOUD_CONNECTED = 0;
-    SPARK_CLOUD_SOCKETED = 0;
+    Spark_Connection_State.dispatch(CONNECTION_EVENT_SOCKET_CLOSED);
   }
 #endif
 }
 
+// Caps the time the main loop and delay() give the cloud at a time, 0 for a
+// single pass
+void SparkClass::serviceBudget(unsigned long millis)
+{
+  Spark_Service_Budget.setBudget(millis);
+}
+
 String SparkClass::deviceID(void)
 {
 	String deviceID;
@@ -547,6 +736,36 @@ String SparkClass::deviceID(void)
 	return deviceID;
 }
 
+Spark_Connection_Stats_TypeDef Spark_Connection_Stats;
+
+// While corked, Spark_Send() collects messages to send them as one segment
+static unsigned char Send_Cork_Buffer[SPARK_SEND_CORK_LENGTH];
+static int Send_Cork_Length = -1;
+
+static int Spark_Send_Flush(void)
+{
+  int bytes_sent = 0;
+  if (Send_Cork_Length > 0)
+  {
+    Spark_Connection_Stats.sends++;
+    bytes_sent = send(sparkSocket, Send_Cork_Buffer, Send_Cork_Length, 0);
+    Send_Cork_Length = 0;
+  }
+  return bytes_sent;
+}
+
+static void Spark_Send_Cork(void)
+{
+  Send_Cork_Length = 0;
+}
+
+static int Spark_Send_Uncork(void)
+{
+  int bytes_sent = isSocketClosed() ? -1 : Spark_Send_Flush();
+  Send_Cork_Length = -1;
+  return bytes_sent;
+}
+
 // Returns number of bytes sent or -1 if an error occurred
 int Spark_Send(const unsigned char *buf, int buflen)
 {
@@ -557,22 +776,31 @@ int Spark_Send(const unsigned char *buf, int buflen)
     return -1;
   }
 
+  if (Send_Cork_Length >= 0 && buflen <= SPARK_SEND_CORK_LENGTH)
+  {
+    if (Send_Cork_Length + buflen > SPARK_SEND_CORK_LENGTH && 0 > Spark_Send_Flush())
+      return -1;
+
+    memcpy(Send_Cork_Buffer + Send_Cork_Length, buf, buflen);
+    Send_Cork_Length += buflen;
+    return buflen;
+  }
+
+  // keep the order of anything already collected
+  if (0 > Spark_Send_Flush())
+    return -1;
+
   // send returns negative numbers on error
+  Spark_Connection_Stats.sends++;
   int bytes_sent = send(sparkSocket, buf, buflen, 0);
 
   return bytes_sent;
 }
 
-// Returns number of bytes received or -1 if an error occurred
-int Spark_Receive(unsigned char *buf, int buflen)
+// Reads what the socket has, waiting at most 5ms.
+// Returns number of bytes received, 0 if there was no data or <0 if an error occurred
+static int Spark_Socket_Read(unsigned char *buf, int buflen)
 {
-  if(SPARK_WLAN_RESET || SPARK_WLAN_SLEEP || isSocketClosed())
-  {
-    //break from any blocking loop
-    DEBUG("SPARK_WLAN_RESET || SPARK_WLAN_SLEEP || isSocketClosed()");
-    return -1;
-  }
-
   timeval timeout;
   _types_fd_set_cc3000 readSet;
   int bytes_received = 0;
@@ -607,24 +835,124 @@ int Spark_Receive(unsigned char *buf, int buflen)
   return bytes_received;
 }
 
+ReceiveBuffer Spark_Receive_Buffer(Spark_Socket_Read);
+
+// Returns number of bytes received or -1 if an error occurred
+int Spark_Receive(unsigned char *buf, int buflen)
+{
+  if(SPARK_WLAN_RESET || SPARK_WLAN_SLEEP || isSocketClosed())
+  {
+    //break from any blocking loop
+    DEBUG("SPARK_WLAN_RESET || SPARK_WLAN_SLEEP || isSocketClosed()");
+    return -1;
+  }
+
+  return Spark_Receive_Buffer.receive(buf, buflen, millis());
+}
+
+void receiveBufferStats(Spark_Receive_Stats_TypeDef *stats)
+{
+  Spark_Receive_Buffer.stats(stats);
+}
+
+static uint32_t Firmware_Writer_Clock(void)
+{
+  return micros();
+}
+
+#ifdef SPARK_SFLASH_ENABLE
+ExternalFlashRegion OTA_Flash(EXTERNAL_FLASH_OTA_ADDRESS, EXTERNAL_FLASH_BLOCK_SIZE / sFLASH_PAGESIZE);
+#endif
+
+// Chunks are acknowledged once copied, and programmed from the
+// communication loop while the next one is on its way
+FirmwareWriter Firmware_Writer(FLASH_Update, Firmware_Writer_Clock);
+
+// An update may instead be a patch against the running image, which is
+// rebuilt into the OTA region as the patch arrives
+static bool Spark_Read_Running_Image(uint8_t *data, uint32_t offset, uint32_t length)
+{
+  if (offset + length > PATCH_SOURCE_LENGTH_MAX || offset + length < offset)
+    return false;
+  memcpy(data, (const uint8_t *)PATCH_SOURCE_ADDRESS + offset, length);
+  return true;
+}
+
+static bool Spark_Save_Decoded_Chunk(const uint8_t *data, size_t length)
+{
+  // whatever the decoder was told, nothing is written past the OTA region
+  if (length > EXTERNAL_FLASH_BLOCK_SIZE - Firmware_Writer.savedBytes())
+    return false;
+  Firmware_Writer.save(data, length);
+  return true;
+}
+
+PatchApplier Firmware_Patch(Spark_Read_Running_Image, Spark_Save_Decoded_Chunk);
+bool Firmware_Is_Patch;
+
+// Or a compressed image, inflated into the OTA region half a window at a time
+LzssDecoder Firmware_Lzss(Spark_Save_Decoded_Chunk);
+bool Firmware_Is_Compressed;
+
 void Spark_Prepare_For_Firmware_Update(void)
 {
   SPARK_FLASH_UPDATE = 1;
   TimingFlashUpdateTimeout = 0;
   FLASH_Begin(EXTERNAL_FLASH_OTA_ADDRESS);
+  Firmware_Writer.begin();
+  Firmware_Patch.begin();
+  Firmware_Is_Patch = false;
+  Firmware_Lzss.begin();
+  Firmware_Is_Compressed = false;
 }
 
 void Spark_Finish_Firmware_Update(void)
 {
-  SPARK_FLASH_UPDATE = 0;
+  LOOP_MONITOR_SCOPE(LOOP_SUBSYSTEM_OTA);
   TimingFlashUpdateTimeout = 0;
-  FLASH_End();
+  if (Firmware_Is_Patch && PATCH_DONE != Firmware_Patch.status())
+  {
+    DEBUG("firmware patch failed: %d", Firmware_Patch.status());
+  }
+  if (Firmware_Is_Compressed && LZSS_DONE != Firmware_Lzss.status())
+  {
+    DEBUG("firmware inflate failed: %d", Firmware_Lzss.status());
+  }
+  bool verified = Firmware_Writer.finish()
+      && (!Firmware_Is_Patch || PATCH_DONE == Firmware_Patch.status())
+      && (!Firmware_Is_Compressed || LZSS_DONE == Firmware_Lzss.status());
+#ifdef SPARK_SFLASH_ENABLE
+  verified = verified && Firmware_Writer.verify(OTA_Flash);
+#endif
+  SPARK_FLASH_UPDATE = 0;
+
+  // don't hand the bootloader an image that did not read back as written
+  if (verified)
+    FLASH_End();
 }
 
 uint16_t Spark_Save_Firmware_Chunk(unsigned char *buf, long unsigned int buflen)
 {
+  LOOP_MONITOR_SCOPE(LOOP_SUBSYSTEM_OTA);
   TimingFlashUpdateTimeout = 0;
-  return FLASH_Update(buf, buflen);
+  if (0 == Firmware_Writer.saved() && !Firmware_Is_Patch && !Firmware_Is_Compressed)
+  {
+    Firmware_Is_Patch = PatchApplier::isPatch(buf, buflen);
+    Firmware_Is_Compressed = LzssDecoder::isCompressed(buf, buflen);
+  }
+
+  if (Firmware_Is_Patch)
+    Firmware_Patch.apply(buf, buflen);
+  else if (Firmware_Is_Compressed)
+    Firmware_Lzss.inflate(buf, buflen);
+  else
+    Firmware_Writer.save(buf, buflen);
+  return Firmware_Writer.saved();
+}
+
+void firmwareWriteStats(Spark_Firmware_Write_Stats_TypeDef *stats)
+{
+  Firmware_Writer.stats(stats);
 }
 
 int numUserFunctions(void)
@@ -673,6 +1001,13 @@ SparkReturnType::Enum wrapVarTypeInEnum(const char *varKey)
   }
 }
 
+// The protocol checks each OTA chunk with this; the backend is chosen by
+// CRC32_BACKEND, the CRC peripheral by default
+static uint32_t Spark_Calculate_CRC(unsigned char *buf, uint32_t buflen)
+{
+  return crc32_compute(buf, buflen);
+}
+
 void Spark_Protocol_Init(void)
 {
   if (!spark_protocol.is_initialized())
@@ -682,7 +1017,7 @@ void Spark_Protocol_Init(void)
     callbacks.receive = Spark_Receive;
     callbacks.prepare_for_firmware_update = Spark_Prepare_For_Firmware_Update;
     callbacks.finish_firmware_update = Spark_Finish_Firmware_Update;
-    callbacks.calculate_crc = Compute_CRC32;
+    callbacks.calculate_crc = Spark_Calculate_CRC;
     callbacks.save_firmware_chunk = Spark_Save_Firmware_Chunk;
     callbacks.signal = Spark_Signal;
     callbacks.millis = millis;
@@ -713,36 +1048,159 @@ void Spark_Protocol_Init(void)
   }
 }
 
+Spark_Handshake_Stats_TypeDef Spark_Handshake_Stats;
+
 int Spark_Handshake(void)
 {
+  LOOP_MONITOR_SCOPE(LOOP_SUBSYSTEM_HANDSHAKE);
+  // the keys are read from flash once, on the first handshake after reset
   Spark_Protocol_Init();
   spark_protocol.reset_updating();
+
+  system_tick_t start = millis();
   int err = spark_protocol.handshake();
+  system_tick_t elapsed = millis() - start;
+
+  Spark_Handshake_Stats.count++;
+  if (err)
+    Spark_Handshake_Stats.failed++;
+  Spark_Handshake_Stats.last_millis = elapsed;
+  Spark_Handshake_Stats.total_millis += elapsed;
+  if (elapsed > Spark_Handshake_Stats.max_millis)
+    Spark_Handshake_Stats.max_millis = elapsed;
 
   Multicast_Presence_Announcement();
-  spark_protocol.send_time_request();
 
-  unsigned char patchver[2];
-  nvmem_read_sp_version(patchver);
-  char patchstr[8];
-  snprintf(patchstr, 8, "%d.%d", patchver[0], patchver[1]);
+  // the patch version can't change without a reset, read it once
+  static char patchstr[8];
+  if (!patchstr[0])
+  {
+    unsigned char patchver[2];
+    nvmem_read_sp_version(patchver);
+    snprintf(patchstr, 8, "%d.%d", patchver[0], patchver[1]);
+  }
+
+  // send the time request, the patch version and any queued events together;
+  // the events wait for the next handshake if this one failed
+  Spark_Send_Cork();
+  spark_protocol.send_time_request();
   Spark.publish("spark/cc3000-patch-version", patchstr, 60, PRIVATE);
+  if (!err)
+    Publish_Queue.drain(millis());
+  Spark_Send_Uncork();
+
+  if (!err)
+    Spark_Connection_Stats.ready_millis = millis() - Spark_Connection_Stats.connect_start;
 
   return err;
 }
 
+#ifdef SPARK_SFLASH_ENABLE
+// Moves one stored event to the publish queue once the handshake is done.
+// Live events go first: replay waits for the queue to empty. The event
+// stays in the log until the queue has sent it.
+static void Offline_Log_Replay(void)
+{
+  if (!Offline_Log_Enabled || !SPARK_CLOUD_CONNECTED || Publish_Queue.pending())
+    return;
+
+  if ((millis() - Offline_Replay_Time) < OFFLINE_REPLAY_INTERVAL_MILLIS)
+    return;
+
+  if (Offline_Log.replay(Publish_Queue))
+    Offline_Replay_Time = millis();
+}
+#endif
+
 // Returns true if all's well or
 //         false on error, meaning we're probably disconnected
 bool Spark_Communication_Loop(void)
 {
-  return spark_protocol.event_loop();
+  PROFILE_SCOPE(PROBE_COMMUNICATION_LOOP);
+  LOOP_MONITOR_SCOPE(LOOP_SUBSYSTEM_CLOUD);
+  if (!spark_protocol.event_loop())
+    return false;
+
+  // program the chunk just acknowledged while the next one is sent
+  if (Firmware_Writer.pending())
+  {
+    LOOP_MONITOR_SCOPE(LOOP_SUBSYSTEM_OTA);
+    Firmware_Writer.service();
+    TimingFlashUpdateTimeout = 0;
+  }
+
+  // hold back events while an OTA update is streaming in
+  if (!SPARK_FLASH_UPDATE)
+  {
+#ifdef SPARK_SFLASH_ENABLE
+    Offline_Log_Replay();
+#endif
+    Publish_Queue.drain(millis());
+  }
+
+  return true;
+}
+
+// Whether SPARK_WLAN_Loop() has more to do than wait on the CC3000
+static bool Spark_Service_Busy(void)
+{
+  Spark_Connection_State_TypeDef state = Spark_Connection_State.state();
+  return SPARK_FLASH_UPDATE
+      || Firmware_Writer.pending()
+      || Publish_Queue.pending()
+      || Spark_Receive_Buffer.available() > 0
+      || state == CONNECTION_CLOUD_CONNECTING
+      || state == CONNECTION_CLOUD_HANDSHAKE;
+}
+
+ServiceBudget Spark_Service_Budget(SPARK_WLAN_Loop, Spark_Service_Busy, millis);
+
+void handshakeStats(Spark_Handshake_Stats_TypeDef *stats)
+{
+  *stats = Spark_Handshake_Stats;
+}
+
+void connectionStats(Spark_Connection_Stats_TypeDef *stats)
+{
+  *stats = Spark_Connection_Stats;
+}
+
+void connectionStateStats(Spark_Connection_State_Stats_TypeDef *stats)
+{
+  Spark_Connection_State.stats(stats);
+}
+
+void serviceStats(Spark_Service_Stats_TypeDef *stats)
+{
+  Spark_Service_Budget.stats(stats);
+}
+
+void publishQueueStats(Spark_Publish_Stats_TypeDef *stats)
+{
+  Publish_Queue.stats(stats);
+}
+
+void offlineLogStats(Spark_Offline_Log_Stats_TypeDef *stats)
+{
+#ifdef SPARK_SFLASH_ENABLE
+  Offline_Log.stats(stats);
+#else
+  memset(stats, 0, sizeof(*stats));
+#endif
 }
 
+// Kept open between announcements, opening a socket costs a CC3000 round trip
+static long Presence_Socket = INVALID_SOCKET;
+
 void Multicast_Presence_Announcement(void)
 {
-  long multicast_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-  if (0 > multicast_socket)
-    return;
+  if (0 > Presence_Socket)
+  {
+    Presence_Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (0 > Presence_Socket)
+      return;
+    Spark_Connection_Stats.socket_opens++;
+  }
 
   unsigned char announcement[19];
   spark_protocol.presence_announcement(announcement, (const char *)ID1);
@@ -760,33 +1218,27 @@ void Multicast_Presence_Announcement(void)
   //why loop here? Uncommenting this leads to SOS(HardFault Exception) on local cloud
   //for (int i = 3; i > 0; i--)
   {
-    sendto(multicast_socket, announcement, 19, 0, &addr, sizeof(sockaddr));
+    Spark_Connection_Stats.sends++;
+    if (0 > sendto(Presence_Socket, announcement, 19, 0, &addr, sizeof(sockaddr)))
+    {
+      // open a new socket next time
+      Multicast_Presence_Release(true);
+    }
   }
-
-  closesocket(multicast_socket);
 }
 
-/* This function MUST NOT BlOCK!
- * It will be executed every 1ms if LED_Signaling_Start() is called
- * and stopped as soon as LED_Signaling_Stop() is called */
-void LED_Signaling_Override(void)
+// Forgets the presence socket. It is only closed when the CC3000 is still
+// running, a reset of the CC3000 frees all its sockets anyway.
+void Multicast_Presence_Release(bool close)
 {
-  if (0 < LED_Signaling_Timing)
+  if (0 <= Presence_Socket)
   {
-    --LED_Signaling_Timing;
-  }
-  else
-  {
-    LED_SetSignalingColor(VIBGYOR_Colors[VIBGYOR_Index]);
-    LED_On(LED_RGB);
-
-    LED_Signaling_Timing = 100;	// 100 ms
-
-    ++VIBGYOR_Index;
-    if(VIBGYOR_Index >= VIBGYOR_Size)
+    if (close)
     {
-      VIBGYOR_Index = 0;
+      closesocket(Presence_Socket);
+      Spark_Connection_Stats.socket_closes++;
     }
+    Presence_Socket = INVALID_SOCKET;
   }
 }
 
@@ -812,6 +1264,7 @@ int Internet_Test(void)
     DEBUG("socket");
     testSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     DEBUG("socketed testSocket=%d",testSocket);
+    Spark_Connection_Stats.socket_opens++;
 
 
     if (testSocket < 0)
@@ -847,15 +1300,90 @@ int Internet_Test(void)
 
     DEBUG("Close");
     int rv = closesocket(testSocket);
+    Spark_Connection_Stats.socket_closes++;
     DEBUG("Closed rv=%d",rv);
 
     //if connection fails, testResult returns -1
     return testResult;
 }
 
-// Same return value as connect(), -1 on error
-int Spark_Connect(void)
+// Steps of the cloud connection, one is taken per call to Spark_Connect_Step()
+typedef enum
+{
+  CONNECT_START, CONNECT_RESOLVE, CONNECT_OPEN
+} Connect_State_TypeDef;
+
+static Connect_State_TypeDef Connect_State = CONNECT_START;
+static ServerAddress Connect_Server_Address;
+static uint32_t Connect_Server_IP;
+static int Connect_DNS_Attempts;
+
+// the last address the server name resolved to
+static uint32_t Cached_Server_IP;
+static system_tick_t Cached_Server_IP_Time;
+
+// Takes the next step towards a connected cloud socket: reading the server
+// address, one DNS lookup, then opening the socket. Each step makes at most
+// one blocking CC3000 call, so the main loop keeps running in between.
+// Returns SPARK_CONNECT_IN_PROGRESS until the last step, then the same
+// value as connect(), -1 on error
+int Spark_Connect_Step(void)
 {
+  LOOP_MONITOR_SCOPE(LOOP_SUBSYSTEM_CONNECT);
+  switch (Connect_State)
+  {
+    case CONNECT_START:
+      Spark_Connection_Stats.connect_start = millis();
+      FLASH_Read_ServerAddress(&Connect_Server_Address);
+      Connect_Server_IP = 0;
+      Connect_DNS_Attempts = 0;
+
+      switch (Connect_Server_Address.addr_type)
+      {
+        case IP_ADDRESS:
+          Connect_Server_IP = Connect_Server_Address.ip;
+          break;
+
+        default:
+        case INVALID_INTERNET_ADDRESS:
+        {
+          const char default_domain[] = "device.spark.io";
+          // Make sure we copy the NULL terminator, so subsequent strlen() calls on server_addr.domain return the correct length
+          memcpy(Connect_Server_Address.domain, default_domain, strlen(default_domain) + 1);
+          // and fall through to domain name case
+        }
+
+        case DOMAIN_NAME:
+          if (Cached_Server_IP && (millis() - Cached_Server_IP_Time) < SPARK_DNS_CACHE_MILLIS)
+          {
+            Connect_Server_IP = Cached_Server_IP;
+          }
+      }
+
+      Connect_State = Connect_Server_IP ? CONNECT_OPEN : CONNECT_RESOLVE;
+      return SPARK_CONNECT_IN_PROGRESS;
+
+    case CONNECT_RESOLVE:
+      // CC3000 unreliability workaround, usually takes 2 or 3 attempts
+      gethostbyname(Connect_Server_Address.domain, strnlen(Connect_Server_Address.domain, 126), &Connect_Server_IP);
+      if (Connect_Server_IP)
+      {
+        Cached_Server_IP = Connect_Server_IP;
+        Cached_Server_IP_Time = millis();
+        Connect_State = CONNECT_OPEN;
+      }
+      else if (++Connect_DNS_Attempts >= SPARK_DNS_ATTEMPTS)
+      {
+        // final fallback
+        Connect_Server_IP = (54 << 24) | (208 << 16) | (229 << 8) | 4;
+        Connect_State = CONNECT_OPEN;
+      }
+      return SPARK_CONNECT_IN_PROGRESS;
+
+    case CONNECT_OPEN:
+      break;
+  }
+
   DEBUG("sparkSocket Now =%d",sparkSocket);
 
   // Close Original
@@ -864,6 +1392,7 @@ int Spark_Connect(void)
 
   sparkSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
   DEBUG("socketed sparkSocket=%d",sparkSocket);
+  Spark_Connection_Stats.socket_opens++;
 
   if (sparkSocket < 0)
   {
@@ -877,52 +1406,30 @@ int Spark_Connect(void)
   tSocketAddr.sa_data[0] = (SPARK_SERVER_PORT & 0xFF00) >> 8;
   tSocketAddr.sa_data[1] = (SPARK_SERVER_PORT & 0x00FF);
 
-  ServerAddress server_addr;
-  FLASH_Read_ServerAddress(&server_addr);
-
-  uint32_t ip_addr = 0;
-
-  switch (server_addr.addr_type)
-  {
-    case IP_ADDRESS:
-      ip_addr = server_addr.ip;
-      break;
-
-    default:
-    case INVALID_INTERNET_ADDRESS:
-    {
-      const char default_domain[] = "device.spark.io";
-      // Make sure we copy the NULL terminator, so subsequent strlen() calls on server_addr.domain return the correct length
-      memcpy(server_addr.domain, default_domain, strlen(default_domain) + 1);
-      // and fall through to domain name case
-    }
-
-    case DOMAIN_NAME:
-      // CC3000 unreliability workaround, usually takes 2 or 3 attempts
-      int attempts = 10;
-      while (!ip_addr && 0 < --attempts)
-      {
-        gethostbyname(server_addr.domain, strnlen(server_addr.domain, 126), &ip_addr);
-        Delay(1);
-      }
-  }
-
-  if (!ip_addr)
-  {
-    // final fallback
-    ip_addr = (54 << 24) | (208 << 16) | (229 << 8) | 4;
-  }
-
-  tSocketAddr.sa_data[2] = BYTE_N(ip_addr, 3);
-  tSocketAddr.sa_data[3] = BYTE_N(ip_addr, 2);
-  tSocketAddr.sa_data[4] = BYTE_N(ip_addr, 1);
-  tSocketAddr.sa_data[5] = BYTE_N(ip_addr, 0);
+  tSocketAddr.sa_data[2] = BYTE_N(Connect_Server_IP, 3);
+  tSocketAddr.sa_data[3] = BYTE_N(Connect_Server_IP, 2);
+  tSocketAddr.sa_data[4] = BYTE_N(Connect_Server_IP, 1);
+  tSocketAddr.sa_data[5] = BYTE_N(Connect_Server_IP, 0);
 
   uint32_t ot = SPARK_WLAN_SetNetWatchDog(S2M(MAX_SEC_WAIT_CONNECT));
   DEBUG("connect");
   int rv = connect(sparkSocket, &tSocketAddr, sizeof(tSocketAddr));
   DEBUG("connected connect=%d",rv);
   SPARK_WLAN_SetNetWatchDog(ot);
+
+  if (rv < 0)
+  {
+    // the server may have moved, look it up again next time
+    Cached_Server_IP = 0;
+  }
+  return rv;
+}
+
+// Same return value as connect(), -1 on error
+int Spark_Connect(void)
+{
+  int rv;
+  while (SPARK_CONNECT_IN_PROGRESS == (rv = Spark_Connect_Step()));
   return rv;
 }
 
@@ -940,9 +1447,12 @@ int Spark_Disconnect(void)
 #endif
       DEBUG("Close");
       retVal = closesocket(sparkSocket);
+      Spark_Connection_Stats.socket_closes++;
       DEBUG("Closed retVal=%d", retVal);
       sparkSocket = INVALID_SOCKET;
   }
+  Spark_Receive_Buffer.clear();
+  Connect_State = CONNECT_START;
   return retVal;
 }
 
@@ -958,48 +1468,106 @@ void Spark_ConnectAbort_WLANReset(void)
 
 int userVarType(const char *varKey)
 {
-	for (int i = 0; i < User_Var_Count; ++i)
+	int i = User_Var_Index.find(varKey);
+	if (i >= 0)
 	{
-		if (0 == strncmp(User_Var_Lookup_Table[i].userVarKey, varKey, USER_VAR_KEY_LENGTH))
-		{
-			return User_Var_Lookup_Table[i].userVarType;
-		}
+		return User_Var_Lookup_Table[i].userVarType;
 	}
 	return -1;
 }
 
 void *getUserVar(const char *varKey)
 {
-	for (int i = 0; i < User_Var_Count; ++i)
+	int i = User_Var_Index.find(varKey);
+	if (i >= 0)
 	{
-		if (0 == strncmp(User_Var_Lookup_Table[i].userVarKey, varKey, USER_VAR_KEY_LENGTH))
-		{
-			return User_Var_Lookup_Table[i].userVar;
-		}
+		return User_Var_Lookup_Table[i].userVar;
 	}
 	return NULL;
 }
 
 int userFuncSchedule(const char *funcKey, const char *paramString)
 {
-	String pString(paramString);
-	int i = 0;
-	for(i = 0; i < User_Func_Count; i++)
+	int i = User_Func_Index.find(funcKey);
+	if(i >= 0 && NULL != paramString)
 	{
-		if(NULL != paramString && (0 == strncmp(User_Func_Lookup_Table[i].userFuncKey, funcKey, USER_FUNC_KEY_LENGTH)))
-		{
-			size_t paramLength = strlen(paramString);
-			if(paramLength > USER_FUNC_ARG_LENGTH)
-				paramLength = USER_FUNC_ARG_LENGTH;
-			memcpy(User_Func_Lookup_Table[i].userFuncArg, paramString, paramLength);
-			User_Func_Lookup_Table[i].userFuncSchedule = true;
-			//return User_Func_Lookup_Table[i].pUserFunc(User_Func_Lookup_Table[i].userFuncArg);
-			return User_Func_Lookup_Table[i].pUserFunc(pString);
-		}
+		// the String is only built for a function that will run now
+		if(CALL_IMMEDIATE == User_Func_Lookup_Table[i].userFuncCallType)
+			return User_Func_Lookup_Table[i].pUserFunc(String(paramString));
+
+		return User_Func_Queue.add(i, paramString) ? 0 : -1;
 	}
 	return -1;
 }
 
+// Runs a deferred function call and publishes its result
+static void userFuncRun(int i, const char *arg)
+{
+	int result = User_Func_Lookup_Table[i].pUserFunc(String(arg));
+
+	if(Spark.connected())
+	{
+		char eventName[sizeof("spark/function/") + USER_FUNC_KEY_LENGTH];
+		char eventData[12];
+		snprintf(eventName, sizeof(eventName), "spark/function/%.*s",
+				USER_FUNC_KEY_LENGTH, User_Func_Lookup_Table[i].userFuncKey);
+		snprintf(eventData, sizeof(eventData), "%d", result);
+		Spark.publish(eventName, eventData, 60, PRIVATE);
+	}
+}
+
+// Runs the oldest deferred function call. Only one call runs per pass of
+// the main loop so that cloud messages are still serviced between slow
+// functions.
+void userFuncProcess(void)
+{
+	User_Func_Queue.process();
+}
+
+void userFuncQueueStats(Spark_Function_Queue_Stats_TypeDef *stats)
+{
+	User_Func_Queue.stats(stats);
+}
+
+// Pushes the tracked variables that changed beyond their deadband.
+// Nothing is compared while earlier events wait to be sent, the changes
+// then go out together once the queue is empty.
+void userVarProcess(void)
+{
+	if(0 == User_Var_Tracker.count() || !SPARK_CLOUD_CONNECTED || Publish_Queue.pending())
+		return;
+
+	User_Var_Tracker.process();
+}
+
+void variablePushStats(Spark_Variable_Push_Stats_TypeDef *stats)
+{
+	User_Var_Tracker.stats(stats);
+}
+
+// Runs the timers that are due and the tasks posted since the last call
+void userTimerProcess(void)
+{
+	Spark_Scheduler.run();
+}
+
+void schedulerStats(Spark_Scheduler_Stats_TypeDef *stats)
+{
+	Spark_Scheduler.stats(stats);
+}
+
+// The loop timing as a binary blob, for Serial.write()
+size_t loopMonitorSerialize(uint8_t *buffer, size_t size)
+{
+	return Loop_Monitor.serialize(buffer, size);
+}
+
+// The same blob as hex, for a Spark.variable STRING
+size_t loopMonitorReport(char *buffer, size_t size)
+{
+	return Loop_Monitor.report(buffer, size);
+}
+
 long socket_connect(long sd, const sockaddr *addr, long addrlen)
 {
 	return connect(sd, addr, addrlen);
@@ -0,0 +1,214 @@
+/**
+ ******************************************************************************
+ * @file    spark_variable_tracker.cpp
+ * @author  Spark Firmware Team
+ * @version V1.0.0
+ * @date    17-October-2026
+ * @brief   Change tracking for cloud variables, pushing the values that moved
+ *          beyond a deadband as batched events.
+ ******************************************************************************
+  Copyright (c) 2014 Spark Labs, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "spark_variable_tracker.h"
+#include <stdio.h>
+#include <string.h>
+
+VariableTracker::VariableTracker(Sender sender) : sender(sender), entryCount(0), next(0)
+{
+	memset(&counters, 0, sizeof(counters));
+}
+
+bool VariableTracker::track(const char *key, const void *variable, Spark_Data_TypeDef type, double deadband)
+{
+	if (entryCount == VARIABLE_TRACKER_MAX_COUNT || NULL == key || NULL == variable)
+		return false;
+
+	Entry &entry = entries[entryCount++];
+	entry.key = key;
+	entry.variable = variable;
+	entry.type = type;
+	entry.deadband = deadband < 0 ? -deadband : deadband;
+	entry.hasSent = false;
+	entry.inBatch = false;
+	return true;
+}
+
+VariableTracker::Value VariableTracker::read(const Entry &entry) const
+{
+	Value value;
+	memset(&value, 0, sizeof(value));
+	switch (entry.type)
+	{
+		case BOOLEAN:
+			value.b = *(const bool *)entry.variable;
+			break;
+
+		case DOUBLE:
+			value.d = *(const double *)entry.variable;
+			break;
+
+		case STRING:
+		{
+			// FNV-1a over what fits in an event
+			const char *s = (const char *)entry.variable;
+			value.hash = 2166136261u;
+			for (int i = 0; i < VARIABLE_TRACKER_DATA_LENGTH && s[i]; i++)
+			{
+				value.hash ^= uint8_t(s[i]);
+				value.hash *= 16777619u;
+			}
+			break;
+		}
+
+		case INT:
+		default:
+			value.i = *(const int32_t *)entry.variable;
+			break;
+	}
+	return value;
+}
+
+bool VariableTracker::changed(const Entry &entry, const Value &value)
+{
+	if (!entry.hasSent)
+		return true;
+
+	double delta;
+	switch (entry.type)
+	{
+		case BOOLEAN:
+			return value.b != entry.sent.b;
+
+		case STRING:
+			return value.hash != entry.sent.hash;
+
+		case DOUBLE:
+			// NaN compares unequal to everything, only send it once
+			if (value.d != value.d)
+				return entry.sent.d == entry.sent.d;
+			if (value.d == entry.sent.d)
+				return false;
+			delta = value.d - entry.sent.d;
+			break;
+
+		case INT:
+		default:
+			if (value.i == entry.sent.i)
+				return false;
+			delta = double(value.i) - double(entry.sent.i);
+			break;
+	}
+
+	if (delta < 0)
+		delta = -delta;
+	if (delta > entry.deadband)
+		return true;
+	counters.suppressed++;
+	return false;
+}
+
+int VariableTracker::format(char *buffer, size_t size, const Entry &entry, const Value &value) const
+{
+	int keyLength = strnlen(entry.key, VARIABLE_TRACKER_KEY_LENGTH);
+	switch (entry.type)
+	{
+		case BOOLEAN:
+			return snprintf(buffer, size, "%.*s=%d", keyLength, entry.key, value.b ? 1 : 0);
+
+		case DOUBLE:
+			return snprintf(buffer, size, "%.*s=%g", keyLength, entry.key, value.d);
+
+		case STRING:
+			return snprintf(buffer, size, "%.*s=%s", keyLength, entry.key, (const char *)entry.variable);
+
+		case INT:
+		default:
+			return snprintf(buffer, size, "%.*s=%ld", keyLength, entry.key, (long)value.i);
+	}
+}
+
+int VariableTracker::process()
+{
+	char data[VARIABLE_TRACKER_DATA_LENGTH];
+	size_t length = 0;
+	int changes = 0;
+	int full = -1;
+
+	for (int n = 0; n < entryCount; n++)
+	{
+		int index = (next + n) % entryCount;
+		Entry &entry = entries[index];
+		Value value = read(entry);
+		counters.samples++;
+		if (!changed(entry, value))
+			continue;
+
+		// a pair longer than an event is truncated when it's the only one
+		char pair[VARIABLE_TRACKER_DATA_LENGTH];
+		int pairLength = format(pair, sizeof(pair), entry, value);
+		if (pairLength >= int(sizeof(pair)))
+			pairLength = sizeof(pair) - 1;
+		if (length && length + 1 + pairLength >= sizeof(data))
+		{
+			full = index;
+			break;
+		}
+
+		if (length)
+			data[length++] = '&';
+		memcpy(data + length, pair, pairLength);
+		length += pairLength;
+		data[length] = '\0';
+
+		entry.current = value;
+		entry.inBatch = true;
+		changes++;
+	}
+
+	if (!changes)
+		return 0;
+
+	bool sent = sender(data, length);
+	for (int i = 0; i < entryCount; i++)
+	{
+		Entry &entry = entries[i];
+		if (entry.inBatch && sent)
+		{
+			entry.sent = entry.current;
+			entry.hasSent = true;
+		}
+		entry.inBatch = false;
+	}
+
+	if (!sent)
+	{
+		counters.refused++;
+		return 0;
+	}
+
+	if (full >= 0)
+		next = full;
+	counters.batches++;
+	counters.changes += changes;
+	return changes;
+}
+
+void VariableTracker::stats(Spark_Variable_Push_Stats_TypeDef *stats) const
+{
+	*stats = counters;
+}
@@ -28,6 +28,7 @@
 #include "spark_wiring_usartserial.h"
 #include "spark_wiring_spi.h"
 #include "spark_wiring_i2c.h"
+#include "spark_loop_monitor.h"
 
 /*
  * Globals
@@ -626,10 +627,7 @@ unsigned long micros(void)
  */
 void delay(unsigned long ms)
 {
-#ifdef SPARK_WLAN_ENABLE
-	volatile system_tick_t spark_loop_elapsed_millis = SPARK_LOOP_DELAY_MILLIS;
-	spark_loop_total_millis += ms;
-#endif
+	LOOP_MONITOR_SCOPE(LOOP_SUBSYSTEM_DELAY);
 
 	volatile system_tick_t last_millis = GetSystem1MsTick();
 
@@ -652,20 +650,11 @@ void delay(unsigned long ms)
 		}
 
 #ifdef SPARK_WLAN_ENABLE
-		if (!SPARK_WLAN_SETUP || SPARK_WLAN_SLEEP)
-		{
-			//Do not yield for SPARK_WLAN_Loop()
-		}
-		else if ((elapsed_millis >= spark_loop_elapsed_millis) || (spark_loop_total_millis >= SPARK_LOOP_DELAY_MILLIS))
+		if (SPARK_WLAN_SETUP && !SPARK_WLAN_SLEEP)
 		{
-			spark_loop_elapsed_millis = elapsed_millis + SPARK_LOOP_DELAY_MILLIS;
-			//spark_loop_total_millis is reset to 0 in SPARK_WLAN_Loop()
-			do
-			{
-				//Run once if the above condition passes
-				SPARK_WLAN_Loop();
-			}
-			while (SPARK_FLASH_UPDATE);//loop during OTA update
+			//Service the cloud in slices that end by the deadline, more
+			//often while it has work pending, an OTA update say
+			Spark_Service_Budget.poll(last_millis + ms);
 		}
 #endif
 	}
@@ -113,23 +113,26 @@ size_t TCPClient::write(const uint8_t *buffer, size_t size)
 
 int TCPClient::bufferCount()
 {
-  return _total - _offset;
+  return _buffer.available();
 }
 
 int TCPClient::available() 
 {
     int avail = 0;
 
-    // At EOB => Flush it
-    if (_total && (_offset == _total))
+    // At EOB => Flush it, so the next recv() gets the whole buffer
+    if (_buffer.empty())
     {
       flush();
     }
 
     if(WiFi.ready() && isOpen(_sock))
     {
+        uint8_t *room;
+        size_t roomSize = _buffer.writeSpan(&room);
+
         // Have room
-        if ( _total < arraySize(_buffer))
+        if (roomSize)
         {
           _types_fd_set_cc3000 readSet;
           timeval timeout;
@@ -144,12 +147,11 @@ int TCPClient::available()
           {
               if (FD_ISSET(_sock, &readSet))
               {
-                  int ret = recv(_sock, _buffer + _total , arraySize(_buffer)-_total, 0);
+                  int ret = recv(_sock, room, roomSize, 0);
                   DEBUG("recv(=%d)",ret);
                   if (ret > 0)
                   {
-                      if (_total == 0) _offset = 0;
-                      _total += ret;
+                      _buffer.commit(ret);
                   }
               }
           } // Select
@@ -161,8 +163,8 @@ int TCPClient::available()
 
 int TCPClient::read() 
 {
-
-  return (bufferCount() || available()) ? _buffer[_offset++] : -1;
+  uint8_t b;
+  return ((bufferCount() || available()) && _buffer.pop(b)) ? b : -1;
 }
 
 int TCPClient::read(uint8_t *buffer, size_t size)
@@ -170,22 +172,20 @@ int TCPClient::read(uint8_t *buffer, size_t size)
         int read = -1;
         if (bufferCount() || available())
         {
-          read = (size > (size_t) bufferCount()) ? bufferCount() : size;
-          memcpy(buffer, &_buffer[_offset], read);
-          _offset += read;
+          read = _buffer.pop(buffer, size);
         }
         return read;
 }
 
 int TCPClient::peek() 
 {
-  return  (bufferCount() || available()) ? _buffer[_offset] : -1;
+  uint8_t b;
+  return  ((bufferCount() || available()) && _buffer.peek(b)) ? b : -1;
 }
 
 void TCPClient::flush() 
 {
-  _offset = 0;
-  _total = 0;
+  _buffer.reset();
 }
 
 void TCPClient::stop() 
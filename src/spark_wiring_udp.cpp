@@ -75,7 +75,7 @@ uint8_t UDP::begin(uint16_t port)
 
 int UDP::available() 
 {
-    return _total - _offset;
+    return _buffer.available();
 
 }
 
@@ -163,7 +163,12 @@ int UDP::parsePacket()
               if (FD_ISSET(_sock, &readSet))
               {
 
-                      int ret = recvfrom(_sock, _buffer, arraySize(_buffer), 0, &_remoteSockAddr, &_remoteSockAddrLen);
+                      // the packet is read whole, from the start of the buffer
+                      uint8_t *packet;
+                      _buffer.reset();
+                      size_t packetSize = _buffer.writeSpan(&packet);
+
+                      int ret = recvfrom(_sock, packet, packetSize, 0, &_remoteSockAddr, &_remoteSockAddrLen);
 
                       if (ret > 0)
                       {
@@ -174,8 +179,7 @@ int UDP::parsePacket()
                               _remoteIP._address[2] = _remoteSockAddr.sa_data[4];
                               _remoteIP._address[3] = _remoteSockAddr.sa_data[5];
 
-                              _offset = 0;
-                              _total = ret;
+                              _buffer.commit(ret);
                       }
               }
       }
@@ -185,7 +189,8 @@ int UDP::parsePacket()
 
 int UDP::read()
 {
-  return available() ? _buffer[_offset++] : -1;
+  uint8_t b;
+  return _buffer.pop(b) ? b : -1;
 }
 
 int UDP::read(unsigned char* buffer, size_t len)
@@ -193,21 +198,19 @@ int UDP::read(unsigned char* buffer, size_t len)
         int read = -1;
         if (available())
 	{
-          read = (len > (size_t) available()) ? available() : len;
-          memcpy(buffer, &_buffer[_offset], read);
-          _offset += read;
+          read = _buffer.pop(buffer, len);
 	}
 	return read;
 }
 
 int UDP::peek()
 {
-     return available() ? _buffer[_offset] : -1;
+     uint8_t b;
+     return _buffer.peek(b) ? b : -1;
 }
 
 void UDP::flush()
 {
-  _offset = 0;
-  _total = 0;
+  _buffer.reset();
 
 }
@@ -39,24 +39,26 @@ STM32_USART_Info USART_MAP[TOTAL_USARTS] =
    * TX pin
    * RX pin
    * GPIO Remap (RCC_APB2Periph_USART2 or GPIO_Remap_None )
+   * TX and RX DMA channels, their interrupt numbers and flags (NULL if none)
    * <tx_buffer pointer> used internally and does not appear below
    * <rx_buffer pointer> used internally and does not appear below
+   * <stats pointer> used internally and does not appear below
+   * <DMA state> used internally and does not appear below
+   *
+   * USART2's DMA channels are also those of Wire's DMA mode, and USART1's
+   * are taken by the CC3000's SPI.
    */
-  { USART2, &RCC->APB1ENR, RCC_APB1Periph_USART2, USART2_IRQn, TX, RX, GPIO_Remap_None },
-  { USART1, &RCC->APB2ENR, RCC_APB2Periph_USART1, USART1_IRQn, D1, D0, GPIO_Remap_USART1 }
+  { USART2, &RCC->APB1ENR, RCC_APB1Periph_USART2, USART2_IRQn, TX, RX, GPIO_Remap_None,
+    DMA1_Channel7, DMA1_Channel6, DMA1_Channel7_IRQn, DMA1_Channel6_IRQn, DMA1_FLAG_TC7, DMA1_FLAG_GL7, DMA1_FLAG_GL6 },
+  { USART1, &RCC->APB2ENR, RCC_APB2Periph_USART1, USART1_IRQn, D1, D0, GPIO_Remap_USART1,
+    NULL, NULL, USART1_IRQn, USART1_IRQn, 0, 0, 0 }
 };
 
+#define USART_FLAG_ERRORS (USART_FLAG_ORE | USART_FLAG_NE | USART_FLAG_FE | USART_FLAG_PE)
 
-inline void store_char(unsigned char c, Ring_Buffer *buffer)
-{
-        unsigned i = (unsigned int)(buffer->head + 1) % SERIAL_BUFFER_SIZE;
+static void USART_DMA_Transmit(STM32_USART_Info *usartMap);
+static void USART_DMA_Poll(STM32_USART_Info *usartMap);
 
-	if (i != buffer->tail)
-	{
-		buffer->buffer[buffer->head] = c;
-		buffer->head = i;
-	}
-}
 
 // Initialize Class Variables //////////////////////////////////////////////////
 USART_InitTypeDef USARTSerial::USART_InitStructure;
@@ -70,11 +72,15 @@ USARTSerial::USARTSerial(STM32_USART_Info *usartMapPtr)
 
         usartMap->usart_rx_buffer = &_rx_buffer;
         usartMap->usart_tx_buffer = &_tx_buffer;
+        usartMap->usart_stats = &_stats;
+        usartMap->usart_dma_enabled = false;
 
-        memset(&_rx_buffer, 0, sizeof(Ring_Buffer));
-        memset(&_tx_buffer, 0, sizeof(Ring_Buffer));
+        _rx_buffer.reset();
+        _tx_buffer.reset();
+        memset(&_stats, 0, sizeof(_stats));
 
         transmitting = false;
+        enableDMA = false;
 }
 
 // Public Methods //////////////////////////////////////////////////////////////
@@ -124,9 +130,68 @@ void USARTSerial::begin(unsigned long baud)
 	// Configure USART
 	USART_Init(usartMap->usart_peripheral, &USART_InitStructure);
 
-	// Enable USART Receive and Transmit interrupts
-	USART_ITConfig(usartMap->usart_peripheral, USART_IT_RXNE, ENABLE);
-	USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, ENABLE);
+	usartMap->usart_rx_buffer = &_rx_buffer;
+	usartMap->usart_tx_buffer = &_tx_buffer;
+	usartMap->usart_dma_enabled = enableDMA && usartMap->usart_rx_dma != NULL;
+
+	if (usartMap->usart_dma_enabled)
+	{
+		// The DMA writes received bytes round the whole ring, and they are
+		// published when the line goes idle or the DMA is half way round
+		unsigned char *ring;
+		_rx_buffer.reset();
+		_rx_buffer.writeSpan(&ring);
+		usartMap->usart_rx_dma_position = 0;
+		usartMap->usart_tx_dma_length = 0;
+
+		// Enable DMA1 clock
+		RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+		DMA_InitTypeDef DMA_InitStructure;
+		DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&usartMap->usart_peripheral->DR;
+		DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)ring;
+		DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+		DMA_InitStructure.DMA_BufferSize = SERIAL_BUFFER_SIZE;
+		DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+		DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+		DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+		DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+		DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+		DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+		DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+		DMA_DeInit(usartMap->usart_rx_dma);
+		DMA_Init(usartMap->usart_rx_dma, &DMA_InitStructure);
+		DMA_ITConfig(usartMap->usart_rx_dma, DMA_IT_HT | DMA_IT_TC, ENABLE);
+
+		// Bursts are sent from the transmit ring, a span at a time
+		DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+		DMA_InitStructure.DMA_BufferSize = 1;
+		DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+		DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+		DMA_DeInit(usartMap->usart_tx_dma);
+		DMA_Init(usartMap->usart_tx_dma, &DMA_InitStructure);
+		DMA_ITConfig(usartMap->usart_tx_dma, DMA_IT_TC, ENABLE);
+
+		// At the priority of the USART Interrupt, so that none of the three
+		// preempts another
+		NVIC_InitStructure.NVIC_IRQChannel = usartMap->usart_rx_dma_int_n;
+		NVIC_Init(&NVIC_InitStructure);
+		NVIC_InitStructure.NVIC_IRQChannel = usartMap->usart_tx_dma_int_n;
+		NVIC_Init(&NVIC_InitStructure);
+
+		DMA_Cmd(usartMap->usart_rx_dma, ENABLE);
+		USART_DMACmd(usartMap->usart_peripheral, USART_DMAReq_Rx | USART_DMAReq_Tx, ENABLE);
+
+		// Enable USART Idle line and Error interrupts only
+		USART_ITConfig(usartMap->usart_peripheral, USART_IT_IDLE, ENABLE);
+		USART_ITConfig(usartMap->usart_peripheral, USART_IT_ERR, ENABLE);
+	}
+	else
+	{
+		// Enable USART Receive and Transmit interrupts
+		USART_ITConfig(usartMap->usart_peripheral, USART_IT_RXNE, ENABLE);
+		USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, ENABLE);
+	}
 
 	// Enable the USART
 	USART_Cmd(usartMap->usart_peripheral, ENABLE);
@@ -144,11 +209,13 @@ void USARTSerial::begin(unsigned long baud, byte config)
 void USARTSerial::end()
 {
 	// wait for transmission of outgoing data
-	while (_tx_buffer.head != _tx_buffer.tail);
+	while (!_tx_buffer.empty());
 
 	// Disable USART Receive and Transmit interrupts
 	USART_ITConfig(usartMap->usart_peripheral, USART_IT_RXNE, DISABLE);
 	USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, DISABLE);
+	USART_ITConfig(usartMap->usart_peripheral, USART_IT_IDLE, DISABLE);
+	USART_ITConfig(usartMap->usart_peripheral, USART_IT_ERR, DISABLE);
 
 	// Disable the USART
 	USART_Cmd(usartMap->usart_peripheral, DISABLE);
@@ -161,8 +228,23 @@ void USARTSerial::end()
 
 	NVIC_Init(&NVIC_InitStructure);
 
+	if (usartMap->usart_dma_enabled)
+	{
+		USART_DMACmd(usartMap->usart_peripheral, USART_DMAReq_Rx | USART_DMAReq_Tx, DISABLE);
+		DMA_Cmd(usartMap->usart_rx_dma, DISABLE);
+		DMA_Cmd(usartMap->usart_tx_dma, DISABLE);
+
+		// Disable the DMA Interrupts
+		NVIC_InitStructure.NVIC_IRQChannel = usartMap->usart_rx_dma_int_n;
+		NVIC_Init(&NVIC_InitStructure);
+		NVIC_InitStructure.NVIC_IRQChannel = usartMap->usart_tx_dma_int_n;
+		NVIC_Init(&NVIC_InitStructure);
+
+		usartMap->usart_dma_enabled = false;
+	}
+
 	// clear any received data
-	_rx_buffer.head = _rx_buffer.tail;
+	_rx_buffer.clear();
 
         // null ring buffer pointers
         usartMap->usart_tx_buffer = NULL;
@@ -174,42 +256,49 @@ void USARTSerial::end()
 	USARTSerial_Enabled = false;
 }
 
-int USARTSerial::available(void)
+//enableDMAMode(true) should be called before begin() else default interrupt mode used.
+//Only Serial1 has DMA channels, shared with Wire's DMA mode, so not both.
+void USARTSerial::enableDMAMode(bool enableDMAMode)
 {
-	return (unsigned int)(SERIAL_BUFFER_SIZE + _rx_buffer.head - _rx_buffer.tail) % SERIAL_BUFFER_SIZE;
+	enableDMA = enableDMAMode;
 }
 
-int USARTSerial::peek(void)
+// In DMA mode the DMA keeps writing round the ring when it is full, over
+// bytes not yet read; those are dropped
+void USARTSerial::discardOverwritten(void)
 {
-	if (_rx_buffer.head == _rx_buffer.tail)
+	size_t held = _rx_buffer.available();
+	if (held > SERIAL_BUFFER_SIZE)
 	{
-		return -1;
-	}
-	else
-	{
-		return _rx_buffer.buffer[_rx_buffer.tail];
+		_stats.dropped += held - SERIAL_BUFFER_SIZE;
+		_rx_buffer.skip(held - SERIAL_BUFFER_SIZE);
 	}
 }
 
+int USARTSerial::available(void)
+{
+	discardOverwritten();
+	return _rx_buffer.available();
+}
+
+int USARTSerial::peek(void)
+{
+	unsigned char c;
+	discardOverwritten();
+	return _rx_buffer.peek(c) ? c : -1;
+}
+
 int USARTSerial::read(void)
 {
-	// if the head isn't ahead of the tail, we don't have any characters
-	if (_rx_buffer.head == _rx_buffer.tail)
-	{
-		return -1;
-	}
-	else
-	{
-		unsigned char c = _rx_buffer.buffer[_rx_buffer.tail];
-		_rx_buffer.tail = (unsigned int)(_rx_buffer.tail + 1) % SERIAL_BUFFER_SIZE;
-		return c;
-	}
+	unsigned char c;
+	discardOverwritten();
+	return _rx_buffer.pop(c) ? c : -1;
 }
 
 void USARTSerial::flush()
 {
 	// Loop until USART DR register is empty
-	while ( _tx_buffer.head != _tx_buffer.tail );
+	while (!_tx_buffer.empty());
 	// Loop until last frame transmission complete
 	while (transmitting && (USART_GetFlagStatus(usartMap->usart_peripheral, USART_FLAG_TC) == RESET));
 	transmitting = false;
@@ -217,21 +306,34 @@ void USARTSerial::flush()
 
 size_t USARTSerial::write(uint8_t c)
 {
+        if (usartMap->usart_dma_enabled)
+        {
+            // Wait for room, or with interrupts off for all to go out, moving
+            // the bursts on from here in case their interrupt can't run
+            while (_tx_buffer.full() || ((__get_PRIMASK() & 1) && !_tx_buffer.empty()))
+            {
+                USART_DMA_Poll(usartMap);
+            }
+
+            _tx_buffer.push(c);
+            USART_DMA_Poll(usartMap);
+            transmitting = true;
+
+            return 1;
+        }
 
         // interrupts are off and data in queue;
         if ((USART_GetITStatus(usartMap->usart_peripheral, USART_IT_TXE) == RESET)
-            && _tx_buffer.head != _tx_buffer.tail) {
+            && !_tx_buffer.empty()) {
             // Get him busy
             USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, ENABLE);
         }
 
-        unsigned i = (_tx_buffer.head + 1) % SERIAL_BUFFER_SIZE;
-
 	// If the output buffer is full, there's nothing for it other than to
         // wait for the interrupt handler to empty it a bit
         //         no space so       or  Called Off Panic with interrupt off get the message out!
         //         make space                     Enter Polled IO mode
-        while (i == _tx_buffer.tail || ((__get_PRIMASK() & 1) && _tx_buffer.head != _tx_buffer.tail) ) {
+        while (_tx_buffer.full() || ((__get_PRIMASK() & 1) && !_tx_buffer.empty()) ) {
             // Interrupts are on but they are not being serviced because this was called from a higher
             // Priority interrupt
 
@@ -240,15 +342,15 @@ size_t USARTSerial::write(uint8_t c)
                 // protect for good measure
                 USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, DISABLE);
                 // Write out a byte
-                USART_SendData(usartMap->usart_peripheral,  _tx_buffer.buffer[_tx_buffer.tail++]);
-                _tx_buffer.tail %= SERIAL_BUFFER_SIZE;
+                unsigned char out;
+                if (_tx_buffer.pop(out))
+                    USART_SendData(usartMap->usart_peripheral, out);
                 // unprotect
                 USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, ENABLE);
             }
         }
 
-        _tx_buffer.buffer[_tx_buffer.head] = c;
-        _tx_buffer.head = i;
+        _tx_buffer.push(c);
 	transmitting = true;
         USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, ENABLE);
 
@@ -260,30 +362,128 @@ USARTSerial::operator bool() {
 	return true;
 }
 
+void USARTSerial::stats(Spark_Serial_Stats_TypeDef *stats) const
+{
+	*stats = _stats;
+}
+
+// Publishes the bytes the DMA has written to the receive ring since last time
+static void USART_DMA_Receive(STM32_USART_Info *usartMap)
+{
+  // The count of bytes left goes down from the size of the ring, and is
+  // reloaded when it reaches 0
+  uint16_t position = (SERIAL_BUFFER_SIZE - DMA_GetCurrDataCounter(usartMap->usart_rx_dma)) & (SERIAL_BUFFER_SIZE - 1);
+  uint16_t received = (position - usartMap->usart_rx_dma_position) & (SERIAL_BUFFER_SIZE - 1);
+
+  usartMap->usart_rx_dma_position = position;
+  usartMap->usart_rx_buffer->commit(received);
+}
+
+// Starts a burst of the contiguous bytes at the tail of the transmit ring,
+// unless one is in flight
+static void USART_DMA_Transmit(STM32_USART_Info *usartMap)
+{
+  const unsigned char *span;
+  size_t length;
+
+  if (usartMap->usart_tx_dma_length || !(length = usartMap->usart_tx_buffer->peekSpan(&span)))
+  {
+    return;
+  }
+
+  DMA_Cmd(usartMap->usart_tx_dma, DISABLE);
+  usartMap->usart_tx_dma->CMAR = (uint32_t)span;
+  usartMap->usart_tx_dma->CNDTR = length;
+  usartMap->usart_tx_dma_length = length;
+  DMA_Cmd(usartMap->usart_tx_dma, ENABLE);
+}
+
+// The bytes of a burst stay in the ring until it completes
+static void USART_DMA_Transmit_Complete(STM32_USART_Info *usartMap)
+{
+  DMA_ClearFlag(usartMap->usart_tx_dma_flag_gl);
+  usartMap->usart_tx_buffer->skip(usartMap->usart_tx_dma_length);
+  usartMap->usart_tx_dma_length = 0;
+  USART_DMA_Transmit(usartMap);
+}
+
+// Moves transmission on from outside the DMA interrupt: completes a burst
+// whose interrupt has not run, or starts one
+static void USART_DMA_Poll(STM32_USART_Info *usartMap)
+{
+  NVIC_DisableIRQ(usartMap->usart_tx_dma_int_n);
+
+  if (DMA_GetFlagStatus(usartMap->usart_tx_dma_flag_tc) != RESET)
+  {
+    USART_DMA_Transmit_Complete(usartMap);
+  }
+  else
+  {
+    USART_DMA_Transmit(usartMap);
+  }
+
+  NVIC_EnableIRQ(usartMap->usart_tx_dma_int_n);
+}
+
 // Shared Interrupt Handler for USART2/Serial1 and USART1/Serial2
 // WARNING: This function MUST remain reentrance compliant -- no local static variables etc.
 static void USART_Interrupt_Handler(STM32_USART_Info *usartMap)
 {
+  uint16_t status = usartMap->usart_peripheral->SR;
+  Spark_Serial_Stats_TypeDef *stats = usartMap->usart_stats;
+
+  if (status & USART_FLAG_ERRORS)
+  {
+    if (status & USART_FLAG_ORE)
+      stats->overruns++;
+    if (status & USART_FLAG_FE)
+      stats->framing_errors++;
+    if (status & USART_FLAG_NE)
+      stats->noise_errors++;
+    if (status & USART_FLAG_PE)
+      stats->parity_errors++;
+  }
+
+  if (usartMap->usart_dma_enabled)
+  {
+    // The flags are cleared by reading the status then the data register.
+    // The DMA reads the data of a byte still waiting, otherwise read it here
+    if ((status & (USART_FLAG_IDLE | USART_FLAG_ERRORS)) && !(status & USART_FLAG_RXNE))
+    {
+      (void)USART_ReceiveData(usartMap->usart_peripheral);
+    }
+
+    if (status & USART_FLAG_IDLE)
+    {
+      stats->rx_interrupts++;
+      USART_DMA_Receive(usartMap);
+    }
+    return;
+  }
+
   if(USART_GetITStatus(usartMap->usart_peripheral, USART_IT_RXNE) != RESET)
   {
     // Read byte from the receive data register
     unsigned char c = USART_ReceiveData(usartMap->usart_peripheral);
-    store_char(c, usartMap->usart_rx_buffer);
+    stats->rx_interrupts++;
+    if (!usartMap->usart_rx_buffer->push(c))
+      stats->dropped++;
   }
 
   if(USART_GetITStatus(usartMap->usart_peripheral, USART_IT_TXE) != RESET)
   {
+    stats->tx_interrupts++;
     // Write byte to the transmit data register
-    if (usartMap->usart_tx_buffer->head == usartMap->usart_tx_buffer->tail)
+    unsigned char c;
+    if (usartMap->usart_tx_buffer->pop(c))
     {
-      // Buffer empty, so disable the USART Transmit interrupt
-      USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, DISABLE);
+      // There is more data in the output buffer. Send the next byte
+      USART_SendData(usartMap->usart_peripheral, c);
     }
     else
     {
-      // There is more data in the output buffer. Send the next byte
-      USART_SendData(usartMap->usart_peripheral, usartMap->usart_tx_buffer->buffer[usartMap->usart_tx_buffer->tail++]);
-      usartMap->usart_tx_buffer->tail %= SERIAL_BUFFER_SIZE;
+      // Buffer empty, so disable the USART Transmit interrupt
+      USART_ITConfig(usartMap->usart_peripheral, USART_IT_TXE, DISABLE);
     }
   }
 }
@@ -302,6 +502,45 @@ void Wiring_USART2_Interrupt_Handler(void)
   USART_Interrupt_Handler(&USART_MAP[USART_TX_RX]);
 }
 
+/*******************************************************************************
+* Function Name  : Wiring_DMA1_Channel6_Interrupt_Handler (Declared as weak in stm32_it.cpp)
+* Description    : This function handles USART2_RX_DMA half and full transfer
+*                  interrupt requests.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Wiring_DMA1_Channel6_Interrupt_Handler(void)
+{
+  STM32_USART_Info *usartMap = &USART_MAP[USART_TX_RX];
+
+  DMA_ClearFlag(usartMap->usart_rx_dma_flag_gl);
+  if (usartMap->usart_dma_enabled)
+  {
+    usartMap->usart_stats->rx_interrupts++;
+    USART_DMA_Receive(usartMap);
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Wiring_DMA1_Channel7_Interrupt_Handler (Declared as weak in stm32_it.cpp)
+* Description    : This function handles USART2_TX_DMA transfer complete
+*                  interrupt request.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Wiring_DMA1_Channel7_Interrupt_Handler(void)
+{
+  STM32_USART_Info *usartMap = &USART_MAP[USART_TX_RX];
+
+  if (usartMap->usart_dma_enabled && DMA_GetFlagStatus(usartMap->usart_tx_dma_flag_tc) != RESET)
+  {
+    usartMap->usart_stats->tx_interrupts++;
+    USART_DMA_Transmit_Complete(usartMap);
+  }
+}
+
 // Serial2 interrupt handler
 // Serial2 uses alternate function pins PB6/D1(TX), PB7/D0(RX)
 /*******************************************************************************
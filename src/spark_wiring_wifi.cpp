@@ -161,8 +161,7 @@ void WiFiClass::connect(void)
     else
     {
       SPARK_LED_FADE = 0;
-      LED_SetRGBColor(RGB_COLOR_GREEN);
-      LED_On(LED_RGB);
+      LED_SetStatusColor(RGB_COLOR_GREEN);
       wlan_ioctl_set_connection_policy(DISABLE, DISABLE, ENABLE);//Enable auto connect
     }
 
@@ -207,8 +206,7 @@ void WiFiClass::on(void)
     SPARK_WLAN_STARTED = 1;
     SPARK_WLAN_SLEEP = 0;
     SPARK_LED_FADE = 1;
-    LED_SetRGBColor(RGB_COLOR_BLUE);
-    LED_On(LED_RGB);
+    LED_SetStatusColor(RGB_COLOR_BLUE);
     wlan_ioctl_set_connection_policy(DISABLE, DISABLE, DISABLE);//Disable auto connect
   }
 }
@@ -227,8 +225,7 @@ void WiFiClass::off(void)
     SPARK_CLOUD_CONNECT = 0;
 
     SPARK_LED_FADE = 1;
-    LED_SetRGBColor(RGB_COLOR_WHITE);
-    LED_On(LED_RGB);
+    LED_SetStatusColor(RGB_COLOR_WHITE);
   }
 }
 
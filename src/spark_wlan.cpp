@@ -26,6 +26,12 @@
 #include "spark_macros.h"
 #include "string.h"
 #include "wifi_credentials_reader.h"
+#include "spark_backoff.h"
+#include "spark_profiler.h"
+#include "spark_loop_monitor.h"
+#include "spark_led_animation.h"
+#include "spark_connection_fsm.h"
+#include <stdlib.h>
 
 //#define DEBUG_WIFI    // Define to show all the flags in debug output
 //#define DEBUG_WAN_WD  // Define to show all SW WD activity in debug output
@@ -82,8 +88,6 @@ uint32_t wlan_watchdog = 0;
 #define WLAN_WD_TO() (wlan_watchdog && (millis() >= wlan_watchdog))
 #define CLR_WLAN_WD() do { wlan_watchdog = 0; WAN_WD_DEBUG("WD Cleared, was %d",wlan_watchdog);;}while(0)
 
-volatile system_tick_t spark_loop_total_millis = 0;
-
 void (*announce_presence)(void);
 
 /* Smart Config Prefix */
@@ -115,6 +119,92 @@ volatile uint8_t SPARK_LED_FADE;
 
 volatile uint8_t Spark_Error_Count;
 
+Backoff Spark_Connect_Backoff(SPARK_CONNECT_BACKOFF_MIN_MILLIS, SPARK_CONNECT_BACKOFF_MAX_MILLIS);
+
+/* Mirrors the connection state in the flags the rest of the firmware reads,
+ * and shows the changes on the LED */
+static void Spark_Connection_Changed(Spark_Connection_State_TypeDef from, Spark_Connection_Event_TypeDef event, Spark_Connection_State_TypeDef to)
+{
+	WLAN_CONNECTED = to >= CONNECTION_WLAN_ADDRESSING;
+	WLAN_DHCP = to >= CONNECTION_WLAN_READY;
+	SPARK_CLOUD_SOCKETED = to >= CONNECTION_CLOUD_HANDSHAKE;
+	SPARK_CLOUD_CONNECTED = to == CONNECTION_CLOUD_CONNECTED;
+	if (!SPARK_CLOUD_SOCKETED)
+	{
+		SPARK_FLASH_UPDATE = 0;
+	}
+	if (to < CONNECTION_WLAN_READY)
+	{
+		Spark_Error_Count = 0;
+	}
+
+	if (from != to)
+	{
+		DEBUG("%s -> %s", ConnectionStateMachine::name(from), ConnectionStateMachine::name(to));
+	}
+
+	switch (event)
+	{
+		case CONNECTION_EVENT_WLAN_CONNECTED:
+			if(!WLAN_DISCONNECT)
+			{
+			  ARM_WLAN_WD(CONNECT_TO_ADDRESS_MAX);
+			}
+			break;
+
+		case CONNECTION_EVENT_WLAN_DISCONNECTED:
+			if (from >= CONNECTION_WLAN_ADDRESSING)
+			{
+			  //Breathe blue if established connection gets disconnected
+			  if(!WLAN_DISCONNECT && !WLAN_SMART_CONFIG_START)
+			  {
+			    //if WiFi.disconnect called or listening, do not enable wlan watchdog
+			    ARM_WLAN_WD(DISCONNECT_TO_RECONNECT);
+			  }
+			  SPARK_LED_FADE = 1;
+			  LED_SetStatusColor(RGB_COLOR_BLUE);
+			}
+			else if (!WLAN_SMART_CONFIG_START)
+			{
+			  //Do not enter if smart config related disconnection happens
+			  //Blink green if connection fails because of wrong password
+			  ARM_WLAN_WD(DISCONNECT_TO_RECONNECT);
+			  SPARK_LED_FADE = 0;
+			  LED_SetStatusColor(RGB_COLOR_GREEN);
+			}
+			break;
+
+		case CONNECTION_EVENT_DHCP_OK:
+			CLR_WLAN_WD();
+			SPARK_LED_FADE = 1;
+			LED_SetStatusColor(RGB_COLOR_GREEN);
+			break;
+
+		case CONNECTION_EVENT_CLOUD_UNWANTED:
+			if(!WLAN_DISCONNECT)
+			{
+			  LED_SetStatusColor(RGB_COLOR_GREEN);
+			}
+			break;
+
+		case CONNECTION_EVENT_CLOUD_RETRY:
+			SPARK_LED_FADE = 0;
+			LED_SetStatusColor(RGB_COLOR_CYAN);
+			break;
+
+		case CONNECTION_EVENT_HANDSHAKE_OK:
+			// an open socket isn't a connection: the server may still
+			// refuse the handshake, and that must keep backing off
+			Spark_Connect_Backoff.reset();
+			break;
+
+		default:
+			break;
+	}
+}
+
+ConnectionStateMachine Spark_Connection_State(Spark_Connection_Changed, millis);
+
 
 void Set_NetApp_Timeout(void)
 {
@@ -174,17 +264,15 @@ void Start_Smart_Config(void)
 	WLAN_SMART_CONFIG_FINISHED = 0;
 	WLAN_SMART_CONFIG_STOP = 0;
 	WLAN_SERIAL_CONFIG_DONE = 0;
-	WLAN_CONNECTED = 0;
-	WLAN_DHCP = 0;
 	WLAN_CAN_SHUTDOWN = 0;
 
-	SPARK_CLOUD_SOCKETED = 0;
-	SPARK_CLOUD_CONNECTED = 0;
-	SPARK_FLASH_UPDATE = 0;
+	/* The access point and the cloud are given up now, not when the CC3000
+	 * reports the disconnection */
+	Spark_Connection_State.dispatch(CONNECTION_EVENT_WLAN_DISCONNECTED);
+
 	SPARK_LED_FADE = 0;
 
-	LED_SetRGBColor(RGB_COLOR_BLUE);
-	LED_On(LED_RGB);
+	LED_SetStatusColor(RGB_COLOR_BLUE);
 
 	/* If WiFi module is connected, disconnect it */
 	WiFi.disconnect();
@@ -259,56 +347,15 @@ void WLAN_Async_Callback(long lEventType, char *data, unsigned char length)
 			break;
 
 		case HCI_EVNT_WLAN_UNSOL_CONNECT:
-			WLAN_CONNECTED = 1;
-			if(!WLAN_DISCONNECT)
-			{
-  		          ARM_WLAN_WD(CONNECT_TO_ADDRESS_MAX);
-			}
+			Spark_Connection_State.post(CONNECTION_EVENT_WLAN_CONNECTED);
 			break;
 
 		case HCI_EVNT_WLAN_UNSOL_DISCONNECT:
-			if (WLAN_CONNECTED)
-			{
-			  //Breathe blue if established connection gets disconnected
-			  if(!WLAN_DISCONNECT)
-			  {
-			    //if WiFi.disconnect called, do not enable wlan watchdog
-			    ARM_WLAN_WD(DISCONNECT_TO_RECONNECT);
-			  }
-			  SPARK_LED_FADE = 1;
-			  LED_SetRGBColor(RGB_COLOR_BLUE);
-			  LED_On(LED_RGB);
-			}
-			else if (!WLAN_SMART_CONFIG_START)
-			{
-			  //Do not enter if smart config related disconnection happens
-			  //Blink green if connection fails because of wrong password
-			  ARM_WLAN_WD(DISCONNECT_TO_RECONNECT);
-			  SPARK_LED_FADE = 0;
-			  LED_SetRGBColor(RGB_COLOR_GREEN);
-			  LED_On(LED_RGB);
-			}
-			WLAN_CONNECTED = 0;
-			WLAN_DHCP = 0;
-			SPARK_CLOUD_SOCKETED = 0;
-			SPARK_CLOUD_CONNECTED = 0;
-			SPARK_FLASH_UPDATE = 0;
-			Spark_Error_Count = 0;
+			Spark_Connection_State.post(CONNECTION_EVENT_WLAN_DISCONNECTED);
 			break;
 
 		case HCI_EVNT_WLAN_UNSOL_DHCP:
-			if (*(data + 20) == 0)
-			{
-				CLR_WLAN_WD();
-				WLAN_DHCP = 1;
-				SPARK_LED_FADE = 1;
-				LED_SetRGBColor(RGB_COLOR_GREEN);
-				LED_On(LED_RGB);
-			}
-			else
-			{
-				WLAN_DHCP = 0;
-			}
+			Spark_Connection_State.post(*(data + 20) == 0 ? CONNECTION_EVENT_DHCP_OK : CONNECTION_EVENT_DHCP_FAILED);
 			break;
 
 		case HCI_EVENT_CC3000_CAN_SHUT_DOWN:
@@ -326,9 +373,7 @@ void WLAN_Async_Callback(long lEventType, char *data, unsigned char length)
 		      set_socket_active_status(socket, SOCKET_STATUS_INACTIVE);
   		      if(socket == sparkSocket)
 		      {
-			SPARK_FLASH_UPDATE = 0;
-			SPARK_CLOUD_CONNECTED = 0;
-			SPARK_CLOUD_SOCKETED = 0;
+			Spark_Connection_State.post(CONNECTION_EVENT_SOCKET_CLOSED);
  		      }
 		    break;
 	}
@@ -383,13 +428,121 @@ void SPARK_WLAN_Setup(void (*presence_announcement_callback)(void))
 	}
 }
 
+static uint8_t Spark_Error_Blinking;
+
+/* Blinks the LED red Spark_Error_Count times, half a second on and half off.
+ * Returns true until the blinking is done; the main loop keeps running. */
+static bool Spark_Error_Blink(void)
+{
+  if (!Spark_Error_Blinking)
+  {
+    Spark_Error_Blinking = 1;
+    Led_Animator.play(LED_ANIMATION_ERROR, RGB_COLOR_RED, Spark_Error_Count);
+  }
+
+  if (Led_Animator.playing())
+  {
+    return true;
+  }
+
+  Spark_Error_Blinking = 0;
+  Spark_Error_Count = 0;
+  return false;
+}
+
+/* Takes the next step of the cloud connection, and works out why it failed */
+static void Spark_Cloud_Connect_Step(int &cfod_count)
+{
+  int rv = Spark_Connect_Step();
+  if (SPARK_CONNECT_IN_PROGRESS == rv)
+  {
+    return;
+  }
+
+  if (rv >= 0)
+  {
+    cfod_count  = 0;
+    // handshake on the next pass
+    Spark_Connection_State.dispatch(CONNECTION_EVENT_SOCKET_OPENED);
+    return;
+  }
+
+  Spark_Connect_Backoff.failed(millis(), rand());
+
+  if (!SPARK_WLAN_RESET)
+  {
+    if ((cfod_count += RESET_ON_CFOD) == MAX_FAILED_CONNECTS)
+    {
+      SPARK_WLAN_RESET = RESET_ON_CFOD;
+      ERROR("Resetting CC3000 due to %d failed connect attempts", MAX_FAILED_CONNECTS);
+    }
+
+    if (Internet_Test() < 0)
+    {
+      // No Internet Connection
+      if ((cfod_count += RESET_ON_CFOD) == MAX_FAILED_CONNECTS)
+      {
+        SPARK_WLAN_RESET = RESET_ON_CFOD;
+        ERROR("Resetting CC3000 due to %d failed connect attempts", MAX_FAILED_CONNECTS);
+      }
+
+      Spark_Error_Count = 2;
+    }
+    else
+    {
+      // Cloud not Reachable
+      Spark_Error_Count = 3;
+    }
+
+    NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET] = Spark_Error_Count;
+    nvmem_write(NVMEM_SPARK_FILE_ID, 1, ERROR_COUNT_FILE_OFFSET, &NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET]);
+  }
+
+  Spark_Connection_State.dispatch(CONNECTION_EVENT_SOCKET_FAILED);
+}
+
+/* Shakes hands with the cloud on the socket just opened */
+static void Spark_Cloud_Handshake(void)
+{
+  int err = Spark_Handshake();
+
+  if (err)
+  {
+    if (0 > err)
+    {
+      // Wrong key error, red
+      LED_SetStatusColor(RGB_COLOR_RED);
+    }
+    else if (1 == err)
+    {
+      // RSA decryption error, orange
+      LED_SetStatusColor(RGB_COLOR_ORANGE);
+    }
+    else if (2 == err)
+    {
+      // RSA signature verification error, magenta
+      LED_SetStatusColor(RGB_COLOR_MAGENTA);
+    }
+
+    // the server has given up on this socket, start again after the backoff
+    Spark_Disconnect();
+    Spark_Connect_Backoff.failed(millis(), rand());
+    Spark_Connection_State.dispatch(CONNECTION_EVENT_HANDSHAKE_FAILED);
+  }
+  else
+  {
+    Spark_Connection_State.dispatch(CONNECTION_EVENT_HANDSHAKE_OK);
+  }
+}
+
 void SPARK_WLAN_Loop(void)
 {
+  PROFILE_SCOPE(PROBE_WLAN_LOOP);
+  LOOP_MONITOR_SCOPE(LOOP_SUBSYSTEM_WLAN);
   static int cfod_count = 0;
   KICK_WDT();
 
   ON_EVENT_DELTA();
-  spark_loop_total_millis = 0;
 
   if (SPARK_WLAN_RESET || SPARK_WLAN_SLEEP || WLAN_WD_TO())
   {
@@ -397,15 +550,13 @@ void SPARK_WLAN_Loop(void)
     {
       DEBUG("Resetting CC3000!");
       CLR_WLAN_WD();
-      WLAN_CONNECTED = 0;
-      WLAN_DHCP = 0;
       SPARK_WLAN_RESET = 0;
       SPARK_WLAN_STARTED = 0;
-      SPARK_CLOUD_SOCKETED = 0;
-      SPARK_CLOUD_CONNECTED = 0;
-      SPARK_FLASH_UPDATE = 0;
-      Spark_Error_Count = 0;
+      Spark_Error_Blinking = 0;
       cfod_count = 0;
+      Spark_Connect_Backoff.reset();
+      Multicast_Presence_Release(false);
+      Spark_Connection_State.dispatch(CONNECTION_EVENT_WLAN_STOPPED);
 
       WiFi.off();
     }
@@ -422,6 +573,13 @@ void SPARK_WLAN_Loop(void)
     }
   }
 
+  // Started before the events it gives rise to are handled
+  if (SPARK_WLAN_STARTED && Spark_Connection_State.state() == CONNECTION_OFF)
+  {
+    Spark_Connection_State.dispatch(CONNECTION_EVENT_WLAN_STARTED);
+  }
+  Spark_Connection_State.process();
+
   if (WLAN_SMART_CONFIG_START)
   {
     Start_Smart_Config();
@@ -466,130 +624,67 @@ void SPARK_WLAN_Loop(void)
     memset(&ip_config, 0, sizeof(tNetappIpconfigRetArgs));
   }
 
-  if (SPARK_CLOUD_CONNECT == 0)
+  Spark_Connection_State_TypeDef state = Spark_Connection_State.state();
+  if (state >= CONNECTION_CLOUD_WAITING && (SPARK_CLOUD_CONNECT == 0 || SPARK_WLAN_SLEEP))
   {
-    if (SPARK_CLOUD_SOCKETED || SPARK_CLOUD_CONNECTED)
-    {
-      Spark_Disconnect();
-
-      SPARK_FLASH_UPDATE = 0;
-      SPARK_CLOUD_CONNECTED = 0;
-      SPARK_CLOUD_SOCKETED = 0;
-
-      if(!WLAN_DISCONNECT)
-      {
-        LED_SetRGBColor(RGB_COLOR_GREEN);
-        LED_On(LED_RGB);
-      }
-    }
-
+    Spark_Disconnect();
+    Spark_Connection_State.dispatch(CONNECTION_EVENT_CLOUD_UNWANTED);
     return;
   }
 
-  if (WLAN_DHCP && !SPARK_WLAN_SLEEP && !SPARK_CLOUD_SOCKETED)
+  // Only the work of the state the connection is in
+  switch (state)
   {
-    if (Spark_Error_Count)
-    {
-      LED_SetRGBColor(RGB_COLOR_RED);
-
-      while (Spark_Error_Count != 0)
-      {
-        LED_On(LED_RGB);
-        Delay(500);
-        LED_Off(LED_RGB);
-        Delay(500);
-        Spark_Error_Count--;
-      }
-
-      // TODO Send the Error Count to Cloud: NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET]
-
-      // Reset Error Count
-      NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET] = 0;
-      nvmem_write(NVMEM_SPARK_FILE_ID, 1, ERROR_COUNT_FILE_OFFSET, &NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET]);
-    }
-
-    SPARK_LED_FADE = 0;
-    LED_SetRGBColor(RGB_COLOR_CYAN);
-    LED_On(LED_RGB);
-
-    if (Spark_Connect() >= 0)
-    {
-      cfod_count  = 0;
-      SPARK_CLOUD_SOCKETED = 1;
-    }
-    else
-    {
-      if (SPARK_WLAN_RESET)
-      {
-        return;
-      }
-
-      if ((cfod_count += RESET_ON_CFOD) == MAX_FAILED_CONNECTS)
+    case CONNECTION_WLAN_READY:
+      if (SPARK_CLOUD_CONNECT && !SPARK_WLAN_SLEEP)
       {
-        SPARK_WLAN_RESET = RESET_ON_CFOD;
-        ERROR("Resetting CC3000 due to %d failed connect attempts", MAX_FAILED_CONNECTS);
+        Spark_Connection_State.dispatch(CONNECTION_EVENT_CLOUD_WANTED);
       }
+      break;
 
-      if (Internet_Test() < 0)
+    case CONNECTION_CLOUD_WAITING:
+      if (Spark_Error_Count)
       {
-        // No Internet Connection
-        if ((cfod_count += RESET_ON_CFOD) == MAX_FAILED_CONNECTS)
+        if (Spark_Error_Blink())
         {
-          SPARK_WLAN_RESET = RESET_ON_CFOD;
-          ERROR("Resetting CC3000 due to %d failed connect attempts", MAX_FAILED_CONNECTS);
+          break;
         }
 
-        Spark_Error_Count = 2;
+        // TODO Send the Error Count to Cloud: NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET]
+
+        // Reset Error Count
+        NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET] = 0;
+        nvmem_write(NVMEM_SPARK_FILE_ID, 1, ERROR_COUNT_FILE_OFFSET, &NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET]);
       }
-      else
+
+      if (Spark_Connect_Backoff.ready(millis()))
       {
-        // Cloud not Reachable
-        Spark_Error_Count = 3;
+        Spark_Connection_State.dispatch(CONNECTION_EVENT_CLOUD_RETRY);
       }
+      break;
 
-      NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET] = Spark_Error_Count;
-      nvmem_write(NVMEM_SPARK_FILE_ID, 1, ERROR_COUNT_FILE_OFFSET, &NVMEM_Spark_File_Data[ERROR_COUNT_FILE_OFFSET]);
-
-      SPARK_CLOUD_SOCKETED = 0;
-    }
-  }
-
-  if (SPARK_CLOUD_SOCKETED)
-  {
-    if (!SPARK_CLOUD_CONNECTED)
-    {
-      int err = Spark_Handshake();
+    case CONNECTION_CLOUD_CONNECTING:
+      Spark_Cloud_Connect_Step(cfod_count);
+      break;
 
-      if (err)
+    case CONNECTION_CLOUD_HANDSHAKE:
+      Spark_Cloud_Handshake();
+      if (Spark_Connection_State.state() != CONNECTION_CLOUD_CONNECTED)
       {
-        if (0 > err)
-        {
-          // Wrong key error, red
-          LED_SetRGBColor(RGB_COLOR_RED);
-        }
-        else if (1 == err)
-        {
-          // RSA decryption error, orange
-          LED_SetRGBColor(RGB_COLOR_ORANGE);
-        }
-        else if (2 == err)
-        {
-          // RSA signature verification error, magenta
-          LED_SetRGBColor(RGB_COLOR_MAGENTA);
-        }
-
-        LED_On(LED_RGB);
+        break;
       }
-      else
+      // fall through, the cloud is up
+
+    case CONNECTION_CLOUD_CONNECTED:
+      if(SPARK_FLASH_UPDATE || System.mode() != MANUAL)
       {
-        SPARK_CLOUD_CONNECTED = 1;
+        Spark.process();
       }
-    }
+      break;
 
-    if(SPARK_FLASH_UPDATE || System.mode() != MANUAL)
-    {
-      Spark.process();
-    }
+    default:
+      // waiting on the CC3000
+      break;
   }
 }
 
@@ -32,6 +32,7 @@
 #include "main.h"
 #include "usb_lib.h"
 #include "usb_istr.h"
+#include "spark_profiler.h"
 
 /* Private typedef -----------------------------------------------------------*/
 
@@ -48,6 +49,8 @@ extern __IO uint16_t BUTTON_DEBOUNCED_TIME[];
 void Wiring_ADC1_2_Interrupt_Handler(void) __attribute__ ((weak));
 void Wiring_USART1_Interrupt_Handler(void) __attribute__ ((weak));
 void Wiring_USART2_Interrupt_Handler(void) __attribute__ ((weak));
+void Wiring_DMA1_Channel6_Interrupt_Handler(void) __attribute__ ((weak));
+void Wiring_DMA1_Channel7_Interrupt_Handler(void) __attribute__ ((weak));
 void Wiring_I2C1_EV_Interrupt_Handler(void) __attribute__ ((weak));
 void Wiring_I2C1_ER_Interrupt_Handler(void) __attribute__ ((weak));
 void Wiring_SPI1_Interrupt_Handler(void) __attribute__ ((weak));
@@ -170,6 +173,7 @@ void DebugMon_Handler(void)
  *******************************************************************************/
 void PendSV_Handler(void)
 {
+	LED_Animation_Tick();
 }
 
 /*******************************************************************************
@@ -181,6 +185,7 @@ void PendSV_Handler(void)
  *******************************************************************************/
 void SysTick_Handler(void)
 {
+	PROFILE_SCOPE(PROBE_SYSTICK);
 	System1MsTick();
 	Timing_Decrement();
 }
@@ -216,6 +221,8 @@ void ADC1_2_IRQHandler(void)
  *******************************************************************************/
 void USART1_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_USART_ISR);
+
 	if(NULL != Wiring_USART1_Interrupt_Handler)
 	{
 		Wiring_USART1_Interrupt_Handler();
@@ -231,12 +238,48 @@ void USART1_IRQHandler(void)
  *******************************************************************************/
 void USART2_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_USART_ISR);
+
 	if(NULL != Wiring_USART2_Interrupt_Handler)
 	{
 		Wiring_USART2_Interrupt_Handler();
 	}
 }
 
+/*******************************************************************************
+ * Function Name  : DMA1_Channel6_IRQHandler
+ * Description    : This function handles USART2_RX_DMA interrupt request.
+ * Input          : None
+ * Output         : None
+ * Return         : None
+ *******************************************************************************/
+void DMA1_Channel6_IRQHandler(void)
+{
+	PROFILE_SCOPE(PROBE_USART_ISR);
+
+	if(NULL != Wiring_DMA1_Channel6_Interrupt_Handler)
+	{
+		Wiring_DMA1_Channel6_Interrupt_Handler();
+	}
+}
+
+/*******************************************************************************
+ * Function Name  : DMA1_Channel7_IRQHandler
+ * Description    : This function handles USART2_TX_DMA interrupt request.
+ * Input          : None
+ * Output         : None
+ * Return         : None
+ *******************************************************************************/
+void DMA1_Channel7_IRQHandler(void)
+{
+	PROFILE_SCOPE(PROBE_USART_ISR);
+
+	if(NULL != Wiring_DMA1_Channel7_Interrupt_Handler)
+	{
+		Wiring_DMA1_Channel7_Interrupt_Handler();
+	}
+}
+
 /*******************************************************************************
  * Function Name  : I2C1_EV_IRQHandler
  * Description    : This function handles I2C1 Event interrupt request.
@@ -291,6 +334,8 @@ void SPI1_IRQHandler(void)
  *******************************************************************************/
 void EXTI0_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_EXTI_ISR);
+
 	if (EXTI_GetITStatus(EXTI_Line0) != RESET)
 	{
 		/* Clear the EXTI line pending bit */
@@ -312,6 +357,8 @@ void EXTI0_IRQHandler(void)
  *******************************************************************************/
 void EXTI1_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_EXTI_ISR);
+
 	if (EXTI_GetITStatus(EXTI_Line1) != RESET)
 	{
 		/* Clear the EXTI line pending bit */
@@ -333,6 +380,8 @@ void EXTI1_IRQHandler(void)
  *******************************************************************************/
 void EXTI2_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_EXTI_ISR);
+
 	if (EXTI_GetITStatus(EXTI_Line2) != RESET)//BUTTON1_EXTI_LINE
 	{
 		/* Clear the EXTI line pending bit */
@@ -357,6 +406,8 @@ void EXTI2_IRQHandler(void)
  *******************************************************************************/
 void EXTI3_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_EXTI_ISR);
+
 	if (EXTI_GetITStatus(EXTI_Line3) != RESET)
 	{
 		/* Clear the EXTI line pending bit */
@@ -378,6 +429,8 @@ void EXTI3_IRQHandler(void)
  *******************************************************************************/
 void EXTI4_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_EXTI_ISR);
+
 	if (EXTI_GetITStatus(EXTI_Line4) != RESET)
 	{
 		/* Clear the EXTI line pending bit */
@@ -399,6 +452,8 @@ void EXTI4_IRQHandler(void)
  *******************************************************************************/
 void EXTI9_5_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_EXTI_ISR);
+
 	//EXTI_Line8 and EXTI_Line9 support is not required for CORE_V02
 
 	if (EXTI_GetITStatus(EXTI_Line5) != RESET)
@@ -444,6 +499,8 @@ void EXTI9_5_IRQHandler(void)
  *******************************************************************************/
 void EXTI15_10_IRQHandler(void)
 {
+	PROFILE_SCOPE(PROBE_EXTI_ISR);
+
 	//EXTI_Line10 and EXTI_Line12 support is not required for CORE_V02
 
 	if (EXTI_GetITStatus(EXTI_Line13) != RESET)
@@ -25,6 +25,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "spark_ring_buffer.h"
 extern "C" {
 #include "usb_lib.h"
 #include "usb_desc.h"
@@ -42,16 +43,10 @@ extern "C" {
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 
-extern  uint8_t USART_Rx_Buffer[];
-extern uint32_t USART_Rx_ptr_out;
-extern uint32_t USART_Rx_length;
-
-extern uint8_t USB_Rx_Buffer[];
-extern uint16_t USB_Rx_length;
-extern uint16_t USB_Rx_ptr;
+extern RingBuffer<uint8_t, USB_RX_DATA_SIZE> USB_Rx_Buffer;
 
 extern uint8_t  USB_Tx_State;
-extern uint8_t  USB_Rx_State;
+extern volatile uint8_t USB_Rx_State;
 
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
@@ -65,36 +60,11 @@ extern uint8_t  USB_Rx_State;
 *******************************************************************************/
 void EP1_IN_Callback (void)
 {
-  uint16_t USB_Tx_ptr;
-  uint16_t USB_Tx_length;
-  
   if (USB_Tx_State == 1)
   {
-    if (USART_Rx_length == 0) 
-    {
-      USB_Tx_State = 0;
-    }
-    else 
-    {
-      if (USART_Rx_length > VIRTUAL_COM_PORT_DATA_SIZE){
-        USB_Tx_ptr = USART_Rx_ptr_out;
-        USB_Tx_length = VIRTUAL_COM_PORT_DATA_SIZE;
-        
-        USART_Rx_ptr_out += VIRTUAL_COM_PORT_DATA_SIZE;
-        USART_Rx_length -= VIRTUAL_COM_PORT_DATA_SIZE;    
-      }
-      else 
-      {
-        USB_Tx_ptr = USART_Rx_ptr_out;
-        USB_Tx_length = USART_Rx_length;
-        
-        USART_Rx_ptr_out += USART_Rx_length;
-        USART_Rx_length = 0;
-      }
-      UserToPMABufferCopy(&USART_Rx_Buffer[USB_Tx_ptr], ENDP1_TXADDR, USB_Tx_length);
-      SetEPTxCount(ENDP1, USB_Tx_length);
-      SetEPTxValid(ENDP1); 
-    }
+    /* The last packet has gone, send the next if there is more */
+    USB_Tx_State = 0;
+    Handle_USBAsynchXfer();
   }
 }
 
@@ -107,18 +77,35 @@ void EP1_IN_Callback (void)
 *******************************************************************************/
 void EP3_OUT_Callback(void)
 {
-  USB_Rx_State = 1;
-
-  USB_Rx_ptr = 0;
+  uint8_t *USB_Rx_ptr;
+  uint8_t USB_Rx_Packet[VIRTUAL_COM_PORT_DATA_SIZE];
 
   /* Get the number of received data on the selected Endpoint */
-  USB_Rx_length = GetEPRxCount(ENDP3);
+  uint16_t USB_Rx_length = GetEPRxCount(ENDP3);
 
-  /* Use the memory interface function to write to the selected endpoint */
-  PMAToUserBufferCopy(USB_Rx_Buffer, ENDP3_RXADDR, USB_Rx_length);
+  /* Use the memory interface function to write to the selected endpoint,
+  straight into the buffer unless the packet wraps around its end */
+  if (USB_Rx_Buffer.writeSpan(&USB_Rx_ptr) >= USB_Rx_length)
+  {
+    PMAToUserBufferCopy(USB_Rx_ptr, ENDP3_RXADDR, USB_Rx_length);
+    USB_Rx_Buffer.commit(USB_Rx_length);
+  }
+  else
+  {
+    PMAToUserBufferCopy(USB_Rx_Packet, ENDP3_RXADDR, USB_Rx_length);
+    USB_Rx_Buffer.push(USB_Rx_Packet, USB_Rx_length);
+  }
 
-  /* USB data should be immediately processed, this allow next USB traffic being
-  NAKed till the end of the processing */
+  /* Take the next packet while there is room for it, otherwise NAK the host
+  until USB_USART_Receive_Data() has made room */
+  if (USB_Rx_Buffer.space() >= VIRTUAL_COM_PORT_DATA_SIZE)
+  {
+    SetEPRxValid(ENDP3);
+  }
+  else
+  {
+    USB_Rx_State = 1;
+  }
 }
 
 
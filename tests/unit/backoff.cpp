@@ -0,0 +1,56 @@
+#include "catch.hpp"
+#include "spark_backoff.h"
+
+SCENARIO("There is no wait before the first attempt", "[backoff]") {
+    Backoff backoff(1000, 60000);
+    REQUIRE(backoff.ready(0));
+    REQUIRE(backoff.failureCount()==0);
+}
+
+SCENARIO("The wait doubles after each failure up to the maximum", "[backoff]") {
+    Backoff backoff(1000, 60000);
+    uint32_t expected[] = { 1000, 2000, 4000, 8000, 16000, 32000, 60000, 60000 };
+    for (uint32_t delay : expected) {
+        backoff.failed(0, 0);       // no jitter
+        REQUIRE(backoff.delay()==delay);
+    }
+    for (int i=0; i<300; i++)
+        backoff.failed(0, 0);
+    REQUIRE(backoff.delay()==60000);
+}
+
+SCENARIO("Jitter shortens the wait by up to a half", "[backoff]") {
+    for (uint32_t random=0; random<5000; random+=7) {
+        Backoff backoff(1000, 60000);
+        backoff.failed(0, random);
+        backoff.failed(0, random);
+        REQUIRE(backoff.delay()>=1000);
+        REQUIRE(backoff.delay()<=2000);
+    }
+}
+
+SCENARIO("An attempt is allowed once the wait is over", "[backoff]") {
+    Backoff backoff(1000, 60000);
+    backoff.failed(5000, 0);
+    REQUIRE(!backoff.ready(5000));
+    REQUIRE(!backoff.ready(5999));
+    REQUIRE(backoff.ready(6000));
+}
+
+SCENARIO("The wait survives the millisecond counter wrapping", "[backoff]") {
+    Backoff backoff(1000, 60000);
+    uint32_t now = 0xFFFFFFFFu - 100;
+    backoff.failed(now, 0);
+    REQUIRE(!backoff.ready(now + 500));
+    REQUIRE(backoff.ready(now + 1000));
+}
+
+SCENARIO("Success resets the backoff", "[backoff]") {
+    Backoff backoff(1000, 60000);
+    backoff.failed(0, 0);
+    backoff.failed(0, 0);
+    backoff.reset();
+    REQUIRE(backoff.ready(0));
+    backoff.failed(0, 0);
+    REQUIRE(backoff.delay()==1000);
+}
@@ -0,0 +1,352 @@
+#include "catch.hpp"
+#include "spark_connection_fsm.h"
+#include "spark_backoff.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static uint32_t now;
+static std::string trace;
+
+static uint32_t virtualClock() {
+    return now;
+}
+
+static void traceTransition(Spark_Connection_State_TypeDef from, Spark_Connection_Event_TypeDef, Spark_Connection_State_TypeDef to) {
+    if (from != to) {
+        trace += ConnectionStateMachine::name(to);
+        trace += ";";
+    }
+}
+
+/**
+ * Stands in for the CC3000: posts its asynchronous events, as
+ * WLAN_Async_Callback() would from the interrupt, once their time has come.
+ */
+struct FakeCC3000 {
+    struct Scripted {
+        uint32_t at;
+        Spark_Connection_Event_TypeDef event;
+    };
+    std::vector<Scripted> script;
+    size_t next = 0;
+
+    FakeCC3000& at(uint32_t millis, Spark_Connection_Event_TypeDef event) {
+        script.push_back({millis, event});
+        return *this;
+    }
+
+    void interrupt(ConnectionStateMachine& machine) {
+        while (next < script.size() && script[next].at <= now)
+            machine.post(script[next++].event);
+    }
+};
+
+/**
+ * Stands in for the cloud: how many connection attempts and handshakes fail
+ * before one succeeds, and how many loop passes an attempt takes.
+ */
+struct FakeCloud {
+    int connect_failures = 0;
+    int handshake_failures = 0;
+    int connect_passes = 3;
+    uint32_t backoff_millis = 1000;
+
+    Backoff* backoff = NULL;   // the firmware's, in place of backoff_millis
+
+    int passes = 0;
+    uint32_t retry_at = 0;
+
+    void failed() {
+        if (backoff) {
+            backoff->failed(now, 0);
+            retry_at = now + backoff->delay();
+        }
+        else
+            retry_at = now + backoff_millis;
+    }
+};
+
+/**
+ * One pass of SPARK_WLAN_Loop(): the events from the interrupt, then the
+ * work of the state the connection is in.
+ */
+static void loopPass(ConnectionStateMachine& machine, FakeCloud& cloud) {
+    machine.process();
+    switch (machine.state()) {
+        case CONNECTION_WLAN_READY:
+            machine.dispatch(CONNECTION_EVENT_CLOUD_WANTED);
+            break;
+        case CONNECTION_CLOUD_WAITING:
+            if (int32_t(now - cloud.retry_at) >= 0) {
+                cloud.passes = 0;
+                machine.dispatch(CONNECTION_EVENT_CLOUD_RETRY);
+            }
+            break;
+        case CONNECTION_CLOUD_CONNECTING:
+            if (++cloud.passes < cloud.connect_passes)
+                break;
+            if (cloud.connect_failures) {
+                cloud.connect_failures--;
+                cloud.failed();
+                machine.dispatch(CONNECTION_EVENT_SOCKET_FAILED);
+            }
+            else
+                machine.dispatch(CONNECTION_EVENT_SOCKET_OPENED);
+            break;
+        case CONNECTION_CLOUD_HANDSHAKE:
+            if (cloud.handshake_failures) {
+                cloud.handshake_failures--;
+                cloud.failed();
+                machine.dispatch(CONNECTION_EVENT_HANDSHAKE_FAILED);
+            }
+            else
+                machine.dispatch(CONNECTION_EVENT_HANDSHAKE_OK);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Runs the loop every 10ms until {@code until}, the interrupt posting the
+ * scripted events between passes.
+ */
+static void run(ConnectionStateMachine& machine, FakeCC3000& cc3000, FakeCloud& cloud, uint32_t until) {
+    while (now < until) {
+        now += 10;
+        cc3000.interrupt(machine);
+        loopPass(machine, cloud);
+    }
+}
+
+static void reset() {
+    now = 0;
+    trace.clear();
+}
+
+static Spark_Connection_State_Stats_TypeDef statsOf(const ConnectionStateMachine& machine) {
+    Spark_Connection_State_Stats_TypeDef stats;
+    machine.stats(&stats);
+    return stats;
+}
+
+SCENARIO("The connection goes from off to the cloud", "[connection]") {
+    reset();
+    ConnectionStateMachine machine(traceTransition, virtualClock);
+    FakeCC3000 cc3000;
+    FakeCloud cloud;
+    cc3000.at(0, CONNECTION_EVENT_WLAN_STARTED)
+          .at(300, CONNECTION_EVENT_WLAN_CONNECTED)
+          .at(1200, CONNECTION_EVENT_DHCP_OK);
+
+    run(machine, cc3000, cloud, 2000);
+    REQUIRE(machine.state()==CONNECTION_CLOUD_CONNECTED);
+    REQUIRE(trace=="wlan connecting;wlan addressing;wlan ready;cloud waiting;cloud connecting;cloud handshake;cloud connected;");
+
+    Spark_Connection_State_Stats_TypeDef stats = statsOf(machine);
+    REQUIRE(stats.cloud_connects==1);
+    // started at 10, DHCP at 1200, a pass to start, 3 to open the socket and one to shake hands
+    REQUIRE(stats.last_cloud_millis==1240);
+    REQUIRE(stats.ignored==0);
+    REQUIRE(stats.dropped==0);
+}
+
+SCENARIO("A wrong password keeps the connection joining", "[connection]") {
+    reset();
+    ConnectionStateMachine machine(traceTransition, virtualClock);
+    FakeCC3000 cc3000;
+    FakeCloud cloud;
+    cc3000.at(0, CONNECTION_EVENT_WLAN_STARTED)
+          .at(500, CONNECTION_EVENT_WLAN_DISCONNECTED)
+          .at(1000, CONNECTION_EVENT_WLAN_DISCONNECTED);
+
+    run(machine, cc3000, cloud, 2000);
+    REQUIRE(machine.state()==CONNECTION_WLAN_CONNECTING);
+    REQUIRE(trace=="wlan connecting;");
+    REQUIRE(statsOf(machine).transitions==3);
+}
+
+SCENARIO("Events that don't apply to the state are ignored", "[connection]") {
+    reset();
+    ConnectionStateMachine machine(traceTransition, virtualClock);
+    FakeCC3000 cc3000;
+    FakeCloud cloud;
+    cc3000.at(0, CONNECTION_EVENT_WLAN_STARTED)
+          .at(100, CONNECTION_EVENT_WLAN_CONNECTED)
+          .at(200, CONNECTION_EVENT_WLAN_DISCONNECTED)
+          // a late DHCP event from the access point that's gone
+          .at(200, CONNECTION_EVENT_DHCP_FAILED)
+          .at(200, CONNECTION_EVENT_SOCKET_CLOSED);
+
+    run(machine, cc3000, cloud, 500);
+    REQUIRE(machine.state()==CONNECTION_WLAN_CONNECTING);
+    REQUIRE(statsOf(machine).ignored==2);
+    REQUIRE_FALSE(machine.dispatch(CONNECTION_EVENT_HANDSHAKE_OK));
+}
+
+SCENARIO("An unreachable cloud is retried after the backoff", "[connection]") {
+    reset();
+    ConnectionStateMachine machine(traceTransition, virtualClock);
+    FakeCC3000 cc3000;
+    FakeCloud cloud;
+    cloud.connect_failures = 2;
+    cloud.handshake_failures = 1;
+    cc3000.at(0, CONNECTION_EVENT_WLAN_STARTED)
+          .at(300, CONNECTION_EVENT_WLAN_CONNECTED)
+          .at(1200, CONNECTION_EVENT_DHCP_OK);
+
+    run(machine, cc3000, cloud, 10000);
+    REQUIRE(machine.state()==CONNECTION_CLOUD_CONNECTED);
+
+    Spark_Connection_State_Stats_TypeDef stats = statsOf(machine);
+    REQUIRE(stats.cloud_connects==1);
+    // DHCP at 1200, attempts fail at 1240 and 2270, the handshake at 3310,
+    // each followed by a second of backoff, and the cloud at 4350
+    REQUIRE(stats.last_cloud_millis==4340);
+}
+
+static Backoff backoff(1000, 8000);
+
+// resets the backoff as Spark_Connection_Changed() does
+static void resetBackoffOnHandshake(Spark_Connection_State_TypeDef from, Spark_Connection_Event_TypeDef event, Spark_Connection_State_TypeDef to) {
+    traceTransition(from, event, to);
+    if (event == CONNECTION_EVENT_HANDSHAKE_OK)
+        backoff.reset();
+}
+
+SCENARIO("The backoff is only reset by a completed handshake", "[connection]") {
+    reset();
+    backoff.reset();
+    ConnectionStateMachine machine(resetBackoffOnHandshake, virtualClock);
+    FakeCC3000 cc3000;
+    FakeCloud cloud;
+    cloud.backoff = &backoff;
+    // the socket opens every time, but the server refuses the handshake
+    cloud.handshake_failures = 3;
+    cc3000.at(0, CONNECTION_EVENT_WLAN_STARTED)
+          .at(100, CONNECTION_EVENT_WLAN_CONNECTED)
+          .at(200, CONNECTION_EVENT_DHCP_OK);
+
+    run(machine, cc3000, cloud, 1000);
+    REQUIRE(machine.state()==CONNECTION_CLOUD_WAITING);
+    REQUIRE(backoff.failureCount()==1);
+    REQUIRE(backoff.delay()==1000);
+
+    // each refusal doubles the wait though the socket opened
+    run(machine, cc3000, cloud, 3000);
+    REQUIRE(backoff.failureCount()==2);
+    REQUIRE(backoff.delay()==2000);
+    run(machine, cc3000, cloud, 7000);
+    REQUIRE(backoff.failureCount()==3);
+    REQUIRE(backoff.delay()==4000);
+
+    run(machine, cc3000, cloud, 8000);
+    REQUIRE(machine.state()==CONNECTION_CLOUD_CONNECTED);
+    REQUIRE(backoff.failureCount()==0);
+}
+
+SCENARIO("The time to get the cloud back is measured from its loss", "[connection]") {
+    reset();
+    ConnectionStateMachine machine(traceTransition, virtualClock);
+    FakeCC3000 cc3000;
+    FakeCloud cloud;
+    cc3000.at(0, CONNECTION_EVENT_WLAN_STARTED)
+          .at(100, CONNECTION_EVENT_WLAN_CONNECTED)
+          .at(200, CONNECTION_EVENT_DHCP_OK)
+          .at(5000, CONNECTION_EVENT_WLAN_DISCONNECTED)
+          .at(7000, CONNECTION_EVENT_WLAN_CONNECTED)
+          .at(8000, CONNECTION_EVENT_DHCP_OK)
+          .at(9000, CONNECTION_EVENT_SOCKET_CLOSED);
+
+    run(machine, cc3000, cloud, 8500);
+    Spark_Connection_State_Stats_TypeDef stats = statsOf(machine);
+    REQUIRE(stats.cloud_connects==2);
+    // lost at 5000, DHCP at 8000, the cloud at 8050
+    REQUIRE(stats.last_cloud_millis==3050);
+    REQUIRE(stats.max_cloud_millis==3050);
+
+    // the server closing the socket costs a reconnection, not the network
+    trace.clear();
+    run(machine, cc3000, cloud, 10000);
+    REQUIRE(machine.state()==CONNECTION_CLOUD_CONNECTED);
+    REQUIRE(trace=="cloud waiting;cloud connecting;cloud handshake;cloud connected;");
+    REQUIRE(statsOf(machine).last_cloud_millis==40);
+}
+
+SCENARIO("Turning the cloud or the CC3000 off is honored from any state", "[connection]") {
+    reset();
+    ConnectionStateMachine machine(traceTransition, virtualClock);
+    FakeCC3000 cc3000;
+    FakeCloud cloud;
+    cc3000.at(0, CONNECTION_EVENT_WLAN_STARTED)
+          .at(100, CONNECTION_EVENT_WLAN_CONNECTED)
+          .at(200, CONNECTION_EVENT_DHCP_OK);
+    run(machine, cc3000, cloud, 1000);
+
+    REQUIRE(machine.dispatch(CONNECTION_EVENT_CLOUD_UNWANTED));
+    REQUIRE(machine.state()==CONNECTION_WLAN_READY);
+    REQUIRE(machine.dispatch(CONNECTION_EVENT_WLAN_STOPPED));
+    REQUIRE(machine.state()==CONNECTION_OFF);
+    REQUIRE_FALSE(machine.dispatch(CONNECTION_EVENT_WLAN_STOPPED));
+}
+
+SCENARIO("Events posted while the queue is full are dropped and counted", "[connection]") {
+    reset();
+    ConnectionStateMachine machine(traceTransition, virtualClock);
+    for (int i=0; i<CONNECTION_QUEUE_DEPTH; i++)
+        machine.post(CONNECTION_EVENT_WLAN_DISCONNECTED);
+    REQUIRE(statsOf(machine).dropped==1);
+    REQUIRE(machine.pending());
+    REQUIRE(machine.process()==CONNECTION_QUEUE_DEPTH - 1);
+    REQUIRE_FALSE(machine.pending());
+    REQUIRE(machine.process()==0);
+}
+
+// run with: runner [benchmark]
+TEST_CASE("Benchmark loop passes of the connection", "[.][benchmark]") {
+    reset();
+    ConnectionStateMachine machine(NULL, virtualClock);
+    FakeCloud cloud;
+    machine.dispatch(CONNECTION_EVENT_WLAN_STARTED);
+    machine.dispatch(CONNECTION_EVENT_WLAN_CONNECTED);
+    machine.dispatch(CONNECTION_EVENT_DHCP_OK);
+    loopPass(machine, cloud);
+
+    // a pass with nothing to do, the state the Core spends its life in
+    const int passes = 10000000;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<passes; i++)
+        loopPass(machine, cloud);
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "idle pass in " << ConnectionStateMachine::name(machine.state()) << ": "
+              << double(elapsed) / passes << " ns" << std::endl;
+
+    // a pass handling an event from the interrupt
+    start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<passes; i++) {
+        machine.post(CONNECTION_EVENT_DHCP_OK);
+        loopPass(machine, cloud);
+    }
+    elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "pass with an event: " << double(elapsed) / passes << " ns" << std::endl;
+
+    // time to the cloud over a flaky network: the AP drops every 5s
+    reset();
+    ConnectionStateMachine flaky(NULL, virtualClock);
+    FakeCC3000 cc3000;
+    FakeCloud flakyCloud;
+    flakyCloud.connect_failures = 3;
+    cc3000.at(0, CONNECTION_EVENT_WLAN_STARTED);
+    for (uint32_t t = 0; t < 60000; t += 5000) {
+        cc3000.at(t + 300, CONNECTION_EVENT_WLAN_CONNECTED)
+              .at(t + 1200, CONNECTION_EVENT_DHCP_OK)
+              .at(t + 4900, CONNECTION_EVENT_WLAN_DISCONNECTED);
+    }
+    run(flaky, cc3000, flakyCloud, 60000);
+    Spark_Connection_State_Stats_TypeDef stats = statsOf(flaky);
+    std::cout << "flaky network: " << stats.cloud_connects << " cloud connections, last "
+              << stats.last_cloud_millis << " ms, longest " << stats.max_cloud_millis << " ms" << std::endl;
+}
@@ -0,0 +1,175 @@
+#include "catch.hpp"
+
+static uint32_t now;
+#define CO_CLOCK() now
+#include "spark_coroutine.h"
+
+#include <deque>
+#include <string>
+
+static std::deque<char> input;
+static std::string trace;
+
+static void reset() {
+    now = 0;
+    input.clear();
+    trace.clear();
+}
+
+/**
+ * Reads lines of input as it arrives, a character at a time.
+ */
+static Spark_Coroutine_Status_TypeDef readLines(Coroutine& co) {
+    static std::string line;
+    CO_BEGIN(co);
+    line.clear();
+    while (1) {
+        CO_AWAIT(co, !input.empty());
+        char c = input.front();
+        input.pop_front();
+        if (c == '\n')
+            break;
+        line += c;
+    }
+    trace += "[" + line + "]";
+    CO_END(co);
+}
+
+static Spark_Coroutine_Status_TypeDef blink(Coroutine& co) {
+    CO_BEGIN(co);
+    while (1) {
+        trace += "on ";
+        CO_DELAY(co, 100);
+        trace += "off ";
+        CO_DELAY(co, 400);
+    }
+    CO_END(co);
+}
+
+SCENARIO("A coroutine waits for a condition without blocking", "[coroutine]") {
+    reset();
+    Coroutine co;
+    REQUIRE(readLines(co)==CO_WAITING);
+    REQUIRE(readLines(co)==CO_WAITING);
+
+    for (char c : std::string("hi"))
+        input.push_back(c);
+    REQUIRE(readLines(co)==CO_WAITING);
+    REQUIRE(trace=="");
+
+    input.push_back('\n');
+    REQUIRE(readLines(co)==CO_DONE);
+    REQUIRE(trace=="[hi]");
+    REQUIRE(co.done());
+
+    GIVEN("it is called again once done") {
+        input.push_back('\n');
+        REQUIRE(readLines(co)==CO_DONE);
+        REQUIRE(trace=="[hi]");
+    }
+    GIVEN("it is reset") {
+        co.reset();
+        input.push_back('x');
+        input.push_back('\n');
+        REQUIRE(readLines(co)==CO_DONE);
+        REQUIRE(trace=="[hi][x]");
+    }
+}
+
+SCENARIO("Coroutines delay concurrently", "[coroutine]") {
+    reset();
+    Coroutine blinker, reader;
+    for (now=0; now<1000; now++) {
+        blink(blinker);
+        readLines(reader);
+        if (now==250) {
+            input.push_back('a');
+            input.push_back('\n');
+        }
+    }
+    REQUIRE(trace=="on off [a]on off ");
+}
+
+static Spark_Coroutine_Status_TypeDef awaitWithTimeout(Coroutine& co) {
+    CO_BEGIN(co);
+    CO_AWAIT_TIMEOUT(co, !input.empty(), 50);
+    trace += co.timedOut() ? "timeout " : "data ";
+    CO_AWAIT_TIMEOUT(co, !input.empty(), 50);
+    trace += co.timedOut() ? "timeout " : "data ";
+    CO_END(co);
+}
+
+SCENARIO("A wait can time out", "[coroutine]") {
+    reset();
+    Coroutine co;
+    while (awaitWithTimeout(co)!=CO_DONE) {
+        now++;
+        if (now==80)
+            input.push_back('x');
+    }
+    REQUIRE(trace=="timeout data ");
+    REQUIRE(now==80);
+}
+
+static Spark_Coroutine_Status_TypeDef counter(Coroutine& co) {
+    static int i;
+    CO_BEGIN(co);
+    for (i=0; i<3; i++) {
+        trace += char('0' + i);
+        CO_YIELD(co);
+    }
+    CO_END(co);
+}
+
+static Coroutine child;
+
+static Spark_Coroutine_Status_TypeDef parent(Coroutine& co) {
+    CO_BEGIN(co);
+    trace += "<";
+    CO_AWAIT_CHILD(co, child, counter(child));
+    trace += "|";
+    CO_AWAIT_CHILD(co, child, counter(child));
+    trace += ">";
+    CO_END(co);
+}
+
+SCENARIO("A coroutine yields and waits for another", "[coroutine]") {
+    reset();
+    Coroutine co;
+    int calls = 0;
+    while (parent(co)!=CO_DONE)
+        calls++;
+    REQUIRE(trace=="<012|012>");
+    REQUIRE(calls==6);
+}
+
+static Spark_Coroutine_Status_TypeDef exitsEarly(Coroutine& co) {
+    CO_BEGIN(co);
+    trace += "a";
+    if (input.empty())
+        CO_EXIT(co);
+    trace += "b";
+    if (input.size() == 1)
+        CO_RESTART(co);
+    trace += "c";
+    CO_END(co);
+}
+
+SCENARIO("A coroutine can exit or restart", "[coroutine]") {
+    reset();
+    Coroutine co;
+    REQUIRE(exitsEarly(co)==CO_DONE);
+    REQUIRE(exitsEarly(co)==CO_DONE);
+    REQUIRE(trace=="a");
+
+    co.reset();
+    input.push_back('x');
+    REQUIRE(exitsEarly(co)==CO_YIELDED);
+    input.push_back('y');
+    REQUIRE(exitsEarly(co)==CO_DONE);
+    REQUIRE(trace=="aababc");
+}
+
+SCENARIO("A coroutine is small", "[coroutine]") {
+    REQUIRE(sizeof(Coroutine) <= 8);
+}
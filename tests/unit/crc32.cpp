@@ -0,0 +1,108 @@
+#include "catch.hpp"
+#include "spark_crc32.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+typedef uint32_t (*Update)(uint32_t crc, const void* data, size_t length);
+
+static uint32_t crc32_update_bitwise(uint32_t crc, const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (length--) {
+        crc ^= *p++;
+        for (int bit=0; bit<8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return crc;
+}
+
+static const struct {
+    const char* name;
+    Update update;
+} backends[] = {
+    { "hardware", crc32_update_hardware },
+    { "sliced", crc32_update_sliced },
+    { "nibble", crc32_update_nibble },
+    { "selected", crc32_update }
+};
+
+static std::vector<uint8_t> randomBytes(size_t length, unsigned seed) {
+    srand(seed);
+    std::vector<uint8_t> bytes(length);
+    for (auto& b : bytes)
+        b = uint8_t(rand());
+    return bytes;
+}
+
+SCENARIO("Every backend gives the standard check value", "[crc32]") {
+    const char* check = "123456789";
+    for (auto& backend : backends) {
+        INFO(backend.name);
+        REQUIRE(crc32_final(backend.update(crc32_init(), check, 9))==0xCBF43926);
+        REQUIRE(crc32_final(backend.update(crc32_init(), check, 0))==0);
+    }
+    REQUIRE(crc32_compute(check, 9)==0xCBF43926);
+}
+
+SCENARIO("Every backend agrees at every length and alignment", "[crc32]") {
+    std::vector<uint8_t> bytes = randomBytes(300, 1);
+    for (size_t offset=0; offset<8; offset++) {
+        for (size_t length=0; length+offset<=bytes.size(); length++) {
+            uint32_t expected = crc32_update_bitwise(0x12345678, &bytes[offset], length);
+            for (auto& backend : backends) {
+                INFO(backend.name << " offset " << offset << " length " << length);
+                REQUIRE(backend.update(0x12345678, &bytes[offset], length)==expected);
+            }
+        }
+    }
+}
+
+SCENARIO("A CRC carries from one update to the next", "[crc32]") {
+    std::vector<uint8_t> bytes = randomBytes(100, 2);
+    uint32_t whole = crc32_compute(bytes.data(), bytes.size());
+    for (auto& backend : backends) {
+        for (size_t split=0; split<=bytes.size(); split++) {
+            INFO(backend.name << " split " << split);
+            uint32_t crc = backend.update(crc32_init(), bytes.data(), split);
+            crc = backend.update(crc, bytes.data() + split, bytes.size() - split);
+            REQUIRE(crc32_final(crc)==whole);
+        }
+    }
+}
+
+SCENARIO("Backends can be mixed within one CRC", "[crc32]") {
+    std::vector<uint8_t> bytes = randomBytes(1000, 3);
+    uint32_t crc = crc32_init();
+    for (size_t i=0; i<bytes.size(); i+=37)
+        crc = backends[(i/37) % 3].update(crc, &bytes[i], std::min(size_t(37), bytes.size()-i));
+    REQUIRE(crc32_final(crc)==crc32_compute(bytes.data(), bytes.size()));
+}
+
+// run with: runner [benchmark]
+TEST_CASE("Benchmark CRC-32 backends", "[.][benchmark]") {
+    std::vector<uint8_t> bytes = randomBytes(64 * 1024, 4);
+    const struct {
+        const char* name;
+        Update update;
+        int rounds;
+    } runs[] = {
+        { "bitwise", crc32_update_bitwise, 20 },
+        { "nibble", crc32_update_nibble, 50 },
+        { "sliced", crc32_update_sliced, 500 },
+        { "hardware model", crc32_update_hardware, 5 }
+    };
+    for (auto& run : runs) {
+        uint32_t crc = crc32_init();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i=0; i<run.rounds; i++)
+            crc = run.update(crc, bytes.data(), bytes.size());
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end-start).count();
+        std::cout << run.name << ": " << (double(bytes.size()) * run.rounds / seconds / 1e6)
+                  << " MB/s (crc " << std::hex << crc << std::dec << ")" << std::endl;
+    }
+    std::cout << "sliced tables " << CRC32_SLICES << " KB, nibble table 64 bytes" << std::endl;
+}
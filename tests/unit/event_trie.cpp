@@ -0,0 +1,227 @@
+#include "catch.hpp"
+#include "spark_event_trie.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef EventTrie<64, 16> TestTrie;
+
+static std::vector<std::string> calls;
+
+void handlerA(const char* name, const char* data) {
+    calls.push_back(std::string("A:") + name + ":" + data);
+}
+
+void handlerB(const char* name, const char* data) {
+    calls.push_back(std::string("B:") + name + ":" + data);
+}
+
+void handlerC(const char* name, const char* data) {
+    calls.push_back(std::string("C:") + name + ":" + data);
+}
+
+SCENARIO("An empty trie calls no handlers", "[eventtrie]") {
+    TestTrie trie;
+    calls.clear();
+    REQUIRE(trie.dispatch("temperature", "21")==0);
+    REQUIRE(calls.empty());
+    REQUIRE(trie.find("temp", handlerA)==-1);
+}
+
+SCENARIO("A handler is called for events starting with its prefix", "[eventtrie]") {
+    TestTrie trie;
+    calls.clear();
+    int id = trie.add("temp", handlerA);
+    REQUIRE(id>=0);
+
+    REQUIRE(trie.dispatch("temp", "1")==1);
+    REQUIRE(trie.dispatch("temperature", "2")==1);
+    REQUIRE(trie.dispatch("tem", "3")==0);
+    REQUIRE(trie.dispatch("humidity", "4")==0);
+
+    REQUIRE(calls.size()==2);
+    REQUIRE(calls[0]=="A:temp:1");
+    REQUIRE(calls[1]=="A:temperature:2");
+    REQUIRE(trie.hits(id)==2);
+}
+
+SCENARIO("All matching handlers are called, shortest prefix first", "[eventtrie]") {
+    TestTrie trie;
+    calls.clear();
+    trie.add("home/kitchen", handlerC);
+    trie.add("home/", handlerB);
+    trie.add("home/kitchen", handlerA);
+    trie.add("home/garage", handlerA);
+
+    REQUIRE(trie.dispatch("home/kitchen/temp", "x")==3);
+    REQUIRE(calls.size()==3);
+    REQUIRE(calls[0]=="B:home/kitchen/temp:x");
+    REQUIRE(calls[1]=="C:home/kitchen/temp:x");
+    REQUIRE(calls[2]=="A:home/kitchen/temp:x");
+
+    calls.clear();
+    REQUIRE(trie.dispatch("home/garage", "y")==2);
+    REQUIRE(calls[0]=="B:home/garage:y");
+    REQUIRE(calls[1]=="A:home/garage:y");
+}
+
+SCENARIO("An empty prefix matches every event", "[eventtrie]") {
+    TestTrie trie;
+    calls.clear();
+    int id = trie.add("", handlerA);
+    REQUIRE(trie.dispatch("anything", "")==1);
+    REQUIRE(trie.dispatch("", "")==1);
+    REQUIRE(trie.hits(id)==2);
+}
+
+SCENARIO("Subscribing the same handler to the same prefix twice is one subscription", "[eventtrie]") {
+    TestTrie trie;
+    calls.clear();
+    int id = trie.add("door", handlerA);
+    REQUIRE(trie.add("door", handlerA)==id);
+    REQUIRE(trie.handler_count()==1);
+    REQUIRE(trie.dispatch("door/open", "")==1);
+    REQUIRE(trie.find("door", handlerA)==id);
+    REQUIRE(trie.find("door", handlerB)==-1);
+    REQUIRE(trie.find("doo", handlerA)==-1);
+}
+
+SCENARIO("Each subscription counts its own hits", "[eventtrie]") {
+    TestTrie trie;
+    int a = trie.add("a", handlerA);
+    int ab = trie.add("ab", handlerB);
+    calls.clear();
+    trie.dispatch("a", "");
+    trie.dispatch("ab", "");
+    trie.dispatch("abc", "");
+    trie.dispatch("b", "");
+    REQUIRE(trie.hits(a)==3);
+    REQUIRE(trie.hits(ab)==2);
+    REQUIRE(trie.hits(-1)==0);
+    REQUIRE(trie.hits(99)==0);
+}
+
+SCENARIO("A full trie refuses more subscriptions", "[eventtrie]") {
+    GIVEN("a trie with few nodes") {
+        EventTrie<4, 8> trie;
+        REQUIRE(trie.add("abc", handlerA)>=0);
+        REQUIRE(trie.add("abcd", handlerA)==-1);
+        REQUIRE(trie.add("ab", handlerB)>=0);
+    }
+    GIVEN("a trie with few handlers") {
+        EventTrie<16, 2> trie;
+        REQUIRE(trie.add("a", handlerA)>=0);
+        REQUIRE(trie.add("b", handlerA)>=0);
+        REQUIRE(trie.add("c", handlerA)==-1);
+    }
+}
+
+SCENARIO("A refused subscription takes no nodes", "[eventtrie]") {
+    GIVEN("a prefix longer than the nodes left") {
+        EventTrie<6, 8> trie;
+        REQUIRE(trie.add("ab", handlerA)>=0);
+        REQUIRE(trie.node_count_used()==3);
+        // 4 new nodes needed, 3 free
+        REQUIRE(trie.add("abcdef", handlerB)==-1);
+        REQUIRE(trie.node_count_used()==3);
+        // so the nodes left still fit a prefix that needs them all
+        REQUIRE(trie.add("xyz", handlerB)>=0);
+        REQUIRE(trie.node_count_used()==6);
+    }
+    GIVEN("no handlers left") {
+        EventTrie<16, 1> trie;
+        REQUIRE(trie.add("a", handlerA)>=0);
+        REQUIRE(trie.add("bcd", handlerB)==-1);
+        REQUIRE(trie.node_count_used()==2);
+        // an existing subscription is still found
+        REQUIRE(trie.add("a", handlerA)==0);
+    }
+    GIVEN("a pool filled by many refused subscriptions") {
+        EventTrie<8, 4> trie;
+        for (int i=0; i<100; i++) {
+            char prefix[16];
+            snprintf(prefix, sizeof(prefix), "event/%d/long", i);
+            REQUIRE(trie.add(prefix, handlerA)==-1);
+        }
+        REQUIRE(trie.node_count_used()==1);
+        REQUIRE(trie.add("short", handlerA)>=0);
+        calls.clear();
+        REQUIRE(trie.dispatch("shorter", "x")==1);
+    }
+}
+
+SCENARIO("Clearing the trie removes all subscriptions", "[eventtrie]") {
+    TestTrie trie;
+    trie.add("a", handlerA);
+    trie.clear();
+    calls.clear();
+    REQUIRE(trie.dispatch("a", "")==0);
+    REQUIRE(trie.handler_count()==0);
+    REQUIRE(trie.node_count_used()==1);
+}
+
+static int benchmark_hits;
+
+void countingHandler(const char*, const char*) {
+    benchmark_hits++;
+}
+
+struct Subscription {
+    char filter[64];
+    EventTrieHandler handler;
+};
+
+/**
+ * The protocol's matching: compare the name against every filter.
+ */
+int linearDispatch(const std::vector<Subscription>& subscriptions, const char* name, const char* data) {
+    int called = 0;
+    size_t length = strlen(name);
+    for (const Subscription& s : subscriptions) {
+        size_t filter_length = strnlen(s.filter, sizeof(s.filter));
+        if (length >= filter_length && !strncmp(name, s.filter, filter_length)) {
+            s.handler(name, data);
+            called++;
+        }
+    }
+    return called;
+}
+
+// run with: runner [benchmark]
+TEST_CASE("Benchmark trie dispatch against a linear filter scan", "[.][benchmark]") {
+    const int iterations = 200000;
+    for (int count : { 4, 50, 200, 500 }) {
+        EventTrie<4096, 512> trie;
+        std::vector<Subscription> subscriptions(count);
+        for (int i=0; i<count; i++) {
+            snprintf(subscriptions[i].filter, sizeof(subscriptions[i].filter), "fleet/site%03d/sensor%d", i % 97, i);
+            subscriptions[i].handler = countingHandler;
+            REQUIRE(trie.add(subscriptions[i].filter, countingHandler)>=0);
+        }
+        std::vector<std::string> names;
+        for (int i=0; i<64; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "fleet/site%03d/sensor%d/reading", (i*13) % 97, i*7);
+            names.push_back(name);
+        }
+
+        for (const std::string& name : names) {
+            REQUIRE(trie.dispatch(name.c_str(), "")==linearDispatch(subscriptions, name.c_str(), ""));
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int n=0; n<iterations; n++)
+            linearDispatch(subscriptions, names[n % names.size()].c_str(), "");
+        auto middle = std::chrono::high_resolution_clock::now();
+        for (int n=0; n<iterations; n++)
+            trie.dispatch(names[n % names.size()].c_str(), "");
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double linear = std::chrono::duration<double, std::nano>(middle-start).count()/iterations;
+        double trie_ns = std::chrono::duration<double, std::nano>(end-middle).count()/iterations;
+        std::cout << count << " subscriptions: linear " << linear << " ns, trie " << trie_ns << " ns" << std::endl;
+    }
+}
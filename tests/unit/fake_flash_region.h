@@ -0,0 +1,45 @@
+#ifndef FAKE_FLASH_REGION_H
+#define FAKE_FLASH_REGION_H
+
+#include "spark_flash_region.h"
+
+// the Flashee library pulls in the firmware headers when built for the core
+#undef SPARK
+#include "../libraries/unit-test/flashee-eeprom.h"
+
+inline Flashee::FlashDevice::~FlashDevice() {}
+
+/**
+ * Presents a Flashee fake device as the FlashRegion used by the firmware.
+ * Writes can be made to fail after a number of bytes to simulate power loss.
+ */
+class FakeFlashRegion : public FlashRegion {
+public:
+    Flashee::FakeFlashDevice device;
+    int bytesUntilPowerLoss;
+
+    FakeFlashRegion(uint32_t pages, uint32_t size) : device(pages, size), bytesUntilPowerLoss(-1) {
+        device.eraseAll();
+    }
+
+    virtual uint32_t pageSize() const { return device.pageSize(); }
+    virtual uint32_t pageCount() const { return device.pageCount(); }
+    virtual bool erasePage(uint32_t address) { return device.erasePage(address); }
+    virtual bool readPage(void* data, uint32_t address, uint32_t length) const {
+        return device.readPage(data, address, length);
+    }
+
+    virtual bool writePage(const void* data, uint32_t address, uint32_t length) {
+        if (bytesUntilPowerLoss >= 0) {
+            if (uint32_t(bytesUntilPowerLoss) < length) {
+                device.writePage(data, address, bytesUntilPowerLoss);
+                bytesUntilPowerLoss = 0;
+                return false;
+            }
+            bytesUntilPowerLoss -= length;
+        }
+        return device.writePage(data, address, length);
+    }
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "catch.hpp"
+#include "spark_firmware_writer.h"
+#include "fake_flash_region.h"
+
+#include <cstring>
+#include <vector>
+
+static std::vector<uint8_t> image;
+static uint32_t clock_micros;
+static uint16_t programmed_chunks;
+static int fail_chunk;
+static const uint32_t PROGRAM_MICROS = 3000;
+
+static uint32_t fakeClock() {
+    return clock_micros;
+}
+
+/**
+ * Programs like FLASH_Update(): the count only advances when the chunk verifies.
+ */
+static uint16_t fakeProgram(unsigned char* buf, uint32_t length) {
+    clock_micros += PROGRAM_MICROS;
+    if (fail_chunk == int(programmed_chunks))
+    {
+        fail_chunk = -1;
+        return programmed_chunks;
+    }
+    image.insert(image.end(), buf, buf + length);
+    return ++programmed_chunks;
+}
+
+static void reset(FirmwareWriter& writer) {
+    image.clear();
+    clock_micros = 1000;
+    programmed_chunks = 0;
+    fail_chunk = -1;
+    writer.begin();
+}
+
+SCENARIO("A saved chunk is programmed by the next service", "[firmwarewriter]") {
+    FirmwareWriter writer(fakeProgram, fakeClock);
+    reset(writer);
+    uint8_t chunk[4] = { 1, 2, 3, 4 };
+
+    writer.save(chunk, sizeof(chunk));
+    REQUIRE(writer.pending());
+    REQUIRE(image.empty());
+    REQUIRE(writer.saved()==1);
+
+    REQUIRE(writer.service());
+    REQUIRE(!writer.pending());
+    REQUIRE(image.size()==4);
+    REQUIRE(!writer.service());
+}
+
+SCENARIO("The chunk is copied, the protocol may reuse its buffer", "[firmwarewriter]") {
+    FirmwareWriter writer(fakeProgram, fakeClock);
+    reset(writer);
+    uint8_t chunk[4] = { 1, 2, 3, 4 };
+    writer.save(chunk, sizeof(chunk));
+    memset(chunk, 0, sizeof(chunk));
+    REQUIRE(writer.finish());
+    REQUIRE(image==std::vector<uint8_t>({ 1, 2, 3, 4 }));
+}
+
+SCENARIO("A chunk arriving before the previous one is programmed waits for it", "[firmwarewriter]") {
+    FirmwareWriter writer(fakeProgram, fakeClock);
+    reset(writer);
+    uint8_t a[2] = { 1, 2 }, b[2] = { 3, 4 };
+    writer.save(a, sizeof(a));
+    writer.save(b, sizeof(b));
+    REQUIRE(image==std::vector<uint8_t>({ 1, 2 }));
+    REQUIRE(writer.finish());
+    REQUIRE(image==std::vector<uint8_t>({ 1, 2, 3, 4 }));
+
+    Spark_Firmware_Write_Stats_TypeDef stats;
+    writer.stats(&stats);
+    REQUIRE(stats.stalls==1);
+    REQUIRE(stats.stall_micros==PROGRAM_MICROS);
+    REQUIRE(stats.program_micros==2*PROGRAM_MICROS);
+}
+
+SCENARIO("Chunks larger than the buffer are programmed directly", "[firmwarewriter]") {
+    FirmwareWriter writer(fakeProgram, fakeClock);
+    reset(writer);
+    std::vector<uint8_t> big(FIRMWARE_CHUNK_BUFFER_SIZE + 1, 0xAA);
+    uint8_t small[1] = { 0x55 };
+    writer.save(small, sizeof(small));
+    writer.save(big.data(), big.size());
+    REQUIRE(!writer.pending());
+    REQUIRE(image.size()==big.size() + 1);
+    REQUIRE(image[0]==0x55);
+}
+
+SCENARIO("The image CRC is updated as chunks arrive", "[firmwarewriter]") {
+    FirmwareWriter writer(fakeProgram, fakeClock);
+    reset(writer);
+    writer.save((const uint8_t*)"1234", 4);
+    writer.save((const uint8_t*)"56789", 5);
+
+    Spark_Firmware_Write_Stats_TypeDef stats;
+    writer.stats(&stats);
+    REQUIRE(stats.crc==0xCBF43926);
+    REQUIRE(stats.chunks==2);
+    REQUIRE(stats.bytes==9);
+}
+
+SCENARIO("A chunk that does not verify fails the image", "[firmwarewriter]") {
+    FirmwareWriter writer(fakeProgram, fakeClock);
+    reset(writer);
+    fail_chunk = 1;
+    uint8_t chunk[4] = { 0 };
+    writer.save(chunk, sizeof(chunk));
+    writer.save(chunk, sizeof(chunk));
+    writer.save(chunk, sizeof(chunk));
+    REQUIRE(!writer.finish());
+
+    Spark_Firmware_Write_Stats_TypeDef stats;
+    writer.stats(&stats);
+    REQUIRE(stats.failed>=1);
+}
+
+SCENARIO("Throughput covers the time from begin to the last chunk programmed", "[firmwarewriter]") {
+    FirmwareWriter writer(fakeProgram, fakeClock);
+    reset(writer);
+    std::vector<uint8_t> chunk(500, 0);
+    for (int i=0; i<4; i++) {
+        writer.save(chunk.data(), chunk.size());
+        // the next chunk takes 7ms to arrive, programming happens meanwhile
+        writer.service();
+        clock_micros += 7000 - PROGRAM_MICROS;
+    }
+    Spark_Firmware_Write_Stats_TypeDef stats;
+    writer.stats(&stats);
+    REQUIRE(stats.stalls==0);
+    REQUIRE(stats.elapsed_micros==3*7000 + PROGRAM_MICROS);
+    REQUIRE(stats.bytes_per_second==uint32_t(2000ull * 1000000 / stats.elapsed_micros));
+}
+
+SCENARIO("The image read back is checked against the CRC of the chunks saved", "[firmwarewriter]") {
+    FirmwareWriter writer(fakeProgram, fakeClock);
+    reset(writer);
+    writer.save((const uint8_t*)"1234", 4);
+    writer.save((const uint8_t*)"56789", 5);
+    writer.finish();
+
+    FakeFlashRegion flash(2, 8);
+    flash.writePage(image.data(), 0, 8);
+    flash.writePage(image.data() + 8, 8, 1);
+    REQUIRE(writer.verify(flash));
+
+    uint8_t zero = 0;
+    flash.writePage(&zero, 3, 1);
+    REQUIRE(!writer.verify(flash));
+}
@@ -0,0 +1,117 @@
+#include "catch.hpp"
+#include "spark_function_queue.h"
+
+#include <string>
+#include <vector>
+
+static std::vector<std::string> ran;
+static FunctionQueue* queueing;     // queued into by the function that runs
+static int queueWhileRunning;
+
+static void run(int index, const char* arg) {
+    while (queueWhileRunning > 0) {
+        queueWhileRunning--;
+        queueing->add(9, "again");
+    }
+    ran.push_back(std::to_string(index) + ":" + arg);
+}
+
+static void reset() {
+    ran.clear();
+    queueing = NULL;
+    queueWhileRunning = 0;
+}
+
+static Spark_Function_Queue_Stats_TypeDef statsOf(const FunctionQueue& queue) {
+    Spark_Function_Queue_Stats_TypeDef stats;
+    queue.stats(&stats);
+    return stats;
+}
+
+SCENARIO("An empty queue runs nothing", "[functionqueue]") {
+    reset();
+    FunctionQueue queue(run);
+    REQUIRE(queue.pending()==0);
+    REQUIRE_FALSE(queue.process());
+    REQUIRE(ran.empty());
+}
+
+SCENARIO("Calls run one at a time in the order they were queued", "[functionqueue]") {
+    reset();
+    FunctionQueue queue(run);
+    // many times round, so the queue wraps
+    for (int i=0; i<10; i++) {
+        REQUIRE(queue.add(i, "a"));
+        REQUIRE(queue.add(i+1, "b"));
+        REQUIRE(queue.process());
+        REQUIRE(queue.pending()==1);
+        REQUIRE(queue.process());
+    }
+    REQUIRE(ran.size()==20);
+    REQUIRE(ran[0]=="0:a");
+    REQUIRE(ran[1]=="1:b");
+    REQUIRE(ran[19]=="10:b");
+    REQUIRE(statsOf(queue).queued==20);
+}
+
+SCENARIO("Calls queued while the queue is full are dropped and counted", "[functionqueue]") {
+    reset();
+    FunctionQueue queue(run);
+    for (int i=0; i<USER_FUNC_QUEUE_DEPTH; i++)
+        REQUIRE(queue.add(i, ""));
+    REQUIRE_FALSE(queue.add(99, ""));
+    REQUIRE_FALSE(queue.add(99, ""));
+
+    Spark_Function_Queue_Stats_TypeDef stats = statsOf(queue);
+    REQUIRE(stats.queued==USER_FUNC_QUEUE_DEPTH);
+    REQUIRE(stats.dropped==2);
+    REQUIRE(stats.pending==USER_FUNC_QUEUE_DEPTH);
+
+    while (queue.process())
+        ;
+    REQUIRE(ran.size()==USER_FUNC_QUEUE_DEPTH);
+    REQUIRE(ran.back()==std::to_string(USER_FUNC_QUEUE_DEPTH-1) + ":");
+}
+
+SCENARIO("The high-water mark is the most calls ever waiting", "[functionqueue]") {
+    reset();
+    FunctionQueue queue(run);
+    queue.add(1, "");
+    queue.add(2, "");
+    queue.process();
+    queue.process();
+    queue.add(3, "");
+    Spark_Function_Queue_Stats_TypeDef stats = statsOf(queue);
+    REQUIRE(stats.high_water==2);
+    REQUIRE(stats.pending==1);
+}
+
+SCENARIO("Arguments are truncated to USER_FUNC_ARG_LENGTH", "[functionqueue]") {
+    reset();
+    FunctionQueue queue(run);
+    std::string arg(USER_FUNC_ARG_LENGTH + 10, 'x');
+    REQUIRE(queue.add(0, arg.c_str()));
+    REQUIRE(queue.process());
+    REQUIRE(ran[0]=="0:" + arg.substr(0, USER_FUNC_ARG_LENGTH));
+}
+
+SCENARIO("A call queued while another runs runs on a later pass", "[functionqueue]") {
+    reset();
+    FunctionQueue queue(run);
+    queueing = &queue;
+    for (int i=0; i<USER_FUNC_QUEUE_DEPTH; i++)
+        queue.add(i, "first");
+
+    // the running call's slot is free, so the queue takes one more call
+    // without disturbing the argument of the call running
+    queueWhileRunning = 2;
+    REQUIRE(queue.process());
+    REQUIRE(ran[0]=="0:first");
+    REQUIRE(queue.pending()==USER_FUNC_QUEUE_DEPTH);
+    REQUIRE(statsOf(queue).dropped==1);
+
+    while (queue.process())
+        ;
+    REQUIRE(ran.size()==USER_FUNC_QUEUE_DEPTH + 1);
+    REQUIRE(ran.back()=="9:again");
+}
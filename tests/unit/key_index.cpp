@@ -0,0 +1,130 @@
+#include "catch.hpp"
+#include "spark_key_index.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+const int KEY_LENGTH = 12;
+const int TABLE_SIZE = 64;
+
+static char keys[TABLE_SIZE][KEY_LENGTH];
+
+static const char* keyAt(int slot) {
+    return keys[slot];
+}
+
+typedef KeyIndex<TABLE_SIZE, KEY_LENGTH> TestIndex;
+
+/**
+ * Fills the key table with {@code count} keys and indexes them.
+ * Keys use the full 12 characters so they are not NUL terminated.
+ */
+void fillKeys(TestIndex& index, int count) {
+    index.clear();
+    memset(keys, 0, sizeof(keys));
+    for (int i=0; i<count; i++) {
+        char buf[KEY_LENGTH+1];
+        snprintf(buf, sizeof(buf), "sensor%06d", (i*7919) % 1000000);
+        memcpy(keys[i], buf, KEY_LENGTH);
+        REQUIRE(index.add(keys[i], i));
+    }
+}
+
+/**
+ * The lookup the index replaces.
+ */
+int linearFind(const char* key, int count) {
+    for (int i=0; i<count; i++) {
+        if (0 == strncmp(keys[i], key, KEY_LENGTH))
+            return i;
+    }
+    return -1;
+}
+
+SCENARIO("The bucket count is a power of two at least twice the capacity", "[keyindex]") {
+    REQUIRE(key_index_buckets(1)==4);
+    REQUIRE(key_index_buckets(4)==8);
+    REQUIRE(key_index_buckets(10)==32);
+    REQUIRE(key_index_buckets(16)==32);
+    REQUIRE(TestIndex::bucket_count==128);
+}
+
+SCENARIO("An empty index finds nothing", "[keyindex]") {
+    TestIndex index(keyAt);
+    REQUIRE(index.find("temperature")==-1);
+    REQUIRE(index.find("")==-1);
+}
+
+SCENARIO("Every indexed key is found at its slot", "[keyindex]") {
+    TestIndex index(keyAt);
+    fillKeys(index, TABLE_SIZE);
+    for (int i=0; i<TABLE_SIZE; i++) {
+        REQUIRE(index.find(keys[i])==i);
+    }
+}
+
+SCENARIO("Keys that are not indexed are not found", "[keyindex]") {
+    TestIndex index(keyAt);
+    fillKeys(index, TABLE_SIZE/2);
+    for (int i=TABLE_SIZE/2; i<TABLE_SIZE; i++) {
+        char buf[KEY_LENGTH+1];
+        snprintf(buf, sizeof(buf), "sensor%06d", (i*7919) % 1000000);
+        REQUIRE(index.find(buf)==-1);
+    }
+}
+
+SCENARIO("Keys compare only on the first 12 characters", "[keyindex]") {
+    TestIndex index(keyAt);
+    memset(keys, 0, sizeof(keys));
+    strcpy(keys[0], "temp");
+    memcpy(keys[1], "abcdefghijkl", KEY_LENGTH);
+    index.add(keys[0], 0);
+    index.add(keys[1], 1);
+
+    REQUIRE(index.find("temp")==0);
+    REQUIRE(index.find("tem")==-1);
+    REQUIRE(index.find("temp2")==-1);
+    REQUIRE(index.find("abcdefghijklmnop")==1);
+    REQUIRE(index.find("abcdefghijk")==-1);
+}
+
+SCENARIO("The index agrees with a linear scan", "[keyindex]") {
+    TestIndex index(keyAt);
+    fillKeys(index, 40);
+    for (int i=0; i<TABLE_SIZE; i++) {
+        char buf[KEY_LENGTH+1];
+        snprintf(buf, sizeof(buf), "sensor%06d", (i*7919) % 1000000);
+        REQUIRE(index.find(buf)==linearFind(buf, 40));
+    }
+}
+
+SCENARIO("A full index refuses more keys", "[keyindex]") {
+    KeyIndex<2, KEY_LENGTH> small(keyAt);
+    for (int i=0; i<small.bucket_count; i++) {
+        REQUIRE(small.add(keys[i], i));
+    }
+    REQUIRE(!small.add(keys[0], 0));
+}
+
+template <typename F> double nanosPerLookup(F lookup, int count, int iterations) {
+    volatile int found = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int n=0; n<iterations; n++) {
+        found += lookup(keys[n % count]);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(end-start).count()/iterations;
+}
+
+// run with: runner [benchmark]
+TEST_CASE("Benchmark hashed lookup against a linear scan", "[.][benchmark]") {
+    TestIndex index(keyAt);
+    const int iterations = 1000000;
+    for (int count : { 4, 10, 32, 64 }) {
+        fillKeys(index, count);
+        double linear = nanosPerLookup([=](const char* k) { return linearFind(k, count); }, count, iterations);
+        double hashed = nanosPerLookup([&](const char* k) { return index.find(k); }, count, iterations);
+        std::cout << count << " keys: linear " << linear << " ns, hashed " << hashed << " ns" << std::endl;
+    }
+}
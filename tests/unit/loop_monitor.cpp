@@ -0,0 +1,157 @@
+#include "catch.hpp"
+#include "spark_loop_monitor.h"
+
+#include <cstring>
+#include <string>
+
+static uint32_t now;
+
+static uint32_t virtualMicros() {
+    return now;
+}
+
+static uint32_t virtualMillis() {
+    return now / 1000;
+}
+
+static uint32_t read32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+SCENARIO("Times go into log2 buckets", "[loopmonitor]") {
+    REQUIRE(LoopMonitor::bucket(0)==0);
+    REQUIRE(LoopMonitor::bucket(1)==0);
+    REQUIRE(LoopMonitor::bucket(2)==1);
+    REQUIRE(LoopMonitor::bucket(3)==1);
+    REQUIRE(LoopMonitor::bucket(1000)==9);
+    REQUIRE(LoopMonitor::bucket(1024)==10);
+    REQUIRE(LoopMonitor::bucket(UINT32_MAX)==LOOP_MONITOR_BUCKETS-1);
+}
+
+SCENARIO("Iterations and loop() periods are counted", "[loopmonitor]") {
+    now = 0;
+    LoopMonitor monitor(virtualMicros, virtualMillis);
+    for (int i=0; i<10; i++) {
+        monitor.iteration();
+        monitor.userLoop();
+        now += 100;
+    }
+    REQUIRE(monitor.iterations(LoopMonitor::bucket(100))==9);
+    REQUIRE(monitor.periods(LoopMonitor::bucket(100))==9);
+
+    monitor.reset();
+    REQUIRE(monitor.iterations(LoopMonitor::bucket(100))==0);
+}
+
+SCENARIO("The worst period names the subsystem that took most of it", "[loopmonitor]") {
+    now = 5000000;
+    LoopMonitor monitor(virtualMicros, virtualMillis);
+    monitor.userLoop();
+
+    // a normal pass: a little WLAN work
+    now += 100;
+    Spark_Loop_Subsystem_TypeDef previous = monitor.enter(LOOP_SUBSYSTEM_WLAN);
+    now += 200;
+    monitor.leave(previous);
+    monitor.userLoop();
+    REQUIRE(monitor.worst().period_micros==300);
+    REQUIRE(monitor.worst().subsystem==LOOP_SUBSYSTEM_WLAN);
+
+    // a long pass: the WLAN loop runs a handshake
+    {
+        LoopMonitorScope wlan(monitor, LOOP_SUBSYSTEM_WLAN);
+        now += 1000;
+        {
+            LoopMonitorScope handshake(monitor, LOOP_SUBSYSTEM_HANDSHAKE);
+            now += 400000;
+        }
+        now += 2000;
+    }
+    now += 50;
+    monitor.userLoop();
+
+    const Spark_Loop_Worst_TypeDef& worst = monitor.worst();
+    REQUIRE(worst.period_micros==403050);
+    REQUIRE(worst.subsystem==LOOP_SUBSYSTEM_HANDSHAKE);
+    REQUIRE(worst.subsystem_micros==400000);
+    REQUIRE(worst.at_millis==(5000000 + 300 + 403050) / 1000);
+
+    // a shorter pass doesn't replace it
+    now += 1000;
+    monitor.userLoop();
+    REQUIRE(monitor.worst().subsystem==LOOP_SUBSYSTEM_HANDSHAKE);
+}
+
+SCENARIO("A slow loop() is blamed on no subsystem", "[loopmonitor]") {
+    now = 0;
+    LoopMonitor monitor(virtualMicros, virtualMillis);
+    monitor.userLoop();
+    now += 100;
+    {
+        LoopMonitorScope delay(monitor, LOOP_SUBSYSTEM_DELAY);
+        now += 30;
+    }
+    now += 5000;
+    monitor.userLoop();
+    REQUIRE(monitor.worst().subsystem==LOOP_SUBSYSTEM_NONE);
+    REQUIRE(monitor.worst().subsystem_micros==5100);
+}
+
+SCENARIO("Periods are measured across the wrap of the clock", "[loopmonitor]") {
+    now = UINT32_MAX - 10;
+    LoopMonitor monitor(virtualMicros, virtualMillis);
+    monitor.userLoop();
+    now += 40;
+    monitor.userLoop();
+    REQUIRE(monitor.worst().period_micros==40);
+}
+
+SCENARIO("The blob and its hex report hold the histograms and worst period", "[loopmonitor]") {
+    now = 0;
+    LoopMonitor monitor(virtualMicros, virtualMillis);
+    monitor.iteration();
+    monitor.userLoop();
+    now += 3000;
+    monitor.iteration();
+    {
+        LoopMonitorScope ota(monitor, LOOP_SUBSYSTEM_OTA);
+        now += 4000;
+    }
+    monitor.userLoop();
+
+    uint8_t blob[LOOP_MONITOR_BLOB_LENGTH];
+    REQUIRE(monitor.serialize(blob, sizeof(blob) - 1)==0);
+    REQUIRE(monitor.serialize(blob, sizeof(blob))==LOOP_MONITOR_BLOB_LENGTH);
+    REQUIRE(blob[0]==LOOP_MONITOR_BLOB_VERSION);
+    REQUIRE(blob[1]==LOOP_MONITOR_BUCKETS);
+
+    const uint8_t* iterations = blob + 2;
+    const uint8_t* periods = iterations + 2 * LOOP_MONITOR_BUCKETS;
+    REQUIRE(iterations[2 * LoopMonitor::bucket(3000)]==1);
+    REQUIRE(periods[2 * LoopMonitor::bucket(7000)]==1);
+
+    const uint8_t* totals = periods + 2 * LOOP_MONITOR_BUCKETS;
+    REQUIRE(read32(totals)==2);
+    REQUIRE(read32(totals + 4)==2);
+    REQUIRE(read32(totals + 8)==3000);
+    REQUIRE(read32(totals + 12)==7000);
+    REQUIRE(read32(totals + 16)==4000);
+    REQUIRE(read32(totals + 20)==7);
+    REQUIRE(totals[24]==LOOP_SUBSYSTEM_OTA);
+
+    char hex[2 * LOOP_MONITOR_BLOB_LENGTH + 1];
+    REQUIRE(monitor.report(hex, sizeof(hex) - 1)==0);
+    REQUIRE(monitor.report(hex, sizeof(hex))==2 * LOOP_MONITOR_BLOB_LENGTH);
+    REQUIRE(std::string(hex, 4)=="0114");
+    REQUIRE(strlen(hex)==2 * LOOP_MONITOR_BLOB_LENGTH);
+}
+
+SCENARIO("Counts saturate", "[loopmonitor]") {
+    now = 0;
+    LoopMonitor monitor(virtualMicros, virtualMillis);
+    for (int i=0; i<70000; i++) {
+        monitor.iteration();
+        now += 10;
+    }
+    REQUIRE(monitor.iterations(LoopMonitor::bucket(10))==UINT16_MAX);
+}
@@ -0,0 +1,237 @@
+#include "catch.hpp"
+#include "spark_lzss.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes output;
+static bool writeFails;
+
+static bool writeOutput(const uint8_t* data, size_t length) {
+    if (writeFails)
+        return false;
+    output.insert(output.end(), data, data + length);
+    return true;
+}
+
+static void put32(Bytes& out, uint32_t v) {
+    for (int i=0; i<4; i++)
+        out.push_back(uint8_t(v >> (8*i)));
+}
+
+static uint32_t crc(const Bytes& b) {
+    uint32_t c = 0xFFFFFFFF;
+    for (uint8_t byte : b) {
+        c ^= byte;
+        for (int bit=0; bit<8; bit++)
+            c = (c >> 1) ^ (0xEDB88320 & -(c & 1));
+    }
+    return ~c;
+}
+
+/**
+ * A reference compressor: greedy longest match over the window.
+ */
+static Bytes compress(const Bytes& in, int windowBits = LZSS_WINDOW_BITS) {
+    const int window = 1 << windowBits;
+    const int maxMatch = (1 << (16 - windowBits)) - 1 + LZSS_MIN_MATCH;
+    Bytes out;
+    put32(out, LZSS_MAGIC);
+    put32(out, in.size());
+    put32(out, crc(in));
+    out.push_back(uint8_t(windowBits));
+    out.push_back(0); out.push_back(0); out.push_back(0);
+
+    size_t pos = 0, flagIndex = 0;
+    int items = 8;
+    while (pos < in.size()) {
+        if (items == 8) {
+            flagIndex = out.size();
+            out.push_back(0);
+            items = 0;
+        }
+        int bestLength = 0, bestDistance = 0;
+        for (int distance = 1; distance <= window && size_t(distance) <= pos; distance++) {
+            int length = 0;
+            while (length < maxMatch && pos + length < in.size() && in[pos + length]==in[pos + length - distance])
+                length++;
+            if (length > bestLength) {
+                bestLength = length;
+                bestDistance = distance;
+                if (length == maxMatch)
+                    break;
+            }
+        }
+        if (bestLength >= LZSS_MIN_MATCH) {
+            uint16_t match = ((bestDistance - 1) << (16 - windowBits)) | (bestLength - LZSS_MIN_MATCH);
+            out.push_back(uint8_t(match >> 8));
+            out.push_back(uint8_t(match));
+            pos += bestLength;
+        }
+        else {
+            out[flagIndex] |= 1 << items;
+            out.push_back(in[pos++]);
+        }
+        items++;
+    }
+    return out;
+}
+
+/**
+ * Something like firmware: repeated instruction patterns and address tables.
+ */
+static Bytes makeImage(size_t length, unsigned seed) {
+    srand(seed);
+    Bytes image;
+    while (image.size() < length) {
+        switch (rand() % 3) {
+            case 0:
+                put32(image, 0x08005000 + (rand() % 0x10000) * 4);
+                break;
+            case 1: {
+                static const uint8_t prologue[] = { 0x2d, 0xe9, 0xf0, 0x41, 0x04, 0x46, 0x0d, 0x46 };
+                image.insert(image.end(), prologue, prologue + sizeof(prologue));
+                break;
+            }
+            default:
+                image.push_back(uint8_t(rand()));
+                image.push_back(uint8_t(rand() % 8));
+        }
+    }
+    image.resize(length);
+    return image;
+}
+
+static Spark_Lzss_Status_TypeDef inflateInPieces(LzssDecoder& decoder, const Bytes& in, size_t piece) {
+    Spark_Lzss_Status_TypeDef status = LZSS_OK;
+    for (size_t i=0; i<in.size() && status==LZSS_OK; i+=piece)
+        status = decoder.inflate(in.data() + i, std::min(piece, in.size() - i));
+    return status;
+}
+
+static void reset() {
+    output.clear();
+    writeFails = false;
+}
+
+SCENARIO("A compressed image inflates to the original", "[lzss]") {
+    Bytes image = makeImage(20000, 1);
+    Bytes compressed = compress(image);
+    INFO("compressed " << image.size() << " to " << compressed.size());
+    REQUIRE(compressed.size() < image.size() * 3 / 4);
+
+    for (size_t piece : { size_t(1), size_t(3), size_t(512), compressed.size() }) {
+        reset();
+        LzssDecoder decoder(writeOutput);
+        REQUIRE(inflateInPieces(decoder, compressed, piece)==LZSS_DONE);
+        REQUIRE(output==image);
+        REQUIRE(decoder.written()==image.size());
+    }
+}
+
+SCENARIO("Smaller windows and odd lengths", "[lzss]") {
+    for (int bits : { 4, 8, LZSS_WINDOW_BITS }) {
+        for (size_t length : { size_t(0), size_t(1), size_t(511), size_t(512), size_t(513), size_t(LZSS_WINDOW_SIZE * 3 + 7) }) {
+            Bytes image = makeImage(length, unsigned(length + bits));
+            reset();
+            LzssDecoder decoder(writeOutput);
+            REQUIRE(inflateInPieces(decoder, compress(image, bits), 64)==LZSS_DONE);
+            REQUIRE(output==image);
+        }
+    }
+}
+
+SCENARIO("A run longer than its distance repeats", "[lzss]") {
+    Bytes image(300, 0xAB);
+    Bytes compressed = compress(image);
+    REQUIRE(compressed.size() < 30);
+    reset();
+    LzssDecoder decoder(writeOutput);
+    REQUIRE(decoder.inflate(compressed.data(), compressed.size())==LZSS_DONE);
+    REQUIRE(output==image);
+}
+
+SCENARIO("Only a compressed image starts with the magic", "[lzss]") {
+    Bytes compressed = compress(Bytes(10, 1));
+    REQUIRE(LzssDecoder::isCompressed(compressed.data(), compressed.size()));
+    Bytes image = makeImage(16, 2);
+    image[0] = 0x00; image[1] = 0x50; image[2] = 0x00; image[3] = 0x20;
+    REQUIRE(!LzssDecoder::isCompressed(image.data(), image.size()));
+}
+
+SCENARIO("Corrupt streams are refused", "[lzss]") {
+    Bytes image = makeImage(3000, 3);
+    Bytes compressed = compress(image);
+    reset();
+    LzssDecoder decoder(writeOutput);
+
+    GIVEN("data that is not compressed") {
+        REQUIRE(decoder.inflate(image.data(), image.size())==LZSS_BAD_HEADER);
+    }
+    GIVEN("a window larger than the decoder's") {
+        compressed[12] = LZSS_WINDOW_BITS + 1;
+        REQUIRE(decoder.inflate(compressed.data(), compressed.size())==LZSS_BAD_HEADER);
+    }
+    GIVEN("an image larger than the OTA region") {
+        Bytes bad(compressed.begin(), compressed.begin() + 4);
+        put32(bad, LZSS_IMAGE_LENGTH_MAX + 1);
+        bad.insert(bad.end(), compressed.begin() + 8, compressed.end());
+        REQUIRE(decoder.inflate(bad.data(), bad.size())==LZSS_BAD_HEADER);
+        REQUIRE(decoder.written()==0);
+    }
+    GIVEN("a match before the start of the image") {
+        Bytes bad(compressed.begin(), compressed.begin() + LZSS_HEADER_LENGTH);
+        bad.push_back(0);       // a match first
+        bad.push_back(0x10);
+        bad.push_back(0x00);
+        REQUIRE(decoder.inflate(bad.data(), bad.size())==LZSS_BAD_DATA);
+    }
+    GIVEN("a corrupted literal") {
+        Bytes bad = compressed;
+        bad[bad.size()-1] ^= 0x01;
+        Spark_Lzss_Status_TypeDef status = decoder.inflate(bad.data(), bad.size());
+        REQUIRE(status!=LZSS_DONE);
+        REQUIRE(status!=LZSS_OK);
+    }
+    GIVEN("a writer that fails") {
+        writeFails = true;
+        REQUIRE(decoder.inflate(compressed.data(), compressed.size())==LZSS_WRITE_FAILED);
+    }
+    GIVEN("a stream that stops early") {
+        REQUIRE(decoder.inflate(compressed.data(), compressed.size() / 2)==LZSS_OK);
+        REQUIRE(decoder.status()==LZSS_OK);
+    }
+}
+
+// run with: runner [benchmark]
+TEST_CASE("Benchmark inflating firmware-like and machine code images", "[.][benchmark]") {
+    std::ifstream self("/proc/self/exe", std::ios::binary);
+    Bytes code((std::istreambuf_iterator<char>(self)), std::istreambuf_iterator<char>());
+    code.resize(std::min(code.size(), size_t(110 * 1024)));
+
+    std::cout << "decoder RAM " << sizeof(LzssDecoder) << " bytes" << std::endl;
+    for (auto sample : { std::make_pair("firmware-like", makeImage(110 * 1024, 4)), std::make_pair("machine code", code) }) {
+        const Bytes& image = sample.second;
+        Bytes compressed = compress(image);
+        LzssDecoder decoder(writeOutput);
+        const int rounds = 20;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i=0; i<rounds; i++) {
+            reset();
+            decoder.begin();
+            REQUIRE(inflateInPieces(decoder, compressed, 512)==LZSS_DONE);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end-start).count() / rounds;
+        std::cout << sample.first << ": " << image.size() << " -> " << compressed.size() << " bytes ("
+                  << (100.0 * compressed.size() / image.size()) << "%), "
+                  << (image.size() / seconds / 1e6) << " MB/s" << std::endl;
+    }
+}
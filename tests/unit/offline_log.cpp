@@ -0,0 +1,233 @@
+#include "catch.hpp"
+#include "spark_offline_log.h"
+#include "fake_flash_region.h"
+
+#include <string>
+#include <vector>
+
+static std::string eventName(int i) {
+    return "event" + std::to_string(i);
+}
+
+static void appendEvents(OfflineLog& log, int from, int to) {
+    for (int i=from; i<to; i++) {
+        REQUIRE(log.append(eventName(i).c_str(), std::to_string(i*10).c_str(), 60, false));
+    }
+}
+
+static void requireReplay(OfflineLog& log, int from, int to) {
+    OfflineEvent event;
+    for (int i=from; i<to; i++) {
+        REQUIRE(log.peek(event));
+        REQUIRE(std::string(event.name)==eventName(i));
+        REQUIRE(std::string(event.data)==std::to_string(i*10));
+        log.consume();
+    }
+}
+
+SCENARIO("An empty log has nothing to replay", "[offlinelog]") {
+    FakeFlashRegion flash(4, 512);
+    OfflineLog log(flash);
+    log.begin();
+    OfflineEvent event;
+    REQUIRE(log.pending()==0);
+    REQUIRE(!log.peek(event));
+}
+
+SCENARIO("Events are replayed in the order they were stored", "[offlinelog]") {
+    FakeFlashRegion flash(4, 512);
+    OfflineLog log(flash);
+    log.begin();
+    REQUIRE(log.append("temp", "21", 30, true));
+    REQUIRE(log.append("motion", NULL, 60, false));
+    REQUIRE(log.pending()==2);
+
+    OfflineEvent event;
+    REQUIRE(log.peek(event));
+    REQUIRE(std::string(event.name)=="temp");
+    REQUIRE(std::string(event.data)=="21");
+    REQUIRE(event.hasData);
+    REQUIRE(event.isPrivate);
+    REQUIRE(event.ttl==30);
+    log.consume();
+
+    REQUIRE(log.peek(event));
+    REQUIRE(std::string(event.name)=="motion");
+    REQUIRE(!event.hasData);
+    REQUIRE(!event.isPrivate);
+    log.consume();
+
+    REQUIRE(!log.peek(event));
+    REQUIRE(log.pending()==0);
+}
+
+SCENARIO("Records span pages in sequence", "[offlinelog]") {
+    FakeFlashRegion flash(4, 256);
+    OfflineLog log(flash);
+    log.begin();
+    appendEvents(log, 0, 20);
+    REQUIRE(log.pending()==20);
+    requireReplay(log, 0, 20);
+}
+
+SCENARIO("The log is recovered after a reset", "[offlinelog]") {
+    FakeFlashRegion flash(4, 256);
+    {
+        OfflineLog log(flash);
+        log.begin();
+        appendEvents(log, 0, 15);
+        requireReplay(log, 0, 5);
+    }
+
+    OfflineLog log(flash);
+    log.begin();
+    REQUIRE(log.pending()==10);
+    requireReplay(log, 5, 10);
+
+    // appends continue after the recovered write position
+    appendEvents(log, 15, 18);
+    OfflineLog again(flash);
+    again.begin();
+    REQUIRE(again.pending()==8);
+    requireReplay(again, 10, 18);
+}
+
+SCENARIO("A full log overwrites the oldest page", "[offlinelog]") {
+    FakeFlashRegion flash(4, 256);
+    OfflineLog log(flash);
+    log.begin();
+    appendEvents(log, 0, 100);
+
+    Spark_Offline_Log_Stats_TypeDef stats;
+    log.stats(&stats);
+    REQUIRE(stats.stored==100);
+    REQUIRE(stats.overwritten>0);
+    REQUIRE((stats.pending+stats.overwritten)==100);
+
+    // the newest events survive, in order, and also after a reset
+    int first = stats.overwritten;
+    OfflineLog recovered(flash);
+    recovered.begin();
+    REQUIRE(recovered.pending()==stats.pending);
+    requireReplay(recovered, first, 100);
+}
+
+SCENARIO("Replay continues after the oldest page is overwritten", "[offlinelog]") {
+    FakeFlashRegion flash(4, 256);
+    OfflineLog log(flash);
+    log.begin();
+    appendEvents(log, 0, 10);
+    requireReplay(log, 0, 2);
+    appendEvents(log, 10, 40);
+
+    Spark_Offline_Log_Stats_TypeDef stats;
+    log.stats(&stats);
+    REQUIRE((stats.pending+stats.overwritten+2)==40);
+    requireReplay(log, 40-stats.pending, 40);
+    REQUIRE(log.pending()==0);
+}
+
+SCENARIO("A record torn by power loss is skipped", "[offlinelog]") {
+    FakeFlashRegion flash(4, 256);
+    {
+        OfflineLog log(flash);
+        log.begin();
+        appendEvents(log, 0, 3);
+        flash.bytesUntilPowerLoss = 10;
+        REQUIRE(!log.append("lost", "data", 60, false));
+    }
+
+    flash.bytesUntilPowerLoss = -1;
+    OfflineLog log(flash);
+    log.begin();
+    REQUIRE(log.pending()==3);
+
+    Spark_Offline_Log_Stats_TypeDef stats;
+    log.stats(&stats);
+    REQUIRE(stats.corrupt==1);
+
+    // new records go to the next page
+    appendEvents(log, 3, 5);
+    requireReplay(log, 0, 5);
+
+    OfflineLog again(flash);
+    again.begin();
+    REQUIRE(again.pending()==0);
+}
+
+SCENARIO("Names and data are truncated to what can be published", "[offlinelog]") {
+    FakeFlashRegion flash(4, 512);
+    OfflineLog log(flash);
+    log.begin();
+    std::string name(100, 'n');
+    std::string data(100, 'd');
+    REQUIRE(log.append(name.c_str(), data.c_str(), 60, false));
+    OfflineEvent event;
+    REQUIRE(log.peek(event));
+    REQUIRE(strlen(event.name)==PUBLISH_NAME_LENGTH-1);
+    REQUIRE(strlen(event.data)==PUBLISH_DATA_LENGTH-1);
+}
+
+static int sendFailures;
+static std::vector<std::string> published;
+
+static bool fakeSend(const char* name, const char*, int, bool) {
+    if (sendFailures > 0) {
+        sendFailures--;
+        return false;
+    }
+    published.push_back(name);
+    return true;
+}
+
+SCENARIO("A replayed event stays in the log until it is sent", "[offlinelog]") {
+    FakeFlashRegion flash(4, 512);
+    OfflineLog log(flash);
+    log.begin();
+    appendEvents(log, 0, 2);
+    PublishQueue queue(fakeSend);
+    published.clear();
+    sendFailures = 1;
+
+    // the first send fails: the event waits in the queue and in the log
+    REQUIRE(log.replay(queue));
+    REQUIRE(queue.drain(0)==0);
+    REQUIRE_FALSE(log.replay(queue));
+    REQUIRE(log.pending()==2);
+
+    // a reset now replays it again
+    OfflineLog afterReset(flash);
+    afterReset.begin();
+    REQUIRE(afterReset.pending()==2);
+
+    // once it is sent it is marked replayed, and the next one is queued
+    REQUIRE(queue.drain(1000)==1);
+    REQUIRE(log.replay(queue));
+    REQUIRE(log.pending()==1);
+    REQUIRE(queue.drain(2000)==1);
+    REQUIRE_FALSE(log.replay(queue));
+    REQUIRE(log.pending()==0);
+    REQUIRE(published==std::vector<std::string>({ eventName(0), eventName(1) }));
+
+    afterReset.begin();
+    REQUIRE(afterReset.pending()==0);
+}
+
+SCENARIO("A replayed event the queue lost is replayed again", "[offlinelog]") {
+    FakeFlashRegion flash(4, 512);
+    OfflineLog log(flash);
+    log.begin();
+    appendEvents(log, 0, 1);
+    PublishQueue queue(fakeSend);
+    published.clear();
+    sendFailures = 0;
+
+    REQUIRE(log.replay(queue));
+    queue.clear();
+    REQUIRE(log.replay(queue));
+    REQUIRE(log.pending()==1);
+    REQUIRE(queue.drain(0)==1);
+    REQUIRE_FALSE(log.replay(queue));
+    REQUIRE(log.pending()==0);
+    REQUIRE(published.size()==1);
+}
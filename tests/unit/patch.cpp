@@ -0,0 +1,337 @@
+#include "catch.hpp"
+#include "spark_patch.h"
+#include "spark_crc32.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes source;
+static Bytes target;
+static bool writeFails;
+
+static bool readSource(uint8_t* data, uint32_t offset, uint32_t length) {
+    if (uint64_t(offset) + length > source.size())
+        return false;
+    memcpy(data, source.data() + offset, length);
+    return true;
+}
+
+static bool writeTarget(const uint8_t* data, size_t length) {
+    if (writeFails)
+        return false;
+    target.insert(target.end(), data, data + length);
+    return true;
+}
+
+static void put32(Bytes& out, uint32_t v) {
+    for (int i=0; i<4; i++)
+        out.push_back(uint8_t(v >> (8*i)));
+}
+
+static void putVarint(Bytes& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+static void putOffset(Bytes& out, int32_t delta) {
+    putVarint(out, (uint32_t(delta) << 1) ^ uint32_t(delta >> 31));
+}
+
+static uint32_t crc(const Bytes& b) {
+    return crc32_compute(b.data(), b.size());
+}
+
+static Bytes header(const Bytes& from, const Bytes& to) {
+    Bytes out;
+    put32(out, PATCH_MAGIC);
+    put32(out, from.size());
+    put32(out, crc(from));
+    put32(out, to.size());
+    put32(out, crc(to));
+    return out;
+}
+
+/**
+ * A small reference diff: exact matches found through a hash of 8 byte
+ * blocks become COPY, and short edits between two matches that stay lined
+ * up with the source become ADD, so the source position needs no new offset.
+ * Everything else is DATA.
+ */
+static Bytes makePatch(const Bytes& from, const Bytes& to) {
+    const size_t BLOCK = 8;
+    const size_t MAX_EDIT = 32;
+    std::multimap<uint64_t, size_t> index;
+    for (size_t i=0; i+BLOCK<=from.size(); i++) {
+        uint64_t key;
+        memcpy(&key, &from[i], BLOCK);
+        index.insert(std::make_pair(key, i));
+    }
+
+    Bytes out = header(from, to);
+    Bytes literal;
+    uint32_t sourcePosition = 0;
+    size_t pos = 0;
+
+    auto flushLiteral = [&]() {
+        if (literal.empty())
+            return;
+        out.push_back(3);
+        putVarint(out, literal.size());
+        out.insert(out.end(), literal.begin(), literal.end());
+        literal.clear();
+    };
+    auto matching = [&](size_t t, size_t s) {
+        size_t length = 0;
+        while (s + length < from.size() && t + length < to.size() && from[s+length]==to[t+length])
+            length++;
+        return length;
+    };
+    auto copy = [&](size_t length, size_t start) {
+        out.push_back(1);
+        putVarint(out, length);
+        putOffset(out, int32_t(start) - int32_t(sourcePosition));
+        sourcePosition = start + length;
+        pos += length;
+    };
+
+    while (pos < to.size()) {
+        size_t bestLength = 0, bestStart = 0;
+        if (pos + BLOCK <= to.size()) {
+            uint64_t key;
+            memcpy(&key, &to[pos], BLOCK);
+            auto range = index.equal_range(key);
+            int candidates = 0;
+            for (auto it = range.first; it != range.second && candidates < 16; ++it, ++candidates) {
+                size_t length = matching(pos, it->second);
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestStart = it->second;
+                }
+            }
+        }
+        if (bestLength < BLOCK) {
+            literal.push_back(to[pos++]);
+            continue;
+        }
+
+        flushLiteral();
+        copy(bestLength, bestStart);
+
+        // follow edits that leave the rest of the code where it was
+        for (;;) {
+            size_t edit = 1;
+            while (edit <= MAX_EDIT && matching(pos + edit, sourcePosition + edit) < BLOCK)
+                edit++;
+            if (edit > MAX_EDIT || pos + edit >= to.size())
+                break;
+            out.push_back(2);
+            putVarint(out, edit);
+            putOffset(out, 0);
+            for (size_t i=0; i<edit; i++)
+                out.push_back(uint8_t(to[pos+i] - from[sourcePosition+i]));
+            sourcePosition += edit;
+            pos += edit;
+            copy(matching(pos, sourcePosition), sourcePosition);
+        }
+    }
+    flushLiteral();
+    out.push_back(0);
+    return out;
+}
+
+/**
+ * Something like firmware: 32-bit words, many of them addresses into the image.
+ */
+static Bytes makeImage(size_t words, unsigned seed) {
+    srand(seed);
+    Bytes image;
+    for (size_t i=0; i<words; i++) {
+        uint32_t word = (rand() % 4) ? uint32_t(rand()) : 0x08005000 + (rand() % (words*4));
+        put32(image, word);
+    }
+    return image;
+}
+
+/**
+ * The next release: a function inserted near the end, where application
+ * code is linked, so the code after it moves and the addresses pointing
+ * past it change, plus a few edits.
+ */
+static Bytes makeRelease(const Bytes& base, size_t insertAt, size_t inserted) {
+    Bytes next(base.begin(), base.begin() + insertAt);
+    for (size_t i=0; i<inserted; i++)
+        next.push_back(uint8_t(rand()));
+    next.insert(next.end(), base.begin() + insertAt, base.end());
+    for (size_t i=0; i+4<=next.size(); i+=4) {
+        uint32_t word = next[i] | (next[i+1]<<8) | (next[i+2]<<16) | (uint32_t(next[i+3])<<24);
+        if (word >= 0x08005000 + insertAt && word < 0x08005000 + base.size()) {
+            word += inserted;
+            for (int b=0; b<4; b++)
+                next[i+b] = uint8_t(word >> (8*b));
+        }
+    }
+    next[100] ^= 0x5A;
+    next[next.size()-7] = 0;
+    return next;
+}
+
+static Spark_Patch_Status_TypeDef applyInPieces(PatchApplier& applier, const Bytes& patch, size_t piece) {
+    Spark_Patch_Status_TypeDef status = PATCH_OK;
+    for (size_t i=0; i<patch.size() && status==PATCH_OK; i+=piece)
+        status = applier.apply(patch.data() + i, std::min(piece, patch.size() - i));
+    return status;
+}
+
+static void reset() {
+    target.clear();
+    writeFails = false;
+}
+
+SCENARIO("A patch rebuilds the next release from the running image", "[patch]") {
+    source = makeImage(6000, 1);
+    Bytes next = makeRelease(source, 20000, 372);
+    Bytes patch = makePatch(source, next);
+    INFO("patch " << patch.size() << " bytes for an image of " << next.size());
+    REQUIRE(patch.size() < next.size() / 5);
+
+    for (size_t piece : { size_t(1), size_t(7), size_t(512), patch.size() }) {
+        reset();
+        PatchApplier applier(readSource, writeTarget);
+        REQUIRE(applyInPieces(applier, patch, piece)==PATCH_DONE);
+        REQUIRE(target==next);
+        REQUIRE(applier.written()==next.size());
+    }
+}
+
+SCENARIO("Each operation on its own", "[patch]") {
+    source = { 10, 20, 30, 40, 50, 60, 70, 80 };
+    Bytes next = { 30, 40, 50, 1, 2, 11, 22, 10, 20, 30 };
+    Bytes patch = header(source, next);
+    patch.push_back(1); putVarint(patch, 3); putOffset(patch, 2);   // 30 40 50
+    patch.push_back(3); putVarint(patch, 2); patch.push_back(1); patch.push_back(2);
+    patch.push_back(2); putVarint(patch, 2); putOffset(patch, -5);  // 10+1, 20+2
+    patch.push_back(1); patch.push_back(2);
+    patch.push_back(1); putVarint(patch, 3); putOffset(patch, -2);  // 10 20 30
+    patch.push_back(0);
+
+    reset();
+    PatchApplier applier(readSource, writeTarget);
+    REQUIRE(applier.apply(patch.data(), patch.size())==PATCH_DONE);
+    REQUIRE(target==next);
+}
+
+SCENARIO("Only a patch starts with the patch magic", "[patch]") {
+    Bytes patch = header({ 1 }, { 2 });
+    REQUIRE(PatchApplier::isPatch(patch.data(), patch.size()));
+    Bytes image = makeImage(4, 1);
+    put32(image, 0x20005000);
+    REQUIRE(!PatchApplier::isPatch(image.data() + 16, 4));
+    REQUIRE(!PatchApplier::isPatch(patch.data(), 3));
+}
+
+SCENARIO("Patches that can't be applied are refused", "[patch]") {
+    source = makeImage(300, 2);
+    Bytes next = makeRelease(source, 400, 20);
+    Bytes patch = makePatch(source, next);
+    reset();
+    PatchApplier applier(readSource, writeTarget);
+
+    GIVEN("data that is not a patch") {
+        Bytes image = makeImage(10, 3);
+        REQUIRE(applier.apply(image.data(), image.size())==PATCH_BAD_HEADER);
+    }
+    GIVEN("a patch for an image larger than the OTA region") {
+        Bytes bad = header(source, next);
+        bad.resize(12);
+        put32(bad, PATCH_TARGET_LENGTH_MAX + 1);
+        put32(bad, crc(next));
+        REQUIRE(applier.apply(bad.data(), bad.size())==PATCH_BAD_HEADER);
+        REQUIRE(applier.written()==0);
+    }
+    GIVEN("a patch made for another image") {
+        source[5] ^= 1;
+        REQUIRE(applier.apply(patch.data(), patch.size())==PATCH_WRONG_SOURCE);
+    }
+    GIVEN("a patch with a corrupted byte of new data") {
+        Bytes bad = patch;
+        bad[bad.size()-2] ^= 0x40;
+        Spark_Patch_Status_TypeDef status = applier.apply(bad.data(), bad.size());
+        REQUIRE(status!=PATCH_DONE);
+        REQUIRE(status!=PATCH_OK);
+    }
+    GIVEN("a copy reaching past the source") {
+        Bytes bad = header(source, next);
+        bad.push_back(1); putVarint(bad, 16); putOffset(bad, source.size() - 8);
+        REQUIRE(applier.apply(bad.data(), bad.size())==PATCH_BAD_DATA);
+    }
+    GIVEN("an offset before the start of the source") {
+        Bytes bad = header(source, next);
+        bad.push_back(1); putVarint(bad, 4); putOffset(bad, -1);
+        REQUIRE(applier.apply(bad.data(), bad.size())==PATCH_BAD_DATA);
+    }
+    GIVEN("more data than the target holds") {
+        Bytes small = { 1, 2 };
+        Bytes bad = header(source, small);
+        bad.push_back(3); putVarint(bad, 3); bad.push_back(1); bad.push_back(2); bad.push_back(3);
+        REQUIRE(applier.apply(bad.data(), bad.size())==PATCH_BAD_DATA);
+    }
+    GIVEN("a length near 2^32, which would wrap a 32 bit bounds check") {
+        Bytes small(100, 7);
+        Bytes bad = header(source, small);
+        bad.push_back(3); putVarint(bad, 10);
+        bad.insert(bad.end(), small.begin(), small.begin() + 10);
+        bad.push_back(3); putVarint(bad, 0xFFFFFFFA);
+        bad.insert(bad.end(), 5000, 0x55);
+        REQUIRE(applier.apply(bad.data(), bad.size())==PATCH_BAD_DATA);
+        REQUIRE(target.size() <= small.size());
+    }
+    GIVEN("a copy or add length near 2^32") {
+        for (uint8_t op = 1; op <= 2; op++) {
+            applier.begin();
+            Bytes bad = header(source, next);
+            bad.push_back(op); putVarint(bad, 0xFFFFFFFF); putOffset(bad, 0);
+            REQUIRE(applier.apply(bad.data(), bad.size())==PATCH_BAD_DATA);
+        }
+        REQUIRE(target.empty());
+    }
+    GIVEN("an unknown operation") {
+        Bytes bad = header(source, next);
+        bad.push_back(9);
+        REQUIRE(applier.apply(bad.data(), bad.size())==PATCH_BAD_DATA);
+    }
+    GIVEN("a patch that ends early") {
+        Bytes bad = header(source, next);
+        bad.push_back(1); putVarint(bad, 4); putOffset(bad, 0);
+        bad.push_back(0);
+        REQUIRE(applier.apply(bad.data(), bad.size())==PATCH_BAD_TARGET);
+    }
+    GIVEN("a sink that fails") {
+        writeFails = true;
+        REQUIRE(applier.apply(patch.data(), patch.size())==PATCH_WRITE_FAILED);
+    }
+    THEN("input after an error is ignored") {
+        Bytes image = makeImage(10, 3);
+        applier.apply(image.data(), image.size());
+        REQUIRE(applier.apply(patch.data(), patch.size())==PATCH_BAD_HEADER);
+    }
+}
+
+SCENARIO("The applier can be reused for another patch", "[patch]") {
+    source = makeImage(200, 4);
+    Bytes next = makeRelease(source, 100, 8);
+    Bytes patch = makePatch(source, next);
+    reset();
+    PatchApplier applier(readSource, writeTarget);
+    REQUIRE(applier.apply(patch.data(), patch.size())==PATCH_DONE);
+    reset();
+    applier.begin();
+    REQUIRE(applier.apply(patch.data(), patch.size())==PATCH_DONE);
+    REQUIRE(target==next);
+}
@@ -0,0 +1,80 @@
+#include "catch.hpp"
+#include "spark_profiler.h"
+
+#include <cstring>
+#include <string>
+
+static void work(uint32_t cycles) {
+    Profiler_Fake_Cycles += cycles;
+}
+
+static void probedLoop(uint32_t cycles) {
+    PROFILE_SCOPE(PROBE_LOOP);
+    work(cycles);
+}
+
+SCENARIO("A probe accumulates count, total, min and max cycles", "[profiler]") {
+    profilerReset();
+    probedLoop(100);
+    probedLoop(300);
+    probedLoop(200);
+
+    Spark_Probe_Stats_TypeDef stats;
+    profilerStats(PROBE_LOOP, &stats);
+    REQUIRE(stats.count==3);
+    REQUIRE(stats.total_cycles==600);
+    REQUIRE(stats.min_cycles==100);
+    REQUIRE(stats.max_cycles==300);
+
+    profilerStats(PROBE_SYSTICK, &stats);
+    REQUIRE(stats.count==0);
+    REQUIRE(stats.min_cycles==0);
+}
+
+SCENARIO("A probe measures across the wrap of the cycle counter", "[profiler]") {
+    profilerReset();
+    Profiler_Fake_Cycles = 0xFFFFFFF0;
+    probedLoop(0x20);
+
+    Spark_Probe_Stats_TypeDef stats;
+    profilerStats(PROBE_LOOP, &stats);
+    REQUIRE(stats.max_cycles==0x20);
+}
+
+SCENARIO("Nested probes each count their own scope", "[profiler]") {
+    profilerReset();
+    {
+        PROFILE_SCOPE(PROBE_WLAN_LOOP);
+        work(10);
+        {
+            PROFILE_SCOPE(PROBE_COMMUNICATION_LOOP);
+            work(5);
+        }
+    }
+    Spark_Probe_Stats_TypeDef wlan, cloud;
+    profilerStats(PROBE_WLAN_LOOP, &wlan);
+    profilerStats(PROBE_COMMUNICATION_LOOP, &cloud);
+    REQUIRE(wlan.total_cycles==15);
+    REQUIRE(cloud.total_cycles==5);
+}
+
+SCENARIO("The report lists the probes that ran", "[profiler]") {
+    profilerReset();
+    char buffer[128];
+    REQUIRE(profilerReport(buffer, sizeof(buffer))==0);
+    REQUIRE(std::string(buffer)=="");
+
+    probedLoop(100);
+    probedLoop(300);
+    profilerRecord(PROBE_USART_ISR, 40);
+    size_t length = profilerReport(buffer, sizeof(buffer));
+    REQUIRE(std::string(buffer)=="loop:2,200,100,300 usart:1,40,40,40");
+    REQUIRE(length==strlen(buffer));
+
+    GIVEN("a buffer too small for every probe") {
+        REQUIRE(profilerReport(buffer, 24)==18);
+        REQUIRE(std::string(buffer)=="loop:2,200,100,300");
+        REQUIRE(profilerReport(buffer, 5)==0);
+        REQUIRE(std::string(buffer)=="");
+    }
+}
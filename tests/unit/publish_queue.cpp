@@ -0,0 +1,168 @@
+#include "catch.hpp"
+#include "spark_publish_queue.h"
+
+#include <string>
+#include <vector>
+
+struct SentEvent {
+    std::string name;
+    std::string data;
+    bool hasData;
+    int ttl;
+    bool isPrivate;
+};
+
+static std::vector<SentEvent> sent;
+static bool sendSucceeds = true;
+
+static bool fakeSender(const char* name, const char* data, int ttl, bool isPrivate) {
+    if (!sendSucceeds)
+        return false;
+    sent.push_back(SentEvent{ name, data ? data : "", data!=NULL, ttl, isPrivate });
+    return true;
+}
+
+static void reset() {
+    sent.clear();
+    sendSucceeds = true;
+}
+
+SCENARIO("Queued events are sent in order", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    REQUIRE(queue.add("a", "1", 60, false)==PUBLISH_QUEUED);
+    REQUIRE(queue.add("b", NULL, 30, true)==PUBLISH_QUEUED);
+    REQUIRE(queue.pending()==2);
+    REQUIRE(sent.empty());
+
+    REQUIRE(queue.drain(0)==2);
+    REQUIRE(queue.pending()==0);
+    REQUIRE(sent.size()==2);
+    REQUIRE(sent[0].name=="a");
+    REQUIRE(sent[0].data=="1");
+    REQUIRE(sent[0].ttl==60);
+    REQUIRE(!sent[0].isPrivate);
+    REQUIRE(sent[1].name=="b");
+    REQUIRE(!sent[1].hasData);
+    REQUIRE(sent[1].isPrivate);
+}
+
+SCENARIO("A full queue drops new events", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    for (int i=0; i<PUBLISH_QUEUE_DEPTH; i++) {
+        REQUIRE(queue.add("e", "x", 60, false)==PUBLISH_QUEUED);
+    }
+    REQUIRE(queue.add("e", "x", 60, false)==PUBLISH_QUEUE_FULL);
+
+    Spark_Publish_Stats_TypeDef stats;
+    queue.stats(&stats);
+    REQUIRE(stats.dropped==1);
+    REQUIRE(stats.pending==PUBLISH_QUEUE_DEPTH);
+    REQUIRE(stats.high_water==PUBLISH_QUEUE_DEPTH);
+}
+
+SCENARIO("Coalescing keeps the latest data for an event name", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    queue.coalesce(true);
+    REQUIRE(queue.add("temp", "20", 60, false)==PUBLISH_QUEUED);
+    REQUIRE(queue.add("humidity", "40", 60, false)==PUBLISH_QUEUED);
+    REQUIRE(queue.add("temp", "21", 60, false)==PUBLISH_COALESCED);
+    REQUIRE(queue.add("temp", "22", 60, true)==PUBLISH_QUEUED);
+    REQUIRE(queue.pending()==3);
+
+    queue.drain(0);
+    REQUIRE(sent.size()==3);
+    REQUIRE(sent[0].name=="temp");
+    REQUIRE(sent[0].data=="21");
+    REQUIRE(sent[1].name=="humidity");
+    REQUIRE(sent[2].data=="22");
+}
+
+SCENARIO("Without coalescing repeated events each take an entry", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    REQUIRE(queue.add("temp", "20", 60, false)==PUBLISH_QUEUED);
+    REQUIRE(queue.add("temp", "21", 60, false)==PUBLISH_QUEUED);
+    REQUIRE(queue.pending()==2);
+}
+
+SCENARIO("The rate limit allows a burst then one event per interval", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    uint32_t now = 5000;
+    for (int i=0; i<PUBLISH_QUEUE_DEPTH; i++)
+        queue.add("e", NULL, 60, false);
+    REQUIRE(queue.drain(now)==PUBLISH_BURST);
+
+    for (int i=0; i<PUBLISH_QUEUE_DEPTH; i++)
+        queue.add("e", NULL, 60, false);
+    REQUIRE(queue.drain(now)==0);
+    REQUIRE(queue.drain(now + PUBLISH_INTERVAL_MILLIS - 1)==0);
+    REQUIRE(queue.drain(now + PUBLISH_INTERVAL_MILLIS)==1);
+    REQUIRE(queue.drain(now + 3*PUBLISH_INTERVAL_MILLIS)==2);
+
+    // a long idle period refills no more than the burst
+    now += 100*PUBLISH_INTERVAL_MILLIS;
+    for (int i=0; i<PUBLISH_QUEUE_DEPTH; i++)
+        queue.add("e", NULL, 60, false);
+    REQUIRE(queue.drain(now)==PUBLISH_BURST);
+}
+
+SCENARIO("The rate limit survives the millisecond counter wrapping", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    uint32_t now = 0xFFFFFFFFu - 10;
+    for (int i=0; i<PUBLISH_BURST; i++)
+        queue.add("e", NULL, 60, false);
+    REQUIRE(queue.drain(now)==PUBLISH_BURST);
+    queue.add("e", NULL, 60, false);
+    REQUIRE(queue.drain(now + PUBLISH_INTERVAL_MILLIS)==1);
+}
+
+SCENARIO("An event the protocol refuses stays queued", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    queue.add("a", "1", 60, false);
+    sendSucceeds = false;
+    REQUIRE(queue.drain(0)==0);
+    REQUIRE(queue.pending()==1);
+
+    sendSucceeds = true;
+    REQUIRE(queue.drain(0)==1);
+    REQUIRE(sent[0].name=="a");
+
+    Spark_Publish_Stats_TypeDef stats;
+    queue.stats(&stats);
+    REQUIRE(stats.send_failed==1);
+    REQUIRE(stats.sent==1);
+    REQUIRE(stats.bytes_sent==2);
+}
+
+SCENARIO("Long names and data are truncated", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    std::string name(100, 'n');
+    std::string data(100, 'd');
+    queue.add(name.c_str(), data.c_str(), 60, false);
+    queue.drain(0);
+    REQUIRE(sent[0].name.length()==PUBLISH_NAME_LENGTH-1);
+    REQUIRE(sent[0].data.length()==PUBLISH_DATA_LENGTH-1);
+}
+
+SCENARIO("Names and data can be given with a length", "[publish]") {
+    reset();
+    PublishQueue queue(fakeSender);
+    queue.coalesce(true);
+    const char* buffer = "temperature=21.5";
+    REQUIRE(queue.add(buffer, 11, buffer+12, 4, 60, false)==PUBLISH_QUEUED);
+    REQUIRE(queue.add("temperature", 11, "22", 2, 60, false)==PUBLISH_COALESCED);
+    REQUIRE(queue.add("temp", 4, NULL, 0, 60, false)==PUBLISH_QUEUED);
+    queue.drain(0);
+    REQUIRE(sent.size()==2);
+    REQUIRE(sent[0].name=="temperature");
+    REQUIRE(sent[0].data=="22");
+    REQUIRE(sent[1].name=="temp");
+    REQUIRE(!sent[1].hasData);
+}
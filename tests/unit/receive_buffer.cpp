@@ -0,0 +1,223 @@
+#include "catch.hpp"
+#include "spark_receive_buffer.h"
+
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+
+/**
+ * A fake cloud socket on a virtual clock. Like the CC3000, a read that
+ * finds no data waits for the 5ms select timeout.
+ */
+struct FakeSocket {
+    std::deque<uint8_t> incoming;
+    uint32_t micros;
+    int error;
+    int reads;
+
+    void reset() {
+        incoming.clear();
+        micros = 0;
+        error = 0;
+        reads = 0;
+    }
+
+    uint32_t millis() const { return micros / 1000; }
+
+    void arrive(const char* data) {
+        while (*data)
+            incoming.push_back(*data++);
+    }
+};
+
+static FakeSocket socket;
+
+static int fakeRead(uint8_t* buf, int length) {
+    socket.reads++;
+    if (socket.error)
+        return socket.error;
+    if (socket.incoming.empty()) {
+        socket.micros += 5000;
+        return 0;
+    }
+    socket.micros += 500;   // SPI transfer
+    int count = 0;
+    while (count < length && !socket.incoming.empty()) {
+        buf[count++] = socket.incoming.front();
+        socket.incoming.pop_front();
+    }
+    return count;
+}
+
+SCENARIO("Received data is served in order in pieces", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    socket.arrive("0123456789");
+
+    uint8_t buf[8];
+    REQUIRE(buffer.receive(buf, 2, socket.millis())==2);
+    REQUIRE(memcmp(buf, "01", 2)==0);
+    REQUIRE(buffer.available()==8);
+    REQUIRE(buffer.receive(buf, 8, socket.millis())==8);
+    REQUIRE(memcmp(buf, "23456789", 8)==0);
+    REQUIRE(socket.reads==1);
+}
+
+SCENARIO("An idle socket is not polled again until the interval passes", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    uint8_t buf[4];
+
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==0);
+    REQUIRE(socket.reads==1);
+
+    socket.arrive("ab");
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==0);
+    REQUIRE(socket.reads==1);
+
+    socket.micros += SPARK_RECEIVE_POLL_MILLIS*1000;
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==2);
+    REQUIRE(socket.reads==2);
+
+    Spark_Receive_Stats_TypeDef stats;
+    buffer.stats(&stats);
+    REQUIRE(stats.polls==2);
+    REQUIRE(stats.idle_polls==1);
+    REQUIRE(stats.skipped==1);
+    REQUIRE(stats.bytes==2);
+}
+
+SCENARIO("The socket is read again at once while data is arriving", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    uint8_t buf[4];
+    socket.arrive("ab");
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==2);
+    socket.arrive("cd");
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==2);
+    REQUIRE(memcmp(buf, "cd", 2)==0);
+}
+
+SCENARIO("Large receives are read straight into the caller's buffer", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    std::string data(SPARK_RECEIVE_BUFFER_SIZE*2, 'x');
+    socket.arrive(data.c_str());
+    uint8_t buf[SPARK_RECEIVE_BUFFER_SIZE*2];
+    REQUIRE(buffer.receive(buf, sizeof(buf), socket.millis())==int(sizeof(buf)));
+    REQUIRE(buffer.available()==0);
+}
+
+SCENARIO("A header split across a refill is received whole", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    // the first refill ends after the first byte of the next header
+    std::string body(SPARK_RECEIVE_BUFFER_SIZE-1, 'x');
+    socket.arrive(body.c_str());
+    socket.arrive("\x01\x10""abc");
+
+    uint8_t buf[SPARK_RECEIVE_BUFFER_SIZE];
+    REQUIRE(buffer.receive(buf, body.length(), socket.millis())==int(body.length()));
+    REQUIRE(buffer.available()==1);
+    REQUIRE(buffer.receive(buf, 2, socket.millis())==2);
+    REQUIRE(memcmp(buf, "\x01\x10", 2)==0);
+    REQUIRE(buffer.receive(buf, 3, socket.millis())==3);
+    REQUIRE(memcmp(buf, "abc", 3)==0);
+    REQUIRE(socket.reads==2);
+}
+
+SCENARIO("A receive comes back short only when the socket has no more", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    uint8_t buf[4];
+    socket.arrive("abc");
+    REQUIRE(buffer.receive(buf, 2, socket.millis())==2);
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==1);
+    REQUIRE(buf[0]=='c');
+    REQUIRE(socket.reads==2);
+}
+
+SCENARIO("An error after buffered data is reported on the next receive", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    uint8_t buf[4];
+    socket.arrive("ab");
+    REQUIRE(buffer.receive(buf, 1, socket.millis())==1);
+    socket.error = -57;
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==1);
+    REQUIRE(buf[0]=='b');
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==-57);
+}
+
+SCENARIO("Socket errors are passed to the protocol", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    uint8_t buf[4];
+    socket.error = -57;
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==-57);
+}
+
+SCENARIO("Clearing discards buffered data", "[receive]") {
+    socket.reset();
+    ReceiveBuffer buffer(fakeRead);
+    uint8_t buf[4];
+    socket.arrive("abcdef");
+    REQUIRE(buffer.receive(buf, 2, socket.millis())==2);
+    buffer.clear();
+    REQUIRE(buffer.available()==0);
+    socket.arrive("gh");
+    REQUIRE(buffer.receive(buf, 4, socket.millis())==2);
+    REQUIRE(memcmp(buf, "gh", 2)==0);
+}
+
+/**
+ * Runs an idle main loop: the application takes 1ms and the protocol
+ * asks for a 2 byte message header each pass. A short message arrives
+ * every 100ms.
+ * @return The average loop time in microseconds.
+ */
+template <typename Receive> double idleLoopMicros(Receive receive) {
+    socket.reset();
+    const int iterations = 10000;
+    uint32_t nextMessage = 0;
+    for (int i=0; i<iterations; i++) {
+        if (socket.micros >= nextMessage) {
+            socket.arrive("\x00\x10""0123456789abcdef");
+            nextMessage += 100000;
+        }
+        socket.micros += 1000;
+        uint8_t header[2];
+        if (receive(header, 2)==2) {
+            uint8_t body[16];
+            int count = 0;
+            while (count < 16) {
+                int n = receive(body+count, 16-count);
+                if (n > 0) count += n;
+            }
+        }
+    }
+    return double(socket.micros) / iterations;
+}
+
+static double unbufferedLoop() {
+    return idleLoopMicros([](uint8_t* buf, int length) { return fakeRead(buf, length); });
+}
+
+static double bufferedLoop() {
+    static ReceiveBuffer buffer(fakeRead);
+    buffer.clear();
+    return idleLoopMicros([](uint8_t* buf, int length) { return buffer.receive(buf, length, socket.millis()); });
+}
+
+SCENARIO("Buffering shortens the idle loop", "[receive]") {
+    double before = unbufferedLoop();
+    double after = bufferedLoop();
+    REQUIRE(after < before/2);
+}
+
+// run with: runner [benchmark]
+TEST_CASE("Benchmark idle loop time with and without the receive buffer", "[.][benchmark]") {
+    std::cout << "loop time per pass: select per receive " << unbufferedLoop()
+              << " us, buffered " << bufferedLoop() << " us" << std::endl;
+}
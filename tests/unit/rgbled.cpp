@@ -5,6 +5,10 @@ extern "C" {
     #include "rgbled.h"
 };
 
+#include "spark_led_animation.h"
+#include <chrono>
+#include <iostream>
+
 
 // The functions for the low-level hardware delecate to mocks so the tests
 // can easily stub/verify calls.
@@ -186,3 +190,116 @@ SCENARIO("LED_RGB_Get can retrieve correct 8-bit values from 16-bit CCR counters
         }
     }
 }
+
+static uint32_t animation_colors[64];
+static int animation_shown;
+
+static void animationSink(uint32_t color) {
+    animation_colors[animation_shown % 64] = color;
+    animation_shown++;
+}
+
+static void advanceFor(LedAnimator& animator, uint32_t millis) {
+    for (uint32_t t=0; t<millis; t+=LED_ANIMATION_TICK_MILLIS)
+        animator.advance(LED_ANIMATION_TICK_MILLIS);
+}
+
+SCENARIO("LED animations scale colors by gamma corrected levels", "[led]") {
+    REQUIRE(LedAnimator::scale(0xFEDCBA, 255) == 0xFEDCBA);
+    REQUIRE(LedAnimator::scale(0xFFFFFF, 0) == 0);
+    // half the level is a fifth of the brightness
+    REQUIRE((LedAnimator::scale(0xFF0000, 128) >> 16) == 56);
+    REQUIRE(LedAnimator::scale(0x00FF00, 128) == 0x003800);
+}
+
+SCENARIO("LED animations step through their keyframes", "[led]") {
+    GIVEN("An animator playing a blink") {
+        animation_shown = 0;
+        LedAnimator animator(animationSink);
+        animator.play(LED_ANIMATION_BLINK, 0x00FF00);
+
+        WHEN("It is advanced through a blink and a half") {
+            advanceFor(animator, 250);
+            THEN("The sink is only called when the color changes") {
+                REQUIRE(animation_shown == 3);
+                REQUIRE(animation_colors[0] == 0x00FF00);
+                REQUIRE(animation_colors[1] == 0);
+                REQUIRE(animation_colors[2] == 0x00FF00);
+                REQUIRE(animator.playing());
+            }
+        }
+        WHEN("It is played again with the same color") {
+            advanceFor(animator, 50);
+            animator.play(LED_ANIMATION_BLINK, 0x00FF00);
+            advanceFor(animator, 50);
+            THEN("The animation is not restarted") {
+                REQUIRE(animation_shown == 2);
+                REQUIRE(animation_colors[1] == 0);
+            }
+        }
+        WHEN("It is played with another color") {
+            advanceFor(animator, 50);
+            animator.play(LED_ANIMATION_BLINK, 0x0000FF);
+            animator.advance(LED_ANIMATION_TICK_MILLIS);
+            THEN("It restarts from the first keyframe") {
+                REQUIRE(animation_shown == 2);
+                REQUIRE(animation_colors[1] == 0x0000FF);
+            }
+        }
+        WHEN("It is stopped") {
+            animator.advance(LED_ANIMATION_TICK_MILLIS);
+            animator.stop();
+            advanceFor(animator, 1000);
+            THEN("The LED is left alone") {
+                REQUIRE(animation_shown == 1);
+                REQUIRE_FALSE(animator.playing());
+            }
+        }
+    }
+}
+
+SCENARIO("LED animations played a number of times end", "[led]") {
+    animation_shown = 0;
+    LedAnimator animator(animationSink);
+    animator.play(LED_ANIMATION_ERROR, 0xFF0000, 3);
+    advanceFor(animator, 2990);
+    REQUIRE(animator.playing());
+    animator.advance(LED_ANIMATION_TICK_MILLIS);
+    REQUIRE_FALSE(animator.playing());
+    // on and off three times
+    REQUIRE(animation_shown == 6);
+    REQUIRE(animation_colors[4] == 0xFF0000);
+    REQUIRE(animation_colors[5] == 0);
+}
+
+SCENARIO("LED animations ramp between keyframe levels", "[led]") {
+    animation_shown = 0;
+    LedAnimator animator(animationSink);
+    animator.play(LED_ANIMATION_BREATHE, 0x00FFFF);
+    animator.advance(0);
+    REQUIRE(animation_colors[0] == 0x00FFFF);
+
+    advanceFor(animator, 1000);
+    int half = animation_shown;
+    uint32_t dimmed = animation_colors[(half - 1) % 64];
+    REQUIRE(dimmed < 0x00FFFF);
+    REQUIRE(dimmed > LedAnimator::scale(0x00FFFF, 40));
+
+    // the dimmest point, then back to full
+    advanceFor(animator, 1000);
+    REQUIRE(animation_colors[(animation_shown - 1) % 64] == LedAnimator::scale(0x00FFFF, 40));
+    advanceFor(animator, 2000);
+    REQUIRE(animation_colors[(animation_shown - 1) % 64] == 0x00FFFF);
+}
+
+// run with: runner [benchmark]
+TEST_CASE("Benchmark advancing an LED animation", "[.][benchmark]") {
+    LedAnimator animator(animationSink);
+    animator.play(LED_ANIMATION_BREATHE, 0x00FFFF);
+    const int ticks = 10000000;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<ticks; i++)
+        animator.advance(LED_ANIMATION_TICK_MILLIS);
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "advance() " << double(elapsed) / ticks << " ns per tick" << std::endl;
+}
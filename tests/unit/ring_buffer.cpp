@@ -0,0 +1,222 @@
+#include "catch.hpp"
+#include "spark_ring_buffer.h"
+#include <chrono>
+#include <iostream>
+
+typedef RingBuffer<uint8_t, 8> SmallRing;
+
+SCENARIO("An empty ring has nothing to read and all its space to write", "[ring]") {
+    SmallRing ring;
+    uint8_t b;
+    const uint8_t* span;
+    REQUIRE(ring.empty());
+    REQUIRE_FALSE(ring.full());
+    REQUIRE(ring.available()==0);
+    REQUIRE(ring.space()==8);
+    REQUIRE_FALSE(ring.pop(b));
+    REQUIRE_FALSE(ring.peek(b));
+    REQUIRE(ring.peekSpan(&span)==0);
+}
+
+SCENARIO("Bytes come out of the ring in the order they went in", "[ring]") {
+    SmallRing ring;
+    uint8_t b;
+    // many times round, so the indices wrap the data
+    for (int i=0; i<100; i++) {
+        REQUIRE(ring.push(uint8_t(i)));
+        REQUIRE(ring.push(uint8_t(i+1)));
+        REQUIRE(ring.peek(b));
+        REQUIRE(b==uint8_t(i));
+        REQUIRE(ring.pop(b));
+        REQUIRE(b==uint8_t(i));
+        REQUIRE(ring.pop(b));
+        REQUIRE(b==uint8_t(i+1));
+    }
+    REQUIRE(ring.empty());
+}
+
+SCENARIO("All of the ring is used, and a push to a full ring is dropped", "[ring]") {
+    SmallRing ring;
+    for (int i=0; i<8; i++)
+        REQUIRE(ring.push(uint8_t(i)));
+    REQUIRE(ring.full());
+    REQUIRE(ring.space()==0);
+    REQUIRE_FALSE(ring.push(99));
+
+    uint8_t b;
+    REQUIRE(ring.pop(b));
+    REQUIRE(b==0);
+    REQUIRE(ring.push(8));
+    for (int i=1; i<=8; i++) {
+        REQUIRE(ring.pop(b));
+        REQUIRE(b==i);
+    }
+}
+
+SCENARIO("Bulk push and pop copy across the end of the ring", "[ring]") {
+    SmallRing ring;
+    uint8_t in[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    uint8_t out[10];
+
+    REQUIRE(ring.push(in, 5)==5);
+    REQUIRE(ring.pop(out, 5)==5);
+
+    // starts at 5, so wraps after 3
+    REQUIRE(ring.push(in, 10)==8);
+    REQUIRE(ring.full());
+    memset(out, 0, sizeof(out));
+    REQUIRE(ring.pop(out, 10)==8);
+    REQUIRE(memcmp(out, in, 8)==0);
+    REQUIRE(ring.empty());
+    REQUIRE(ring.pop(out, 10)==0);
+}
+
+SCENARIO("Spans reach to the end of the ring", "[ring]") {
+    SmallRing ring;
+    uint8_t in[] = { 1, 2, 3, 4, 5, 6 };
+    uint8_t out[6];
+    ring.push(in, 6);
+    ring.pop(out, 6);
+
+    // head and tail at 6: 2 bytes of room up to the end
+    uint8_t* room;
+    REQUIRE(ring.writeSpan(&room)==2);
+    room[0] = 10;
+    room[1] = 11;
+    ring.commit(2);
+    REQUIRE(ring.writeSpan(&room)==6);
+    room[0] = 12;
+    ring.commit(1);
+
+    const uint8_t* span;
+    REQUIRE(ring.peekSpan(&span)==2);
+    REQUIRE(span[0]==10);
+    REQUIRE(span[1]==11);
+    ring.skip(2);
+    REQUIRE(ring.peekSpan(&span)==1);
+    REQUIRE(span[0]==12);
+    ring.skip(1);
+    REQUIRE(ring.empty());
+}
+
+SCENARIO("Clear drops what is available, reset starts at the start", "[ring]") {
+    SmallRing ring;
+    uint8_t in[] = { 1, 2, 3, 4, 5 };
+    ring.push(in, 5);
+    ring.clear();
+    REQUIRE(ring.empty());
+    REQUIRE(ring.space()==8);
+
+    uint8_t* room;
+    REQUIRE(ring.writeSpan(&room)==3);
+    ring.reset();
+    REQUIRE(ring.writeSpan(&room)==8);
+}
+
+SCENARIO("A producer and consumer running at different rates see every byte once", "[ring]") {
+    RingBuffer<uint8_t, 64> ring;
+    uint32_t produced = 0, consumed = 0;
+    uint32_t dropped = 0;
+    uint8_t chunk[37];
+    uint8_t out[23];
+
+    // bursts from the producer, like an interrupt, drained in other sizes
+    for (int round=0; round<10000; round++) {
+        size_t n = (round * 7) % sizeof(chunk);
+        for (size_t i=0; i<n; i++)
+            chunk[i] = uint8_t(produced + i);
+        size_t pushed = ring.push(chunk, n);
+        dropped += n - pushed;
+        produced += pushed;
+
+        size_t m = ring.pop(out, (round * 5) % sizeof(out));
+        for (size_t i=0; i<m; i++)
+            REQUIRE(out[i]==uint8_t(consumed + i));
+        consumed += m;
+    }
+    uint32_t held = consumed + ring.available();
+    REQUIRE(held==produced);
+    REQUIRE(dropped > 0);
+}
+
+SCENARIO("The ring holds structures as well as bytes", "[ring]") {
+    struct Sample { uint32_t time; int16_t value; };
+    RingBuffer<Sample, 4> ring;
+    Sample in[] = { { 1, -1 }, { 2, -2 }, { 3, -3 } };
+    Sample out[3];
+    REQUIRE(ring.push(in, 3)==3);
+    REQUIRE(ring.pop(out, 3)==3);
+    REQUIRE(ring.push(in, 3)==3);
+    REQUIRE(ring.pop(out, 3)==3);
+    REQUIRE(out[2].time==3);
+    REQUIRE(out[2].value==-3);
+}
+
+// The ring the serial ports had: the same data, indexed with %
+struct ModuloRing {
+    unsigned char buffer[64];
+    volatile unsigned int head;
+    volatile unsigned int tail;
+};
+
+static bool moduloPush(ModuloRing& ring, unsigned char c) {
+    unsigned i = (unsigned int)(ring.head + 1) % 64;
+    if (i == ring.tail)
+        return false;
+    ring.buffer[ring.head] = c;
+    ring.head = i;
+    return true;
+}
+
+static int moduloPop(ModuloRing& ring) {
+    if (ring.head == ring.tail)
+        return -1;
+    unsigned char c = ring.buffer[ring.tail];
+    ring.tail = (unsigned int)(ring.tail + 1) % 64;
+    return c;
+}
+
+// run with: runner [benchmark]
+TEST_CASE("Benchmark ring throughput", "[.][benchmark]") {
+    const int bytes = 100000000;
+    unsigned sum = 0;
+
+    ModuloRing modulo;
+    memset(&modulo, 0, sizeof(modulo));
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<bytes; i+=32) {
+        for (int j=0; j<32; j++)
+            moduloPush(modulo, uint8_t(j));
+        for (int j=0; j<32; j++)
+            sum += moduloPop(modulo);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "modulo ring, a byte at a time: " << double(elapsed) / bytes << " ns/byte" << std::endl;
+
+    RingBuffer<uint8_t, 64> ring;
+    uint8_t b;
+    start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<bytes; i+=32) {
+        for (int j=0; j<32; j++)
+            ring.push(uint8_t(j));
+        for (int j=0; j<32; j++)
+            if (ring.pop(b))
+                sum += b;
+    }
+    elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "masked ring, a byte at a time: " << double(elapsed) / bytes << " ns/byte" << std::endl;
+
+    uint8_t in[32], out[32];
+    for (int j=0; j<32; j++)
+        in[j] = uint8_t(j);
+    start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<bytes; i+=32) {
+        ring.push(in, 32);
+        ring.pop(out, 32);
+        sum += out[i & 31];
+    }
+    elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "masked ring, 32 bytes at a time: " << double(elapsed) / bytes << " ns/byte" << std::endl;
+
+    REQUIRE(sum > 0);
+}
@@ -0,0 +1,195 @@
+#include "catch.hpp"
+#include "spark_scheduler.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static uint32_t now;
+static std::string trace;
+
+static uint32_t virtualClock() {
+    return now;
+}
+
+static void taskA() { trace += "A"; }
+static void taskB() { trace += "B"; }
+static void taskC() { trace += "C"; }
+
+static void reset(uint32_t start = 0) {
+    now = start;
+    trace.clear();
+}
+
+/**
+ * Advances the virtual clock a millisecond at a time, running the scheduler
+ * at each step as the main loop would.
+ */
+static void advance(Scheduler& scheduler, uint32_t millis) {
+    for (uint32_t i=0; i<millis; i++) {
+        now++;
+        scheduler.run();
+    }
+}
+
+SCENARIO("A one-shot timer fires once when due", "[scheduler]") {
+    reset();
+    Scheduler scheduler(virtualClock);
+    REQUIRE(scheduler.after(10, taskA) >= 0);
+    REQUIRE(scheduler.idleMillis()==10);
+
+    advance(scheduler, 9);
+    REQUIRE(trace=="");
+    advance(scheduler, 1);
+    REQUIRE(trace=="A");
+    advance(scheduler, 100);
+    REQUIRE(trace=="A");
+    REQUIRE(scheduler.pending()==0);
+    REQUIRE(scheduler.idleMillis()==UINT32_MAX);
+}
+
+SCENARIO("Periodic timers fire on their period in due order", "[scheduler]") {
+    reset();
+    Scheduler scheduler(virtualClock);
+    scheduler.every(3, taskA);
+    scheduler.every(5, taskB);
+    scheduler.after(4, taskC);
+
+    advance(scheduler, 15);
+    // A at 3 6 9 12 15, B at 5 10 15, C at 4; A is older at 15
+    REQUIRE(trace=="ACBAABAAB");
+}
+
+SCENARIO("A late periodic timer keeps its phase and drops missed periods", "[scheduler]") {
+    reset();
+    Scheduler scheduler(virtualClock);
+    scheduler.every(10, taskA);
+
+    now = 35;       // the main loop was busy
+    REQUIRE(scheduler.run()==1);
+    REQUIRE(trace=="A");
+    REQUIRE(scheduler.idleMillis()==5);
+
+    Spark_Scheduler_Stats_TypeDef stats;
+    scheduler.stats(&stats);
+    REQUIRE(stats.overruns==2);
+    REQUIRE(stats.max_late_millis==25);
+
+    advance(scheduler, 5);
+    REQUIRE(trace=="AA");
+}
+
+SCENARIO("Timers keep their order across the wrap of the clock", "[scheduler]") {
+    reset(UINT32_MAX - 5);
+    Scheduler scheduler(virtualClock);
+    scheduler.after(20, taskB);
+    scheduler.after(2, taskA);
+    scheduler.every(8, taskC);
+
+    advance(scheduler, 20);
+    REQUIRE(trace=="ACCB");
+}
+
+SCENARIO("Cancelled timers don't fire", "[scheduler]") {
+    reset();
+    Scheduler scheduler(virtualClock);
+    int a = scheduler.after(5, taskA);
+    int b = scheduler.every(2, taskB);
+    scheduler.after(6, taskC);
+
+    REQUIRE(scheduler.cancel(a));
+    REQUIRE(!scheduler.cancel(a));
+    advance(scheduler, 4);
+    REQUIRE(scheduler.cancel(b));
+    advance(scheduler, 10);
+    REQUIRE(trace=="BBC");
+
+    GIVEN("the id of a timer that fired, whose slot was reused") {
+        int c = scheduler.after(1, taskA);
+        advance(scheduler, 1);
+        int d = scheduler.after(1, taskB);
+        REQUIRE((c & 0xFF)==(d & 0xFF));
+        REQUIRE(!scheduler.cancel(c));
+        advance(scheduler, 1);
+        REQUIRE(trace=="BBCAB");
+    }
+}
+
+static Scheduler* current;
+static int selfId;
+
+static void cancelsItself() {
+    trace += "S";
+    current->cancel(selfId);
+}
+
+static void startsAnother() {
+    trace += "R";
+    current->after(0, startsAnother);
+}
+
+SCENARIO("Callbacks may start and cancel timers", "[scheduler]") {
+    reset();
+    Scheduler scheduler(virtualClock);
+    current = &scheduler;
+
+    GIVEN("a periodic timer that cancels itself") {
+        selfId = scheduler.every(1, cancelsItself);
+        advance(scheduler, 5);
+        REQUIRE(trace=="S");
+    }
+    GIVEN("a timer that keeps restarting itself without delay") {
+        scheduler.after(0, startsAnother);
+        REQUIRE(scheduler.run()==1);
+        REQUIRE(scheduler.run()==1);
+        REQUIRE(trace=="RR");
+    }
+}
+
+SCENARIO("Posted tasks run in order on the next run", "[scheduler]") {
+    reset();
+    Scheduler scheduler(virtualClock);
+    scheduler.after(0, taskC);
+    REQUIRE(scheduler.post(taskA));
+    REQUIRE(scheduler.post(taskB));
+    REQUIRE(scheduler.idleMillis()==0);
+    REQUIRE(scheduler.run()==3);
+    REQUIRE(trace=="CAB");
+
+    for (int i=0; i<SCHEDULER_QUEUE_DEPTH; i++)
+        REQUIRE(scheduler.post(taskA));
+    REQUIRE(!scheduler.post(taskB));
+    REQUIRE(scheduler.run()==SCHEDULER_QUEUE_DEPTH);
+}
+
+SCENARIO("A full scheduler refuses more timers", "[scheduler]") {
+    reset();
+    Scheduler scheduler(virtualClock);
+    for (int i=0; i<SCHEDULER_MAX_TIMERS; i++)
+        REQUIRE(scheduler.after(i + 1, taskA) >= 0);
+    REQUIRE(scheduler.after(1, taskB)==-1);
+    REQUIRE(scheduler.every(0, taskB)==-1);
+
+    advance(scheduler, SCHEDULER_MAX_TIMERS);
+    REQUIRE(trace==std::string(SCHEDULER_MAX_TIMERS, 'A'));
+}
+
+SCENARIO("Timers fire in due order whatever order they were started in", "[scheduler]") {
+    reset();
+    Scheduler scheduler(virtualClock);
+    srand(1);
+    std::vector<int> ids;
+    for (int round=0; round<200; round++) {
+        while (scheduler.pending() < SCHEDULER_MAX_TIMERS)
+            ids.push_back(scheduler.after(rand() % 50, taskA));
+        scheduler.cancel(ids[rand() % ids.size()]);
+
+        // nothing due is left behind and nothing early fires
+        uint32_t due = scheduler.idleMillis();
+        size_t fired = trace.size();
+        now += due;
+        REQUIRE(scheduler.run() >= 1);
+        REQUIRE(trace.size() > fired);
+        REQUIRE(scheduler.idleMillis() > 0);
+    }
+}
@@ -0,0 +1,127 @@
+#include "catch.hpp"
+#include "spark_service_budget.h"
+
+static uint32_t now;
+static uint32_t pass_millis;	// how long a pass of the service takes
+static int work;				// passes of work pending
+static int passes;
+
+static uint32_t virtualClock() {
+    return now;
+}
+
+static void service() {
+    now += pass_millis;
+    passes++;
+    if (work > 0)
+        work--;
+}
+
+static bool busy() {
+    return work > 0;
+}
+
+static void reset(uint32_t cost = 2, int pending = 0) {
+    now = 1000;
+    pass_millis = cost;
+    work = pending;
+    passes = 0;
+}
+
+/**
+ * delay() as the firmware has it: waits until {@code ms} have passed,
+ * polling the budget at each millisecond.
+ * @return How late it returned.
+ */
+static uint32_t delay(ServiceBudget& budget, uint32_t ms) {
+    uint32_t start = now;
+    while (now - start < ms) {
+        if (!budget.poll(start + ms))
+            now++;
+    }
+    return now - start - ms;
+}
+
+static Spark_Service_Stats_TypeDef statsOf(const ServiceBudget& budget) {
+    Spark_Service_Stats_TypeDef stats;
+    budget.stats(&stats);
+    return stats;
+}
+
+SCENARIO("A slice with nothing pending is a single pass", "[service]") {
+    reset();
+    ServiceBudget budget(service, busy, virtualClock);
+    REQUIRE(budget.run()==1);
+    REQUIRE(passes==1);
+    REQUIRE(budget.getInterval()==2*SERVICE_BUSY_INTERVAL_MILLIS);
+}
+
+SCENARIO("Pending work is serviced until the budget is spent", "[service]") {
+    reset(2, 100);
+    ServiceBudget budget(service, busy, virtualClock);
+    budget.setBudget(20);
+    REQUIRE(budget.run()==10);
+    REQUIRE(work==90);
+    REQUIRE(budget.getInterval()==SERVICE_BUSY_INTERVAL_MILLIS);
+
+    Spark_Service_Stats_TypeDef stats = statsOf(budget);
+    REQUIRE(stats.busy==1);
+    REQUIRE(stats.max_slice_millis==20);
+    REQUIRE(stats.overruns==0);
+
+    // finishing the work early ends the slice
+    work = 3;
+    REQUIRE(budget.run()==3);
+}
+
+SCENARIO("A budget of 0 still makes a pass", "[service]") {
+    reset(2, 100);
+    ServiceBudget budget(service, busy, virtualClock);
+    budget.setBudget(0);
+    REQUIRE(budget.run()==1);
+    REQUIRE(budget.run()==1);
+    REQUIRE(work==98);
+    REQUIRE(statsOf(budget).overruns==2);
+}
+
+SCENARIO("delay() services less often as the cloud stays idle", "[service]") {
+    reset(1);
+    ServiceBudget budget(service, busy, virtualClock);
+    delay(budget, 10000);
+    // 1, 2, 4 ... 512ms, then every second
+    REQUIRE(budget.getInterval()==SERVICE_IDLE_INTERVAL_MILLIS);
+    REQUIRE(passes >= 15);
+    REQUIRE(passes <= 20);
+
+    // work arriving brings the rate back up at the next slice
+    int before = passes;
+    work = 50;
+    delay(budget, 2000);
+    REQUIRE(work==0);
+    REQUIRE(passes >= before + 50);
+}
+
+SCENARIO("delay() returns on time however much work is pending", "[service]") {
+    // an OTA update: thousands of passes of work
+    reset(3, 5000);
+    ServiceBudget budget(service, busy, virtualClock);
+    uint32_t worst = 0;
+    for (int i=0; i<100; i++) {
+        uint32_t late = delay(budget, 50);
+        if (late > worst)
+            worst = late;
+    }
+    // a pass that started before the deadline may finish after it
+    REQUIRE(worst < pass_millis);
+    // the update made progress all along
+    REQUIRE(work < 5000 - 100*50/3/2);
+}
+
+SCENARIO("delay() is cut short by neither the budget nor the interval", "[service]") {
+    reset(1);
+    ServiceBudget budget(service, busy, virtualClock);
+    REQUIRE(delay(budget, 1)==0);
+    REQUIRE(delay(budget, 250)==0);
+    REQUIRE_FALSE(budget.due());
+    REQUIRE(budget.poll(now + 1000)==0);
+}
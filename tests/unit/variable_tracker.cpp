@@ -0,0 +1,180 @@
+#include "catch.hpp"
+#include "spark_variable_tracker.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> sent;
+static bool accept = true;
+
+static bool recordSend(const char* data, size_t length) {
+    if (accept)
+        sent.push_back(std::string(data, length));
+    return accept;
+}
+
+static void reset() {
+    sent.clear();
+    accept = true;
+}
+
+SCENARIO("Nothing is sent when nothing is tracked", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    REQUIRE(tracker.process()==0);
+    REQUIRE(sent.empty());
+}
+
+SCENARIO("The first pass sends every tracked value", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    int32_t count = 42;
+    double temp = 21.5;
+    bool door = true;
+    char state[] = "idle";
+    tracker.track("count", &count, INT, 0);
+    tracker.track("temp", &temp, DOUBLE, 0.5);
+    tracker.track("door", &door, BOOLEAN, 0);
+    tracker.track("state", state, STRING, 0);
+
+    REQUIRE(tracker.process()==4);
+    REQUIRE(sent.size()==1);
+    REQUIRE(sent[0]=="count=42&temp=21.5&door=1&state=idle");
+
+    REQUIRE(tracker.process()==0);
+    REQUIRE(sent.size()==1);
+}
+
+SCENARIO("Only the values that changed are sent", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    int32_t a = 1, b = 2;
+    tracker.track("a", &a, INT, 0);
+    tracker.track("b", &b, INT, 0);
+    tracker.process();
+
+    b = 3;
+    REQUIRE(tracker.process()==1);
+    REQUIRE(sent.back()=="b=3");
+}
+
+SCENARIO("Changes within the deadband are not sent", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    double temp = 20.0;
+    tracker.track("temp", &temp, DOUBLE, 0.5);
+    tracker.process();
+
+    WHEN("the value drifts in small steps") {
+        temp = 20.3;
+        REQUIRE(tracker.process()==0);
+        temp = 20.5;
+        REQUIRE(tracker.process()==0);
+        THEN("it is sent once it is beyond the deadband from the value sent") {
+            temp = 20.6;
+            REQUIRE(tracker.process()==1);
+            REQUIRE(sent.back()=="temp=20.6");
+            Spark_Variable_Push_Stats_TypeDef stats;
+            tracker.stats(&stats);
+            REQUIRE(stats.suppressed==2);
+            REQUIRE(stats.changes==2);
+            REQUIRE(stats.batches==2);
+        }
+    }
+    WHEN("the value falls") {
+        temp = 19.4;
+        REQUIRE(tracker.process()==1);
+    }
+}
+
+SCENARIO("An integer deadband", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    int32_t level = 100;
+    tracker.track("level", &level, INT, 5);
+    tracker.process();
+    level = 105;
+    REQUIRE(tracker.process()==0);
+    level = 94;
+    REQUIRE(tracker.process()==1);
+    REQUIRE(sent.back()=="level=94");
+}
+
+SCENARIO("Strings and booleans are sent on any change", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    bool on = false;
+    char state[16] = "idle";
+    tracker.track("on", &on, BOOLEAN, 10);
+    tracker.track("state", state, STRING, 10);
+    tracker.process();
+
+    strcpy(state, "busy");
+    REQUIRE(tracker.process()==1);
+    REQUIRE(sent.back()=="state=busy");
+    on = true;
+    REQUIRE(tracker.process()==1);
+    REQUIRE(sent.back()=="on=1");
+}
+
+SCENARIO("Changes the sender refuses are sent later", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    int32_t a = 1;
+    tracker.track("a", &a, INT, 0);
+    tracker.process();
+
+    a = 2;
+    accept = false;
+    REQUIRE(tracker.process()==0);
+    accept = true;
+    REQUIRE(tracker.process()==1);
+    REQUIRE(sent.back()=="a=2");
+
+    Spark_Variable_Push_Stats_TypeDef stats;
+    tracker.stats(&stats);
+    REQUIRE(stats.refused==1);
+}
+
+SCENARIO("Changes that don't fit in one event are sent by the next pass", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    char keys[8][13];
+    int32_t values[8];
+    for (int i=0; i<8; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "sensor%06d", i);
+        values[i] = 1000 + i;
+        tracker.track(keys[i], &values[i], INT, 0);
+    }
+    int total = 0;
+    for (int pass=0; pass<8 && total<8; pass++) {
+        int changes = tracker.process();
+        REQUIRE(changes>0);
+        REQUIRE(sent.back().size()<VARIABLE_TRACKER_DATA_LENGTH);
+        total += changes;
+    }
+    REQUIRE(total==8);
+    REQUIRE(sent.size()>1);
+    REQUIRE(tracker.process()==0);
+}
+
+SCENARIO("Keys that fill the key length are not read beyond it", "[variabletracker]") {
+    reset();
+    VariableTracker tracker(recordSend);
+    char key[17] = "abcdefghijklmnop";
+    int32_t v = 7;
+    tracker.track(key, &v, INT, 0);
+    tracker.process();
+    REQUIRE(sent.back()=="abcdefghijkl=7");
+}
+
+SCENARIO("A full tracker refuses more variables", "[variabletracker]") {
+    VariableTracker tracker(recordSend);
+    int32_t v = 0;
+    for (int i=0; i<VARIABLE_TRACKER_MAX_COUNT; i++)
+        REQUIRE(tracker.track("v", &v, INT, 0));
+    REQUIRE(!tracker.track("v", &v, INT, 0));
+    REQUIRE(tracker.count()==VARIABLE_TRACKER_MAX_COUNT);
+}